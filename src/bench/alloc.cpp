@@ -0,0 +1,235 @@
+// Steady state allocation check: warms a simulated server up with each message type, then
+// counts the heap allocations made while handling more of them. Building and sending the
+// messages is not counted, only the server's steps. The heartbeat is enabled, so that the
+// clients' timers are armed throughout. Exits with an error if the server allocated.
+// Usage: bench_alloc [clients], with 1000 clients by default.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+#include <bench/sim.hpp>
+#include <client/message.hpp>
+#include <server/message.hpp>
+#include <util/allocations.hpp>
+
+
+namespace tp3::bench::alloc {
+	using sim::bytes;
+
+	constexpr int warmup_rounds = 4;
+	constexpr int rounds = 16;
+
+
+	// A fixed width name, so that renames don't need larger storage once warmed up.
+	bytes name(char prefix, std::size_t index) {
+		char name[16];
+		std::snprintf(name, sizeof(name), "%c%07zu", prefix, index);
+
+		return bytes(name);
+	}
+
+
+	class check {
+	protected:
+		sim::simulation& simulation;
+		bool failed = false;
+
+	public:
+		check(sim::simulation& simulation)
+			: simulation(simulation)
+		{
+			std::printf("case\tmessages\tallocations\tbytes\n");
+		}
+
+		bool passed() const noexcept {
+			return !this->failed;
+		}
+
+
+		// Each round, the first senders clients send make(client, round), unless empty, and
+		// the clock advances by elapse, handled in one step.
+		void run(
+			const char* name,
+			std::size_t senders,
+			const std::function<bytes(std::size_t, int)>& make,
+			std::chrono::nanoseconds elapse = {}
+		) {
+			tp3::util::allocations::counters total;
+
+			for (int round = 0; round < warmup_rounds + rounds; ++round) {
+				for (std::size_t client = 0; client < senders; ++client)
+					if (const auto packet = make(client, round); packet.size() > 0)
+						this->simulation.send(client, packet);
+
+				this->simulation.advance(elapse);
+
+				tp3::util::allocations::scope scope;
+				this->simulation.step();
+				const auto counted = scope.counted();
+
+				this->simulation.drain();
+
+				if (round >= warmup_rounds) {
+					total.allocations += counted.allocations;
+					total.bytes += counted.bytes;
+				}
+			}
+
+			std::printf(
+				"%s\t%zu\t%llu\t%llu\n",
+				name,
+				senders * rounds,
+				(unsigned long long) total.allocations,
+				(unsigned long long) total.bytes
+			);
+
+			if (total.allocations > 0)
+				this->failed = true;
+		}
+	};
+
+
+	int main(int argc, char* argv[]) {
+		using namespace tp3::server::message;
+
+		const std::size_t clients = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+
+		if (clients < 2) {
+			std::fprintf(stderr, "Usage: %s [clients], with at least 2 clients\n", argv[0]);
+			return 1;
+		}
+
+		tp3::server::config config;
+		config.heartbeat = std::chrono::seconds(1);
+
+		sim::simulation simulation(clients, config);
+		check check(simulation);
+
+		const std::size_t senders = std::min<std::size_t>(clients, 100);
+
+		// the simulation names client i as i. The targets cycle within the warm up rounds, as
+		// the first delivery to a client grows its in-memory pipe.
+		check.run(
+			"unicast.64",
+			senders,
+			[&](std::size_t client, int round) {
+				return encode(
+					unicast(sim::name((client + 1 + round % warmup_rounds) % clients), sim::text(64))
+				);
+			}
+		);
+
+		check.run(
+			"unicast_handle.64",
+			senders,
+			[&](std::size_t client, int round) {
+				return encode(
+					unicast_handle(sim::handle((client + 1 + round % warmup_rounds) % clients), sim::text(64))
+				);
+			}
+		);
+
+		check.run(
+			"multicast.20",
+			senders,
+			[&](std::size_t client, int round) {
+				auto targets = sim::names(client + 1 + round % warmup_rounds, 20, clients);
+				targets.push_back(bytes("nobody"));
+
+				return encode(multicast(targets, sim::text(64)));
+			}
+		);
+
+		check.run(
+			"unicast.unknown",
+			senders,
+			[](std::size_t, int) { return encode(unicast(bytes("nobody"), sim::text(64))); }
+		);
+
+		// the senders join a room in the first round, joining again is a no-op.
+		check.run(
+			"room.join",
+			senders,
+			[](std::size_t, int) { return encode(join(bytes("room"))); }
+		);
+
+		check.run(
+			"publish.64",
+			senders,
+			[](std::size_t, int) { return encode(publish(bytes("room"), sim::text(64))); }
+		);
+
+		// the senders block the next client in the first round, blocking again is a no-op. The
+		// broadcasts then filter through their block lists.
+		check.run(
+			"block",
+			senders,
+			[&](std::size_t client, int) { return encode(block(sim::name((client + 1) % clients))); }
+		);
+
+		check.run(
+			"broadcast.64",
+			1,
+			[](std::size_t, int) { return encode(broadcast(sim::text(64))); }
+		);
+
+		check.run(
+			"list_users",
+			10,
+			[](std::size_t, int) { return encode(list_users()); }
+		);
+
+		check.run(
+			"list_users.page",
+			10,
+			[](std::size_t client, int) { return encode(list_users(client * 10, 16, bytes("1"))); }
+		);
+
+		check.run(
+			"name.rename",
+			senders,
+			[](std::size_t client, int round) {
+				return encode(tp3::server::message::name(alloc::name(round % 2 ? 'b' : 'a', client)));
+			}
+		);
+
+		check.run(
+			"name.taken",
+			senders,
+			[&](std::size_t client, int) {
+				return encode(tp3::server::message::name(alloc::name('b', (client + 1) % senders)));
+			}
+		);
+
+		check.run(
+			"name.anonymous",
+			senders,
+			[](std::size_t client, int round) {
+				return encode(
+					tp3::server::message::name(round % 2 ? alloc::name('c', client) : bytes())
+				);
+			}
+		);
+
+		// every other round, the clients are idle for the heartbeat, and pinged, and then they
+		// answer. Every client answers, so that none times out.
+		check.run(
+			"heartbeat",
+			clients,
+			[](std::size_t, int round) { return round % 2 ? encode(pong()) : bytes(); },
+			config.heartbeat
+		);
+
+		return check.passed() ? 0 : 1;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	return tp3::bench::alloc::main(argc, argv);
+}
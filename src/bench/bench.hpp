@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+
+// A minimal microbenchmark harness. Results are printed as TSV, one line per case, so
+// that runs of different builds can be compared with standard tools.
+namespace tp3::bench {
+	using clock = std::chrono::steady_clock;
+
+
+	// Keep the compiler from optimizing away the computation of value.
+	template<typename T>
+	inline void keep(const T& value) noexcept {
+		asm volatile("" : : "r"(&value) : "memory");
+	}
+
+
+	// Times the measured part of a benchmark body.
+	class timer {
+	protected:
+		clock::time_point start;
+		double elapsed = 0; // nanoseconds.
+
+	public:
+		void resume() noexcept {
+			this->start = clock::now();
+		}
+
+		void pause() noexcept {
+			this->elapsed += std::chrono::duration<double, std::nano>(clock::now() - this->start).count();
+		}
+
+		double nanoseconds() const noexcept {
+			return this->elapsed;
+		}
+	};
+
+
+	class suite {
+	protected:
+		const std::string bench;
+		const std::string filter; // Only cases whose name contains the filter are run.
+
+		static constexpr double min_time = 50e6; // nanoseconds per run.
+		static constexpr int runs = 5;
+
+
+	public:
+		suite(const char* bench, const char* filter = nullptr)
+			: bench(bench),
+			  filter(filter ? filter : "")
+		{
+			std::printf("bench\tcase\tops\tns_per_op\tmb_per_sec\n");
+		}
+
+
+		// Run a benchmark case. body(ops, timer) must perform ops operations, resuming the
+		// timer only around the measured part. The number of operations grows until a run
+		// takes at least min_time, and the fastest of a few runs is reported.
+		// bytes is the number of bytes processed per operation, or 0 if not meaningful.
+		template<typename Body>
+		void run(const std::string& name, std::size_t bytes, Body body) {
+			if (name.find(this->filter) == std::string::npos)
+				return;
+
+			std::size_t ops = 1;
+			double elapsed;
+
+			while (true) {
+				timer timer;
+				body(ops, timer);
+				elapsed = timer.nanoseconds();
+
+				if (elapsed >= min_time || ops >= (std::size_t(1) << 30))
+					break;
+
+				// grow towards min_time, at most 10x at a time.
+				ops = std::max<std::size_t>(
+					ops + 1,
+					ops * std::min(10.0, 1.2 * min_time / std::max(elapsed, 1.0))
+				);
+			}
+
+			for (int i = 1; i < runs; ++i) {
+				timer timer;
+				body(ops, timer);
+				elapsed = std::min(elapsed, timer.nanoseconds());
+			}
+
+			const double ns_per_op = elapsed / ops;
+
+			std::printf(
+				"%s\t%s\t%zu\t%.2f\t%.1f\n",
+				this->bench.c_str(),
+				name.c_str(),
+				ops,
+				ns_per_op,
+				bytes == 0 ? 0 : bytes * 1e3 / ns_per_op
+			);
+
+			std::fflush(stdout);
+		}
+	};
+}
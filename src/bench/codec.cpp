@@ -0,0 +1,375 @@
+// Codec and framing microbenchmarks: message decoding and encoding in both directions,
+// framing under different fragmentation patterns, boxed_array construction and hashing,
+// and catalogue lookups. Usage: bench_codec [filter], where only the cases whose name
+// contains filter are run.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <bench/bench.hpp>
+#include <client/message.hpp>
+#include <server/message.hpp>
+#include <socket/result.hpp>
+#include <util/boxed_array.hpp>
+#include <util/read_buffer.hpp>
+
+
+namespace tp3::bench::codec {
+	template<typename T>
+	using boxed_array = tp3::util::boxed_array<T>;
+
+	using bytes = boxed_array<uint8_t>;
+
+	// Messages are encoded in batches, as encoding consumes the message.
+	constexpr std::size_t batch_size = 1024;
+
+
+	bytes text(std::size_t size, uint8_t fill = 'a') {
+		bytes text(size);
+		std::fill(text.begin(), text.end(), fill);
+
+		return text;
+	}
+
+	// A user name with a distinct prefix, so names differ early as real ones do.
+	bytes user(std::size_t index, std::size_t size = 8) {
+		auto name = std::to_string(index);
+		name.resize(std::max(size, name.size()), 'u');
+
+		return bytes(name.c_str());
+	}
+
+	std::vector<bytes> users(std::size_t count) {
+		std::vector<bytes> users;
+		users.reserve(count);
+
+		for (std::size_t i = 0; i < count; ++i)
+			users.push_back(user(i));
+
+		return users;
+	}
+
+
+	// Decode the given frame repeatedly.
+	template<typename Variant, typename Decode>
+	void decode(suite& suite, const std::string& name, const bytes& frame, Decode decode) {
+		suite.run(
+			name,
+			frame.size(),
+			[&](std::size_t ops, timer& timer) {
+				uint8_t* const end = const_cast<uint8_t*>(frame.end());
+
+				timer.resume();
+
+				for (std::size_t i = 0; i < ops; ++i) {
+					uint8_t* begin = const_cast<uint8_t*>(frame.begin());
+					std::optional<Variant> message = decode(begin, end);
+					keep(message);
+				}
+
+				timer.pause();
+			}
+		);
+	}
+
+	// Encode copies of the given message, made outside of the measured part.
+	template<typename Variant, typename Make, typename Encode>
+	void encode(suite& suite, const std::string& name, Make make, Encode encode) {
+		const std::size_t size = encode(make()).size();
+
+		suite.run(
+			name,
+			size,
+			[&](std::size_t ops, timer& timer) {
+				std::vector<Variant> batch;
+				batch.reserve(batch_size);
+
+				for (std::size_t done = 0; done < ops; ) {
+					batch.clear();
+
+					for (std::size_t i = 0; i < batch_size && done + i < ops; ++i)
+						batch.push_back(make());
+
+					timer.resume();
+
+					for (auto& message : batch) {
+						auto packet = encode(std::move(message));
+						keep(packet);
+					}
+
+					timer.pause();
+
+					done += batch.size();
+				}
+			}
+		);
+	}
+
+
+	void server_codec(suite& suite) {
+		using namespace tp3::server::message;
+
+		auto decoder = [](uint8_t*& begin, uint8_t* end) {
+			return tp3::server::message::decode(begin, end);
+		};
+
+		auto encoder = [](variant&& message) {
+			return tp3::server::message::encode(std::move(message));
+		};
+
+		auto run = [&](const std::string& name, auto make) {
+			decode<variant>(suite, "server.decode." + name, encoder(make()), decoder);
+			encode<variant>(suite, "server.encode." + name, make, encoder);
+		};
+
+		run("name", [] { return variant(tp3::server::message::name(user(1, 16))); });
+		run("list_users", [] { return variant(list_users()); });
+		run("broadcast.64", [] { return variant(broadcast(text(64))); });
+		run("broadcast.1024", [] { return variant(broadcast(text(1024))); });
+		run("broadcast.16384", [] { return variant(broadcast(text(16384))); });
+		run("unicast.64", [] { return variant(unicast(user(1, 16), text(64))); });
+	}
+
+
+	void client_codec(suite& suite) {
+		using namespace tp3::client::message;
+
+		auto decoder = [](uint8_t*& begin, uint8_t* end) {
+			return tp3::client::message::decode(begin, end);
+		};
+
+		auto encoder = [](variant&& message) {
+			return tp3::client::message::encode(std::move(message));
+		};
+
+		auto run = [&](const std::string& name, auto make) {
+			decode<variant>(suite, "client.decode." + name, encoder(make()), decoder);
+			encode<variant>(suite, "client.encode." + name, make, encoder);
+		};
+
+		run("error", [] { return variant(error(error_token::invalid_target)); });
+		run("text.64", [] { return variant(tp3::client::message::text(user(1, 16), codec::text(64))); });
+		run("text.1024", [] { return variant(tp3::client::message::text(user(1, 16), codec::text(1024))); });
+
+		for (std::size_t count : { 10, 1000, 10000 }) {
+			const auto list = users(count);
+
+			run(
+				"users_list." + std::to_string(count),
+				[&] { return variant(users_list(std::vector<bytes>(list))); }
+			);
+		}
+	}
+
+
+	// A source that delivers a stream in fragments of the given sizes, cyclically.
+	class fragments {
+	protected:
+		const std::vector<uint8_t>& stream;
+		const std::vector<std::size_t>& sizes;
+
+		mutable std::size_t position = 0;
+		mutable std::size_t next = 0;
+
+	public:
+		fragments(const std::vector<uint8_t>& stream, const std::vector<std::size_t>& sizes)
+			: stream(stream),
+			  sizes(sizes) { }
+
+		bool done() const noexcept {
+			return this->position == this->stream.size();
+		}
+
+		tp3::socket::result recv(uint8_t buffer[], std::size_t size) const {
+			size = std::min({ size, this->sizes[this->next], this->stream.size() - this->position });
+
+			std::copy(
+				this->stream.begin() + this->position,
+				this->stream.begin() + this->position + size,
+				buffer
+			);
+
+			this->position += size;
+			this->next = (this->next + 1) % this->sizes.size();
+
+			return { .size = size };
+		}
+	};
+
+
+	void framing(suite& suite) {
+		constexpr std::size_t buffer_size = 4096;
+		using buffer = tp3::util::read_buffer<buffer_size>;
+
+		std::mt19937 random(1);
+		std::uniform_int_distribution<std::size_t> mtu(1, 1460);
+
+		std::vector<std::size_t> random_sizes(4096);
+
+		for (auto& size : random_sizes)
+			size = mtu(random);
+
+		const std::pair<std::string, std::vector<std::size_t>> patterns[] = {
+			{ "1", { 1 } },
+			{ "7", { 7 } },
+			{ "1460", { 1460 } },
+			{ "bulk", { buffer_size } },
+			{ "random", random_sizes }
+		};
+
+		for (std::size_t body_size : { 64, 1024 }) {
+			const auto frame = tp3::server::message::encode(tp3::server::message::broadcast(text(body_size)));
+
+			for (const auto& [pattern, sizes] : patterns)
+				suite.run(
+					"framing.broadcast." + std::to_string(body_size) + ".fragment." + pattern,
+					frame.size(),
+					[&](std::size_t ops, timer& timer) {
+						std::vector<uint8_t> stream;
+						stream.reserve(ops * frame.size());
+
+						for (std::size_t i = 0; i < ops; ++i)
+							stream.insert(stream.end(), frame.begin(), frame.end());
+
+						buffer buffer;
+						fragments source(stream, sizes);
+
+						timer.resume();
+
+						while (!source.done()) {
+							buffer.read(source);
+
+							while (
+								auto message = buffer.template next<tp3::server::message::variant>(
+									tp3::server::message::decode<buffer::parser_iter>,
+									tp3::server::message::token_value(tp3::server::message::token::heading),
+									tp3::server::message::token_value(tp3::server::message::token::end)
+								)
+							)
+								keep(message);
+						}
+
+						timer.pause();
+					}
+				);
+		}
+	}
+
+
+	void boxed_arrays(suite& suite) {
+		for (std::size_t size : { 16, 256 }) {
+			const auto source = text(size);
+			const std::vector<uint8_t> vector(source.begin(), source.end());
+			const auto suffix = "." + std::to_string(size);
+
+			suite.run(
+				"boxed_array.from_iterators" + suffix,
+				size,
+				[&](std::size_t ops, timer& timer) {
+					timer.resume();
+
+					for (std::size_t i = 0; i < ops; ++i) {
+						bytes array(vector.begin(), vector.end());
+						keep(array);
+					}
+
+					timer.pause();
+				}
+			);
+
+			suite.run(
+				"boxed_array.copy" + suffix,
+				size,
+				[&](std::size_t ops, timer& timer) {
+					timer.resume();
+
+					for (std::size_t i = 0; i < ops; ++i) {
+						bytes array(source);
+						keep(array);
+					}
+
+					timer.pause();
+				}
+			);
+
+			suite.run(
+				"boxed_array.hash" + suffix,
+				size,
+				[&](std::size_t ops, timer& timer) {
+					const std::hash<bytes> hash;
+
+					timer.resume();
+
+					for (std::size_t i = 0; i < ops; ++i) {
+						auto value = hash(source);
+						keep(value);
+					}
+
+					timer.pause();
+				}
+			);
+		}
+	}
+
+
+	// Lookups in a catalogue like the server's, mapping user names to client indexes.
+	void catalogue(suite& suite) {
+		for (std::size_t count : { 100, 10000, 100000 }) {
+			std::unordered_map<bytes, std::size_t> catalogue;
+
+			for (std::size_t i = 0; i < count; ++i)
+				catalogue.emplace(user(i), i);
+
+			std::vector<bytes> hits, misses;
+
+			for (std::size_t i = 0; i < batch_size; ++i) {
+				hits.push_back(user(i * 7919 % count));
+				misses.push_back(user(count + i));
+			}
+
+			auto run = [&](const std::string& name, const std::vector<bytes>& keys) {
+				suite.run(
+					"catalogue." + std::to_string(count) + "." + name,
+					0,
+					[&](std::size_t ops, timer& timer) {
+						timer.resume();
+
+						for (std::size_t i = 0; i < ops; ++i) {
+							auto found = catalogue.find(keys[i % keys.size()]);
+							keep(found);
+						}
+
+						timer.pause();
+					}
+				);
+			};
+
+			run("hit", hits);
+			run("miss", misses);
+		}
+	}
+
+
+	int main(int argc, char* argv[]) {
+		suite suite("codec", argc > 1 ? argv[1] : nullptr);
+
+		server_codec(suite);
+		client_codec(suite);
+		framing(suite);
+		boxed_arrays(suite);
+		catalogue(suite);
+
+		return 0;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	return tp3::bench::codec::main(argc, argv);
+}
@@ -0,0 +1,122 @@
+// Framing benchmark: feeds a stream of large messages to a read_buffer in fragments of
+// different sizes. The cost per byte should be constant regardless of fragmentation and
+// message size, showing that no data is rescanned.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <server/message.hpp>
+#include <socket/result.hpp>
+#include <util/read_buffer.hpp>
+
+
+namespace tp3::bench::framer {
+	// A source that delivers a stream in fixed size fragments.
+	class fragments {
+	protected:
+		const std::vector<uint8_t>& stream;
+		const std::size_t fragment;
+
+		mutable std::size_t position = 0;
+
+	public:
+		fragments(const std::vector<uint8_t>& stream, std::size_t fragment)
+			: stream(stream),
+			  fragment(fragment) { }
+
+		bool done() const noexcept {
+			return this->position == this->stream.size();
+		}
+
+		tp3::socket::result recv(uint8_t buffer[], std::size_t size) const {
+			size = std::min({ size, this->fragment, this->stream.size() - this->position });
+
+			std::copy(
+				this->stream.begin() + this->position,
+				this->stream.begin() + this->position + size,
+				buffer
+			);
+
+			this->position += size;
+
+			return { .size = size };
+		}
+	};
+
+
+	// A stream of broadcast messages with the given body size.
+	std::vector<uint8_t> make_stream(std::size_t body_size, std::size_t total_size) {
+		std::vector<uint8_t> stream;
+		stream.reserve(total_size + body_size + 3);
+
+		while (stream.size() < total_size) {
+			stream.push_back(tp3::server::message::token_value(tp3::server::message::token::heading));
+			stream.push_back(tp3::server::message::token_value(tp3::server::message::token::broadcast));
+			stream.insert(stream.end(), body_size, 'a');
+			stream.push_back(tp3::server::message::token_value(tp3::server::message::token::end));
+		}
+
+		return stream;
+	}
+
+
+	template<std::size_t buffer_size>
+	void run(std::size_t body_size, std::size_t fragment) {
+		const auto stream = make_stream(body_size, 16 << 20);
+
+		tp3::util::read_buffer<buffer_size> buffer;
+		fragments source(stream, fragment);
+
+		std::size_t messages = 0;
+
+		const auto start = std::chrono::steady_clock::now();
+
+		while (!source.done()) {
+			buffer.read(source);
+
+			while (
+				buffer.template next<tp3::server::message::variant>(
+					tp3::server::message::decode<typename tp3::util::read_buffer<buffer_size>::parser_iter>,
+					tp3::server::message::token_value(tp3::server::message::token::heading),
+					tp3::server::message::token_value(tp3::server::message::token::end)
+				)
+			)
+				++messages;
+		}
+
+		const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::printf(
+			"framer\t%zu\t%zu\t%zu\t%zu\t%.3f\n",
+			buffer_size,
+			body_size,
+			fragment,
+			messages,
+			elapsed.count() / stream.size()
+		);
+	}
+
+
+	int main() {
+		std::printf("bench\tbuffer\tbody\tfragment\tmessages\tns_per_byte\n");
+
+		const std::size_t fragments[] = { 1, 1460, 65536 }; // single byte, MTU sized, bulk.
+
+		for (auto fragment : fragments) {
+			run<65536>(1000, fragment);
+			run<65536>(10000, fragment);
+			run<65536>(60000, fragment);
+		}
+
+		return 0;
+	}
+}
+
+
+int main() {
+	return tp3::bench::framer::main();
+}
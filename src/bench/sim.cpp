@@ -0,0 +1,258 @@
+// Event loop simulation benchmark: drives the server step by step over the in-memory
+// transport, with many virtual clients, and times the steps only. The results measure the
+// CPU cost of routing and fan-out, free from the noise of the kernel's network stack.
+// Usage: bench_sim [filter] [clients], where only the cases whose name contains filter are
+// run, with 100000 clients by default.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bench/bench.hpp>
+#include <bench/sim.hpp>
+#include <server/message.hpp>
+
+
+namespace tp3::bench::sim {
+	// Time batches of messages, each sent by a random client and handled in a single step.
+	template<typename Make>
+	void messages(suite& suite, simulation& simulation, const std::string& name, std::size_t bytes, std::size_t batch, Make make) {
+		suite.run(
+			name,
+			bytes,
+			[&](std::size_t ops, timer& timer) {
+				std::uniform_int_distribution<std::size_t> client(0, simulation.clients() - 1);
+
+				for (std::size_t done = 0; done < ops; ) {
+					const std::size_t count = std::min(batch, ops - done);
+
+					for (std::size_t i = 0; i < count; ++i)
+						simulation.send(client(simulation.random), make());
+
+					timer.resume();
+					simulation.step();
+					timer.pause();
+
+					simulation.drain();
+					done += count;
+				}
+			}
+		);
+	}
+
+
+	int main(int argc, char* argv[]) {
+		suite suite("sim", argc > 1 ? argv[1] : nullptr);
+
+		const std::size_t clients = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+		const std::string prefix = "sim." + std::to_string(clients) + ".";
+
+		// The heartbeat: every client is idle for the heartbeat at once, and pinged in a
+		// single step, then answers. Run first, with its own simulation, so that only one
+		// simulation is alive at a time.
+		{
+			tp3::server::config config;
+			config.heartbeat = std::chrono::seconds(1);
+
+			simulation simulation(clients, config);
+
+			const auto pong = tp3::server::message::encode(tp3::server::message::pong());
+
+			suite.run(
+				prefix + "heartbeat",
+				0,
+				[&](std::size_t ops, timer& timer) {
+					for (std::size_t i = 0; i < ops; ++i) {
+						simulation.advance(config.heartbeat);
+
+						timer.resume();
+						simulation.step();
+						timer.pause();
+
+						for (std::size_t client = 0; client < simulation.clients(); ++client)
+							simulation.send(client, pong);
+
+						simulation.step();
+						simulation.drain();
+					}
+				}
+			);
+		}
+
+		simulation simulation(clients);
+
+		std::uniform_int_distribution<std::size_t> target(0, clients - 1);
+
+		// The cost of polling with nothing to do, included in every step.
+		suite.run(
+			prefix + "idle",
+			0,
+			[&](std::size_t ops, timer& timer) {
+				timer.resume();
+
+				for (std::size_t i = 0; i < ops; ++i)
+					simulation.step();
+
+				timer.pause();
+			}
+		);
+
+		messages(
+			suite, simulation, prefix + "unicast.64", 64, 1000,
+			[&] {
+				return tp3::server::message::encode(
+					tp3::server::message::unicast(name(target(simulation.random)), text(64))
+				);
+			}
+		);
+
+		messages(
+			suite, simulation, prefix + "unicast_handle.64", 64, 1000,
+			[&] {
+				return tp3::server::message::encode(
+					tp3::server::message::unicast_handle(handle(target(simulation.random)), text(64))
+				);
+			}
+		);
+
+		messages(
+			suite, simulation, prefix + "multicast.20.64", 64, 100,
+			[&] {
+				return tp3::server::message::encode(
+					tp3::server::message::multicast(names(target(simulation.random), 20, clients), text(64))
+				);
+			}
+		);
+
+		// A room with 1000 members, published to by random clients.
+		for (std::size_t client = 0; client < std::min<std::size_t>(clients, 1000); ++client)
+			simulation.send(client, tp3::server::message::encode(tp3::server::message::join(bytes("room"))));
+
+		simulation.step();
+		simulation.drain();
+
+		messages(
+			suite, simulation, prefix + "publish.1000.64", 64, 10,
+			[] {
+				return tp3::server::message::encode(
+					tp3::server::message::publish(bytes("room"), text(64))
+				);
+			}
+		);
+
+		messages(
+			suite, simulation, prefix + "broadcast.64", 64, 1,
+			[] { return tp3::server::message::encode(tp3::server::message::broadcast(text(64))); }
+		);
+
+		// The same, with every client blocking another.
+		for (std::size_t client = 0; client < clients; ++client)
+			simulation.send(
+				client,
+				tp3::server::message::encode(tp3::server::message::block(name(target(simulation.random))))
+			);
+
+		simulation.step();
+		simulation.drain();
+
+		messages(
+			suite, simulation, prefix + "broadcast.64.blocking", 64, 1,
+			[] { return tp3::server::message::encode(tp3::server::message::broadcast(text(64))); }
+		);
+
+		// The latency of a unicast by a random client while the first client floods the
+		// server with pipelined broadcasts, bounded by the message budget.
+		suite.run(
+			prefix + "flood.unicast",
+			0,
+			[&](std::size_t ops, timer& timer) {
+				const auto flood = tp3::server::message::encode(tp3::server::message::broadcast(text(1)));
+				const auto unicast = tp3::server::message::encode(tp3::server::message::unicast(name(0), text(64)));
+
+				std::uniform_int_distribution<std::size_t> client(1, simulation.clients() - 1);
+
+				for (std::size_t i = 0; i < ops; ++i) {
+					for (std::size_t j = 0; j < 256; ++j)
+						simulation.send(0, flood);
+
+					simulation.send(client(simulation.random), unicast);
+
+					// the first client doesn't get its own broadcasts, only the unicast.
+					timer.resume();
+
+					while (simulation.received(0) == 0)
+						simulation.step();
+
+					timer.pause();
+
+					for (std::size_t j = 0; j < 256 / 64 + 1; ++j) {
+						simulation.step();
+						simulation.drain();
+					}
+				}
+			}
+		);
+
+		messages(
+			suite, simulation, prefix + "list_users", 0, 10,
+			[] { return tp3::server::message::encode(tp3::server::message::list_users()); }
+		);
+
+		// A page of the names starting with a digit, at a random offset.
+		messages(
+			suite, simulation, prefix + "list_users.page", 0, 10,
+			[&] {
+				return tp3::server::message::encode(
+					tp3::server::message::list_users(target(simulation.random), 16, bytes("1"))
+				);
+			}
+		);
+
+		// Connections accepted, named and disconnected, in batches of the accept budget.
+		suite.run(
+			prefix + "churn",
+			0,
+			[&](std::size_t ops, timer& timer) {
+				for (std::size_t done = 0; done < ops; ) {
+					const std::size_t count = std::min<std::size_t>(256, ops - done);
+
+					timer.resume();
+					simulation.disconnect(simulation.connect(count));
+					timer.pause();
+
+					done += count;
+				}
+			}
+		);
+
+		// Named clients disconnected, in batches of the accept budget: the leave cost alone.
+		suite.run(
+			prefix + "leave",
+			0,
+			[&](std::size_t ops, timer& timer) {
+				for (std::size_t done = 0; done < ops; ) {
+					const std::size_t count = std::min<std::size_t>(256, ops - done);
+					const std::size_t first = simulation.connect(count);
+
+					timer.resume();
+					simulation.disconnect(first);
+					timer.pause();
+
+					done += count;
+				}
+			}
+		);
+
+		return 0;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	return tp3::bench::sim::main(argc, argv);
+}
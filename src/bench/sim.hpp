@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <server/message.hpp>
+#include <server/server.hpp>
+#include <socket/memory.hpp>
+#include <util/boxed_array.hpp>
+
+
+// A simulated server, driven step by step over the in-memory transport.
+namespace tp3::bench::sim {
+	namespace memory = tp3::socket::memory;
+
+	using bytes = tp3::util::boxed_array<uint8_t>;
+
+	constexpr std::size_t buffer_size = 4096;
+
+
+	inline bytes name(std::size_t index) {
+		return bytes(std::to_string(index).c_str());
+	}
+
+	// The session handle of client index. The clients are given the first sessions, in order.
+	inline uint32_t handle(std::size_t index) {
+		return uint32_t(index) << tp3::server::sessions::generation_bits;
+	}
+
+	// The names of count clients from first on, wrapping around, for multicasts.
+	inline std::vector<bytes> names(std::size_t first, std::size_t count, std::size_t clients) {
+		std::vector<bytes> names;
+
+		for (std::size_t i = 0; i < count; ++i)
+			names.push_back(name((first + i) % clients));
+
+		return names;
+	}
+
+	inline bytes text(std::size_t size) {
+		bytes text(size);
+		std::fill(text.begin(), text.end(), 'a');
+
+		return text;
+	}
+
+
+	// A server with named virtual clients, all connected through the same network.
+	class simulation {
+	protected:
+		memory::network network;
+		tp3::server::server<buffer_size, memory::transport> server;
+
+		std::vector<memory::peer> peers;
+		std::size_t next_name = 0; // Names are unique, even across reconnections.
+
+
+	public:
+		std::mt19937 random;
+
+
+		simulation(std::size_t clients, const tp3::server::config& config = {})
+			: server(
+			  	memory::transport(this->network),
+			  	memory::server(this->network),
+			  	config
+			  ),
+			  random(1)
+		{
+			this->connect(clients);
+		}
+
+
+		std::size_t clients() const noexcept {
+			return this->peers.size();
+		}
+
+
+		// Connect and name clients, returning the index of the first.
+		std::size_t connect(std::size_t count) {
+			const std::size_t first = this->peers.size();
+
+			for (std::size_t i = 0; i < count; ++i) {
+				this->peers.push_back(this->network.connect());
+				this->send(
+					this->peers.size() - 1,
+					tp3::server::message::encode(tp3::server::message::name(name(this->next_name++)))
+				);
+			}
+
+			while (this->network.pending() > 0)
+				this->server.step();
+
+			this->server.step(); // read the names.
+			this->drain(first);
+
+			return first;
+		}
+
+		// Disconnect the clients from first on.
+		void disconnect(std::size_t first) {
+			for (std::size_t i = first; i < this->peers.size(); ++i)
+				this->peers[i].close();
+
+			this->peers.erase(this->peers.begin() + first, this->peers.end());
+
+			this->server.step();
+		}
+
+
+		void send(std::size_t peer, const bytes& packet) {
+			this->peers[peer].send(packet.get(), packet.size());
+		}
+
+		void step() {
+			this->server.step();
+		}
+
+		// Advance the network's virtual clock, for the server's timers.
+		void advance(memory::clock::duration duration) noexcept {
+			this->network.advance(duration);
+		}
+
+		// How many bytes the server sent to a client, not yet drained.
+		std::size_t received(std::size_t peer) const {
+			return this->peers[peer].available();
+		}
+
+		// Discard what the server sent to the clients, from first on.
+		void drain(std::size_t first = 0) {
+			for (auto peer = this->peers.begin() + first; peer != this->peers.end(); ++peer)
+				peer->consume(peer->available());
+		}
+	};
+}
@@ -0,0 +1,197 @@
+// Connection storm benchmark: runs a server in a background thread and opens many
+// connections to it at once, as clients reconnecting after a deploy would. Each
+// connection sends a list_users request as soon as it is established, and the time until
+// its reply arrives is the time to first message.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <server/server.hpp>
+
+
+namespace tp3::bench::storm {
+	using clock = std::chrono::steady_clock;
+
+	struct peer {
+		int fd;
+		clock::time_point start;
+		bool sent = false;
+		double ttfm = -1; // time to first message, in milliseconds.
+	};
+
+
+	volatile std::sig_atomic_t stop = 0; // never set, the server runs until the process exits.
+
+
+	void serve(const char* port, tp3::server::config config, std::promise<void>& ready) {
+		tp3::server::server<1024> server(
+			tp3::socket::addr(
+				tp3::socket::name("::", port),
+				(addrinfo) {
+					.ai_family = AF_UNSPEC,
+					.ai_socktype = SOCK_STREAM
+				}
+			),
+			config
+		);
+
+		ready.set_value();
+
+		server.process(stop);
+	}
+
+
+	int main(int argc, char* argv[]) {
+		if (argc < 2) {
+			std::cerr << "Usage: " << argv[0] << " <port> [connections] [backlog] [accept_budget]"
+			          << std::endl;
+			return 1;
+		}
+
+		const char* port = argv[1];
+		const std::size_t connections = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5000;
+
+		tp3::server::config config;
+
+		if (argc > 3)
+			config.backlog = std::strtoul(argv[3], nullptr, 10);
+
+		if (argc > 4)
+			config.accept_budget = std::strtoul(argv[4], nullptr, 10);
+
+		std::promise<void> ready;
+		std::thread(serve, port, config, std::ref(ready)).detach();
+		ready.get_future().wait();
+
+		const tp3::socket::addr address(
+			tp3::socket::name("localhost", port),
+			(addrinfo) {
+				.ai_family = AF_UNSPEC,
+				.ai_socktype = SOCK_STREAM
+			}
+		);
+
+		const uint8_t request[] = {
+			tp3::server::message::token_value(tp3::server::message::token::heading),
+			tp3::server::message::token_value(tp3::server::message::token::list_users),
+			tp3::server::message::token_value(tp3::server::message::token::end)
+		};
+
+		std::vector<peer> peers;
+		std::vector<pollfd> poll_peers;
+
+		peers.reserve(connections);
+		poll_peers.reserve(connections);
+
+		const auto start = clock::now();
+
+		// Open all connections at once, without waiting for any of them.
+		for (std::size_t i = 0; i < connections; ++i) {
+			const int fd = ::socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK, 0);
+
+			if (fd < 0) {
+				std::perror("socket");
+				return 1;
+			}
+
+			const auto now = clock::now();
+
+			if (::connect(fd, address->ai_addr, address->ai_addrlen) < 0 && errno != EINPROGRESS) {
+				std::perror("connect");
+				return 1;
+			}
+
+			peers.push_back(peer { .fd = fd, .start = now });
+			poll_peers.push_back(pollfd { .fd = fd, .events = POLLOUT });
+		}
+
+		// Send a request when connected, and wait for the reply.
+		std::size_t pending = connections;
+		std::size_t errors = 0;
+
+		while (pending > 0) {
+			if (::poll(poll_peers.data(), poll_peers.size(), 10000) <= 0) {
+				std::cerr << "timed out with " << pending << " pending connections" << std::endl;
+				break;
+			}
+
+			for (std::size_t i = 0; i < connections; ++i) {
+				auto& peer = peers[i];
+				auto& poll_peer = poll_peers[i];
+
+				if (poll_peer.revents & (POLLERR | POLLHUP)) {
+					++errors;
+					--pending;
+					poll_peer.fd = -1;
+				}
+				else if (poll_peer.revents & POLLOUT && !peer.sent) {
+					if (::send(peer.fd, request, sizeof(request), MSG_NOSIGNAL) != sizeof(request))
+						continue;
+
+					peer.sent = true;
+					poll_peer.events = POLLIN;
+				}
+				else if (poll_peer.revents & POLLIN) {
+					uint8_t reply[1024];
+
+					if (::recv(peer.fd, reply, sizeof(reply), 0) <= 0)
+						++errors;
+					else
+						peer.ttfm = std::chrono::duration<double, std::milli>(clock::now() - peer.start).count();
+
+					--pending;
+					poll_peer.fd = -1;
+				}
+			}
+		}
+
+		const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+		std::vector<double> ttfm;
+
+		for (const auto& peer : peers)
+			if (peer.ttfm >= 0)
+				ttfm.push_back(peer.ttfm);
+
+		std::sort(ttfm.begin(), ttfm.end());
+
+		auto percentile = [&](double p) {
+			return ttfm.empty() ? 0 : ttfm[std::min(ttfm.size() - 1, std::size_t(p * ttfm.size()))];
+		};
+
+		std::printf("bench\tconnections\terrors\tseconds\taccepts_per_sec\tttfm_p50_ms\tttfm_p99_ms\tttfm_max_ms\n");
+		std::printf(
+			"storm\t%zu\t%zu\t%.3f\t%.0f\t%.3f\t%.3f\t%.3f\n",
+			connections,
+			errors,
+			elapsed,
+			ttfm.size() / elapsed,
+			percentile(0.5),
+			percentile(0.99),
+			ttfm.empty() ? 0 : ttfm.back()
+		);
+
+		std::fflush(stdout);
+		::_exit(0); // the server thread never returns.
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	return tp3::bench::storm::main(argc, argv);
+}
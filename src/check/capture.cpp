@@ -0,0 +1,78 @@
+// Capture writer check: destroys writers while the writer thread is writing a large batch of
+// records, with more records still buffered, and checks that every record reaches the trace
+// file, in order. Exits with an error if a record is lost.
+// Usage: check_capture [path], with a file in /tmp by default.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <server/capture.hpp>
+
+
+namespace tp3::check::capture {
+	namespace capture = tp3::server::capture;
+
+	constexpr int runs = 8;
+	constexpr uint32_t records = 1 << 10; // Per batch.
+	constexpr std::size_t record_size = 16 << 10; // A batch of 16 MiB, slow to write.
+
+
+	// Write two batches, handing the first to the writer thread, and destroy the writer while
+	// it writes the first. Returns whether the file holds both, in order.
+	bool run(const std::string& path) {
+		const std::vector<uint8_t> data(record_size, 'x');
+
+		{
+			capture::writer writer(path);
+
+			for (uint32_t i = 0; i < records; ++i)
+				writer.write(capture::type::data, i, data.data(), data.size());
+
+			writer.flush();
+
+			for (uint32_t i = records; i < 2 * records; ++i)
+				writer.write(capture::type::connected, i);
+		}
+
+		std::ifstream file(path, std::ios::binary);
+
+		if (!capture::read_header(file))
+			return false;
+
+		uint32_t count = 0;
+
+		while (const auto record = capture::read(file)) {
+			if (record->connection != count)
+				return false;
+
+			++count;
+		}
+
+		std::printf("%u of %u records\n", count, 2 * records);
+
+		return count == 2 * records;
+	}
+
+
+	int main(int argc, char* argv[]) {
+		const std::string path = argc > 1 ? argv[1] : "/tmp/check_capture.tp3c";
+
+		bool passed = true;
+
+		for (int i = 0; i < runs; ++i)
+			passed = run(path) && passed;
+
+		std::remove(path.c_str());
+
+		return passed ? 0 : 1;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	return tp3::check::capture::main(argc, argv);
+}
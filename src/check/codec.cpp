@@ -0,0 +1,135 @@
+// Codec check: decodes crafted frames whose numbers are out of range, which must be rejected
+// instead of wrapping around, and in range ones, which must decode. Exits with an error if a
+// frame decodes otherwise.
+// Usage: check_codec
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <server/message.hpp>
+
+
+namespace tp3::check::codec {
+	using namespace tp3::server::message;
+
+
+	class check {
+	protected:
+		bool failed = false;
+
+	public:
+		bool passed() const noexcept {
+			return !this->failed;
+		}
+
+
+		// Decode a frame of the given bytes, expecting it to decode as Message or not, and to
+		// pass a check of the decoded message.
+		template<typename Message, typename Check>
+		void run(const char* name, const std::vector<uint8_t>& frame, bool decodes, Check check) {
+			auto begin = frame.begin();
+			const auto message = Message::decode(begin, frame.end());
+
+			const bool passed = message ? decodes && check(*message) : !decodes;
+
+			std::printf("%s\t%s\n", name, passed ? "ok" : "failed");
+
+			if (!passed)
+				this->failed = true;
+		}
+
+		template<typename Message>
+		void run(const char* name, const std::vector<uint8_t>& frame, bool decodes) {
+			this->run<Message>(name, frame, decodes, [](const Message&) { return true; });
+		}
+	};
+
+
+	// A frame of the given kind and body.
+	std::vector<uint8_t> frame(token kind, const std::string& body) {
+		const std::string frame = char(token_value(token::heading))
+		                        + (char(token_value(kind)) + body)
+		                        + char(token_value(token::end));
+
+		return std::vector<uint8_t>(frame.begin(), frame.end());
+	}
+
+	std::vector<uint8_t> handle_frame(const std::string& target) {
+		return frame(token::unicast_handle, target + char(token_value(token::text)) + "text");
+	}
+
+
+	std::vector<uint8_t> page_frame(const std::string& offset, const std::string& limit) {
+		const char separator = token_value(token::user_sep);
+
+		return frame(token::list_users, offset + separator + limit + separator + "a");
+	}
+
+
+	int main() {
+		check check;
+
+		check.run<unicast_handle>(
+			"unicast_handle.max",
+			handle_frame("4294967295"),
+			true,
+			[](const auto& message) { return message.target == UINT32_MAX; }
+		);
+
+		check.run<unicast_handle>(
+			"unicast_handle.above_max",
+			handle_frame("4294967296"),
+			false
+		);
+
+		// 2^64 + 1 wraps to handle 1.
+		check.run<unicast_handle>(
+			"unicast_handle.wrap",
+			handle_frame("18446744073709551617"),
+			false
+		);
+
+		check.run<unicast_handle>(
+			"unicast_handle.digits",
+			handle_frame("000000000000000000000000000001"),
+			true,
+			[](const auto& message) { return message.target == 1; }
+		);
+
+		check.run<list_users>(
+			"list_users.page",
+			page_frame("4294967295", "16"),
+			true,
+			[](const auto& message) { return message.query->offset == UINT32_MAX && message.query->limit == 16; }
+		);
+
+		// 2^64 + 1 wraps to offset 1.
+		check.run<list_users>(
+			"list_users.offset_wrap",
+			page_frame("18446744073709551617", "16"),
+			false
+		);
+
+		check.run<list_users>(
+			"list_users.limit_wrap",
+			page_frame("0", "18446744073709551616"),
+			false
+		);
+
+		check.run<list_users>(
+			"list_users.offset_above_max",
+			page_frame("4294967296", "16"),
+			false
+		);
+
+		return check.passed() ? 0 : 1;
+	}
+}
+
+
+int main() {
+	return tp3::check::codec::main();
+}
@@ -5,15 +5,18 @@
 #include <algorithm>
 #include <array>
 #include <cerrno>
+#include <charconv>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <optional>
+#include <set>
 #include <string>
 #include <system_error>
 #include <variant>
+#include <vector>
 
 #include <client/server.hpp>
 #include <socket/addr.hpp>
@@ -33,6 +36,11 @@ namespace tp3::client {
 
 		std::array<pollfd, 2> poll_files; // stdin, server socket
 
+		// The users known from the presence deltas, when subscribed. The users list the
+		// server sends on subscribing is the starting point.
+		bool watching = false;
+		std::set<std::string> roster;
+
 
 	public:
 		client(tp3::socket::addr&& address)
@@ -68,6 +76,12 @@ namespace tp3::client {
 			if (input == "users")
 				return tp3::server::message::list_users();
 
+			if (input == "watch")
+				return tp3::server::message::subscribe();
+
+			if (input == "unwatch")
+				return tp3::server::message::unsubscribe();
+
 			const auto begin = input.begin();
 			const auto end = input.end();
 
@@ -97,6 +111,106 @@ namespace tp3::client {
 				);
 			}
 
+			auto number = [&](auto begin, auto end) -> std::optional<std::size_t> {
+				const char* first = input.data() + (begin - input.begin());
+				const char* last = input.data() + (end - input.begin());
+
+				std::size_t number;
+				const auto result = std::from_chars(first, last, number);
+
+				if (first == last || result.ec != std::errc() || result.ptr != last)
+					return {};
+
+				return number;
+			};
+
+			if (equals(begin, delimiter, "users")) {
+				// users;<offset>;<limit>[;<prefix>]
+				const auto delimiter2 = std::find(delimiter + 1, end, ';');
+				const auto delimiter3 = std::find(delimiter2, end, ';');
+
+				const auto offset = number(delimiter + 1, delimiter2);
+				const auto limit = number(delimiter2 + (delimiter2 != end), delimiter3);
+
+				if (!offset || !limit)
+					return {};
+
+				return tp3::server::message::list_users(
+					*offset,
+					*limit,
+					boxed_array<uint8_t>(delimiter3 + (delimiter3 != end), end)
+				);
+			}
+
+			if (equals(begin, delimiter, "to")) {
+				auto delimiter2 = std::find(delimiter + 1, end, ';');
+				const auto handle = number(delimiter + 1, delimiter2);
+
+				if (delimiter2 == end || !handle || *handle > UINT32_MAX)
+					return {};
+
+				return tp3::server::message::unicast_handle(
+					*handle,
+					boxed_array<uint8_t>(delimiter2 + 1, end)
+				);
+			}
+
+			if (equals(begin, delimiter, "join")) {
+				return tp3::server::message::join(
+					boxed_array<uint8_t>(delimiter + 1, end)
+				);
+			}
+
+			if (equals(begin, delimiter, "leave")) {
+				return tp3::server::message::leave(
+					boxed_array<uint8_t>(delimiter + 1, end)
+				);
+			}
+
+			if (equals(begin, delimiter, "block")) {
+				return tp3::server::message::block(
+					boxed_array<uint8_t>(delimiter + 1, end)
+				);
+			}
+
+			if (equals(begin, delimiter, "unblock")) {
+				return tp3::server::message::unblock(
+					boxed_array<uint8_t>(delimiter + 1, end)
+				);
+			}
+
+			if (equals(begin, delimiter, "room")) {
+				auto delimiter2 = std::find(delimiter + 1, end, ';');
+
+				if (delimiter2 == end)
+					return {};
+
+				return tp3::server::message::publish(
+					boxed_array<uint8_t>(delimiter + 1, delimiter2),
+					boxed_array<uint8_t>(delimiter2 + 1, end)
+				);
+			}
+
+			if (equals(begin, delimiter, "multi")) {
+				// multi;<target>,<target>...;<message>
+				auto delimiter2 = std::find(delimiter + 1, end, ';');
+
+				if (delimiter2 == end)
+					return {};
+
+				std::vector<boxed_array<uint8_t>> targets;
+
+				for (auto target = delimiter + 1, comma = target; comma != delimiter2; target = comma + 1) {
+					comma = std::find(target, delimiter2, ',');
+					targets.emplace_back(target, comma);
+				}
+
+				return tp3::server::message::multicast(
+					targets,
+					boxed_array<uint8_t>(delimiter2 + 1, end)
+				);
+			}
+
 			if (equals(begin, delimiter, "uni")) {
 				auto delimiter2 = std::find(delimiter + 1, end, ';');
 
@@ -113,8 +227,31 @@ namespace tp3::client {
 		}
 
 
-		void process_incoming_message() {
-			if (auto message = this->server.read()) {
+		// Replace the roster with the named users of a users list.
+		void reset_roster(const tp3::client::message::users_list& msg) {
+			this->roster.clear();
+
+			for (const auto& user : msg.users)
+				this->roster.emplace(user.begin(), user.end());
+		}
+
+		void print_roster() const {
+			if (!this->watching) {
+				std::cout << "not watching (use watch)." << std::endl;
+				return;
+			}
+
+			std::cout << "roster:" << std::endl;
+
+			for (const auto& user : this->roster)
+				std::cout << user << std::endl;
+		}
+
+
+		void process_incoming_messages() {
+			this->server.receive();
+
+			while (auto message = this->server.next()) {
 				std::visit(
 					tp3::util::overload {
 						[](const tp3::client::message::error& msg) {
@@ -126,24 +263,85 @@ namespace tp3::client {
 								case tp3::client::message::error_token::invalid_target:
 									std::cout << "error: invalid target";
 									break;
+
+								case tp3::client::message::error_token::invalid_targets:
+									std::cout << "error: invalid targets:";
+
+									for (const auto& target : msg.targets)
+										std::cout << ' ' << target;
+
+									break;
+
+								case tp3::client::message::error_token::server_busy:
+									std::cout << "error: server busy, message dropped";
+									break;
 							}
 						},
 
-						[](const tp3::client::message::users_list& msg) {
+						[this](const tp3::client::message::users_list& msg) {
+							if (this->watching)
+								this->reset_roster(msg);
+
 							std::cout << "users:" << std::endl;
 
 							for (const auto& user : msg.users)
 								std::cout << user << std::endl;
+
+							if (msg.anonymous)
+								std::cout << "anonymous(" << *msg.anonymous << ')' << std::endl;
+						},
+
+						[](const tp3::client::message::users_page& msg) {
+							std::cout << "users (" << msg.users.size() << " of " << msg.total << "):";
+
+							for (const auto& user : msg.users)
+								std::cout << std::endl << user.name << " #" << user.handle;
+						},
+
+						[](const tp3::client::message::session& msg) {
+							std::cout << "handle: #" << msg.handle;
+						},
+
+						[this](const tp3::client::message::ping&) {
+							this->server.send(tp3::server::message::pong());
+						},
+
+						[](const tp3::client::message::room_text& msg) {
+							std::cout << '[' << msg.room << "] " << msg.sender << ": " << msg.body;
 						},
 
 						[](const tp3::client::message::text& msg) {
 							std::cout << msg.sender << ": " << msg.body;
+						},
+
+						[this](const tp3::client::message::joined& msg) {
+							if (this->watching)
+								this->roster.emplace(msg.name.begin(), msg.name.end());
+
+							std::cout << "joined: " << msg.name;
+						},
+
+						[this](const tp3::client::message::left& msg) {
+							if (this->watching)
+								this->roster.erase(std::string(msg.name.begin(), msg.name.end()));
+
+							std::cout << "left: " << msg.name;
+						},
+
+						[this](const tp3::client::message::renamed& msg) {
+							if (this->watching) {
+								this->roster.erase(std::string(msg.from.begin(), msg.from.end()));
+								this->roster.emplace(msg.to.begin(), msg.to.end());
+							}
+
+							std::cout << "renamed: " << msg.from << " -> " << msg.to;
 						}
 					},
 					*message
 				);
 
-				std::cout << std::endl;
+				if (!std::holds_alternative<tp3::client::message::ping>(*message)) // answered silently.
+					std::cout << std::endl;
 			}
 		}
 
@@ -170,16 +368,32 @@ namespace tp3::client {
 					if (input == "exit")
 						return;
 
-					if (auto message = this->parse(input))
+					if (input == "roster")
+						this->print_roster();
+					else if (auto message = this->parse(input)) {
+						if (std::holds_alternative<tp3::server::message::subscribe>(*message))
+							this->watching = true;
+						else if (std::holds_alternative<tp3::server::message::unsubscribe>(*message)) {
+							this->watching = false;
+							this->roster.clear();
+						}
+
 						this->server.send(std::move(*message));
+					}
 					else
 						std::cout << "invalid message." << std::endl;
 				}
 
 				auto& server = this->poll_files.back();
 
-				if (server.revents & POLLIN)
-					this->process_incoming_message();
+				if (server.revents & (POLLIN | POLLHUP | POLLERR)) {
+					this->process_incoming_messages();
+
+					if (!this->server.connected()) {
+						std::cout << "server disconnected." << std::endl;
+						return;
+					}
+				}
 			}
 		}
 	};
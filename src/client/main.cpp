@@ -1,40 +1,82 @@
 #include "main.hpp"
 
+#include <cstdlib>
 #include <iostream>
 
 #include <netdb.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include <client/client.hpp>
 
 
 namespace tp3::client::main {
+	void usage(char* program) {
+		std::cerr << "Usage: " << program << " [-b buffer_size] <ip> <port>" << std::endl;
+		std::cerr << "Supported buffer sizes:";
+
+		for (auto size : buffer_sizes::values)
+			std::cerr << ' ' << size;
+
+		std::cerr << " (default " << default_buffer_size << ")" << std::endl;
+		::exit(1);
+	}
+
+
 	args parse_args(int argc, char** argv) {
-		if (argc < 3) {
+		std::size_t buffer_size = default_buffer_size;
+
+		int option;
+
+		// http://man7.org/linux/man-pages/man3/getopt.3.html
+		while ((option = ::getopt(argc, argv, "b:")) != -1)
+			switch (option) {
+				case 'b': {
+					char* end;
+					buffer_size = std::strtoul(optarg, &end, 10);
+
+					if (*end != '\0' || !buffer_sizes::contains(buffer_size)) {
+						std::cerr << "Invalid buffer size: " << optarg << std::endl;
+						usage(argv[0]);
+					}
+
+					break;
+				}
+
+				default:
+					usage(argv[0]);
+			}
+
+		if (argc - optind < 2) {
 			std::cerr << "Missing arguments" << std::endl;
-			std::cerr << "Usage: " << argv[0] << " <ip> <port>" << std::endl;
-			::exit(1);
+			usage(argv[0]);
 		}
 
 		return (args) {
 			.address = tp3::socket::addr(
-				tp3::socket::name(argv[1], argv[2]),
+				tp3::socket::name(argv[optind], argv[optind + 1]),
 				(addrinfo) {
 					.ai_family = AF_UNSPEC, // accept both ipv4 and ipv6
 					.ai_socktype = SOCK_STREAM // force TCP
 				}
-			)
+			),
+			.buffer_size = buffer_size
 		};
 	}
 
 	int main(int argc, char* argv[]) try {
 		args args = parse_args(argc, argv);
 
-		tp3::client::client<1024> client(
-			std::move(args.address)
-		);
+		buffer_sizes::call(
+			args.buffer_size,
+			[&](auto buffer_size) {
+				tp3::client::client<buffer_size> client(
+					std::move(args.address)
+				);
 
-		client.process();
+				client.process();
+			}
+		);
 
 		return 0;
 	}
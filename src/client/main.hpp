@@ -1,13 +1,24 @@
 #pragma once
 
+#include <cstddef>
+
 #include <socket/addr.hpp>
+#include <util/dispatch.hpp>
 
 
 namespace tp3::client::main {
+	// The buffer sizes the client is compiled for, selectable at runtime.
+	using buffer_sizes = tp3::util::size_dispatch<512, 1024, 4096, 16384, 65536>;
+
+	constexpr std::size_t default_buffer_size = 1024;
+
+
 	struct args {
 		tp3::socket::addr address;
+		std::size_t buffer_size;
 	};
 
+	void usage(char* program);
 	args parse_args(int argc, char** argv);
 
 	int main(int argc, char* argv[]);
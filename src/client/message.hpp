@@ -1,7 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <charconv>
 #include <numeric>
+#include <cstddef>
 #include <cstdint>
 #include <type_traits>
 #include <variant>
@@ -9,6 +11,7 @@
 #include <vector>
 
 #include <util/boxed_array.hpp>
+#include <util/number.hpp>
 #include <util/overload.hpp>
 #include <util/token.hpp>
 
@@ -21,12 +24,21 @@ namespace tp3::client::message {
 		heading = 0x01,        // Start of heading character
 		end = 0x04,            // End of transmission character
 		user_sep = 0x1F,       // Unit separator character
-		text_start = 0x02      // Start of text character
+		text_start = 0x02,     // Start of text character
+		joined = 0x06,         // Acknowledge character
+		left = 0x18,           // Cancel character
+		renamed = 0x1A,        // Substitute character
+		users_page = 0x0C,     // Form feed character
+		session = 0x12,        // Device control two character
+		room_text = 0x93,      // Set transmit state character
+		ping = 0x07            // Bell character
 	};
 
 	enum class error_token : uint8_t {
 		invalid_name = 0x01,
-		invalid_target = 0x02
+		invalid_target = 0x02,
+		invalid_targets = 0x03, // Followed by the unknown targets of a multicast.
+		server_busy = 0x05     // The server is overloaded and shed the message.
 	};
 
 
@@ -34,16 +46,34 @@ namespace tp3::client::message {
 	using boxed_array = tp3::util::boxed_array<T>;
 
 
+	inline std::size_t number_size(std::size_t number) noexcept {
+		char digits[20];
+
+		return std::to_chars(digits, digits + sizeof(digits), number).ptr - digits;
+	}
+
+	inline uint8_t* encode_number(uint8_t* packet_it, std::size_t number) noexcept {
+		char digits[20];
+		const char* digits_end = std::to_chars(digits, digits + sizeof(digits), number).ptr;
+
+		return std::copy(static_cast<const char*>(digits), digits_end, packet_it);
+	}
+
+
 	class error {
 	public:
 		static constexpr std::size_t min_size = 4; // minimum message size.
 
 		error_token token;
+		std::vector<boxed_array<uint8_t>> targets; // The unknown targets, if invalid_targets.
 
 		error(const error&) = delete;
 		error(error&& other) noexcept = default;
 		error(error_token token) noexcept
 			:token(token) { }
+		error(std::vector<boxed_array<uint8_t>>&& targets) noexcept
+			: token(error_token::invalid_targets),
+			  targets(std::move(targets)) { }
 
 		error& operator=(const error&) = delete;
 		error& operator=(error&&) = default;
@@ -66,7 +96,9 @@ namespace tp3::client::message {
 
 			const auto errors = {
 				error_token::invalid_name,
-				error_token::invalid_target
+				error_token::invalid_target,
+				error_token::invalid_targets,
+				error_token::server_busy
 			};
 
 			auto err = std::find_if(
@@ -82,6 +114,24 @@ namespace tp3::client::message {
 
 			++begin;
 
+			if (*err == error_token::invalid_targets) {
+				const auto targets_end = std::find(begin, end, util::token_value(token::end));
+
+				if (targets_end == end)
+					return {};
+
+				std::vector<boxed_array<uint8_t>> targets;
+
+				for (auto separator = begin; separator != targets_end; begin = separator + 1) {
+					separator = std::find(begin, targets_end, util::token_value(token::user_sep));
+					targets.emplace_back(begin, separator);
+				}
+
+				begin = targets_end + 1; // leave begin at the end of the parsed data.
+
+				return error(std::move(targets));
+			}
+
 			if (*begin != util::token_value(token::end))
 				return {};
 
@@ -97,16 +147,44 @@ namespace tp3::client::message {
 		static constexpr std::size_t min_size = 3; // minimum message size.
 
 		std::vector<boxed_array<uint8_t>> users;
+		std::optional<std::size_t> anonymous; // The count of anonymous users, if listed.
 
 		users_list(const users_list&) = delete;
 		users_list(users_list&& other) noexcept = default;
-		users_list(std::vector<boxed_array<uint8_t>>&& users) noexcept
-			: users(std::move(users)) { }
+		users_list(std::vector<boxed_array<uint8_t>>&& users, std::optional<std::size_t> anonymous = {}) noexcept
+			: users(std::move(users)),
+			  anonymous(anonymous) { }
 
 		users_list& operator=(const users_list&) = delete;
 		users_list& operator=(users_list&&) = default;
 
 
+		static constexpr const char anonymous_prefix[] = "anonymous(";
+		static constexpr std::size_t anonymous_prefix_size = sizeof(anonymous_prefix) - 1;
+
+
+	protected:
+		// The count of anonymous users of an entry listing them: "anonymous(count)".
+		static std::optional<std::size_t> parse_anonymous(const boxed_array<uint8_t>& entry) noexcept {
+			if (entry.size() < anonymous_prefix_size + 2
+			    || !std::equal(anonymous_prefix, anonymous_prefix + anonymous_prefix_size, entry.begin())
+			    || entry[entry.size() - 1] != ')')
+				return {};
+
+			std::size_t count = 0;
+
+			for (auto it = entry.begin() + anonymous_prefix_size; it != entry.end() - 1; ++it) {
+				if (*it < '0' || *it > '9')
+					return {};
+
+				count = count * 10 + (*it - '0');
+			}
+
+			return count;
+		}
+
+
+	public:
 		template<typename ForwardIterator>
 		static std::optional<users_list> decode(ForwardIterator& begin, ForwardIterator end) {
 			if (std::distance(begin, end) < users_list::min_size)
@@ -132,8 +210,11 @@ namespace tp3::client::message {
 
 			std::vector<boxed_array<uint8_t>> users;
 
+			// The server leaves removed names empty, which are skipped.
 			while (find_separator(token::user_sep)) {
-				users.emplace_back(begin, separator);
+				if (separator != begin)
+					users.emplace_back(begin, separator);
+
 				begin = separator + 1;
 			}
 
@@ -142,16 +223,155 @@ namespace tp3::client::message {
 				return {};
 			}
 
-			users.emplace_back(begin, separator);
+			if (separator != begin)
+				users.emplace_back(begin, separator);
+
 			begin = separator + 1;
 
+			// the anonymous users are listed last.
+			std::optional<std::size_t> anonymous;
+
+			if (!users.empty() && (anonymous = parse_anonymous(users.back())))
+				users.pop_back();
+
 			return users_list(
-				std::move(users)
+				std::move(users),
+				anonymous
 			);
 		}
 	};
 
 
+	// A page of the users list: the count of the names matching the query, and the names
+	// of the page, in byte order, each followed by its session handle.
+	class users_page {
+	public:
+		static constexpr std::size_t min_size = 4; // minimum message size.
+
+		struct user {
+			boxed_array<uint8_t> name;
+			uint32_t handle;
+		};
+
+		std::size_t total;
+		std::vector<user> users;
+
+		users_page(const users_page&) = delete;
+		users_page(users_page&& other) noexcept = default;
+		users_page(std::size_t total, std::vector<user>&& users) noexcept
+			: total(total),
+			  users(std::move(users)) { }
+
+		users_page& operator=(const users_page&) = delete;
+		users_page& operator=(users_page&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<users_page> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < users_page::min_size)
+				return {};
+
+			if (*begin != util::token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != util::token_value(token::users_page))
+				return {};
+
+			++begin;
+
+			const auto body_end = std::find(begin, end, util::token_value(token::end));
+
+			if (body_end == end)
+				return {};
+
+			auto separator = std::find(begin, body_end, util::token_value(token::user_sep));
+
+			const auto total = util::decode_number(begin, separator);
+
+			if (!total)
+				return {};
+
+			std::vector<user> users;
+
+			while (separator != body_end) {
+				begin = separator + 1;
+				separator = std::find(begin, body_end, util::token_value(token::user_sep));
+
+				// the handle follows the last text_start, as names may have text_start.
+				auto handle_start = separator;
+
+				while (handle_start != begin && *(handle_start - 1) != util::token_value(token::text_start))
+					--handle_start;
+
+				if (handle_start == begin)
+					return {};
+
+				const auto handle = util::decode_number(handle_start, separator, UINT32_MAX);
+
+				if (!handle)
+					return {};
+
+				users.push_back(user { boxed_array<uint8_t>(begin, handle_start - 1), uint32_t(*handle) });
+			}
+
+			begin = body_end + 1;  // leave begin at the end of the parsed data.
+
+			return users_page(*total, std::move(users));
+		}
+	};
+
+
+	// The session handle, in reply to a name set. Unicast messages may address a session by
+	// its handle instead of the name.
+	class session {
+	public:
+		static constexpr std::size_t min_size = 4; // minimum message size.
+
+		uint32_t handle;
+
+		session(const session&) = delete;
+		session(session&& other) noexcept = default;
+		session(uint32_t handle) noexcept
+			: handle(handle) { }
+
+		session& operator=(const session&) = delete;
+		session& operator=(session&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<session> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < session::min_size)
+				return {};
+
+			if (*begin != util::token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != util::token_value(token::session))
+				return {};
+
+			++begin;
+
+			const auto handle_end = std::find(begin, end, util::token_value(token::end));
+
+			if (handle_end == end)
+				return {};
+
+			const auto handle = util::decode_number(begin, handle_end, UINT32_MAX);
+
+			if (!handle)
+				return {};
+
+			begin = handle_end + 1;  // leave begin at the end of the parsed data.
+
+			return session(*handle);
+		}
+	};
+
+
 	class text {
 	public:
 		static constexpr std::size_t min_size = 4; // minimum message size.
@@ -214,11 +434,250 @@ namespace tp3::client::message {
 	};
 
 
+	// Presence deltas, sent to the clients subscribed to presence: a user took a name, gave
+	// it up, or changed it. Anonymous clients aren't tracked.
+	template<token kind>
+	class presence {
+	public:
+		static constexpr std::size_t min_size = 3; // minimum message size.
+
+		boxed_array<uint8_t> name;
+
+		presence(const presence&) = delete;
+		presence(presence&& other) noexcept = default;
+		presence(boxed_array<uint8_t>&& name) noexcept
+			: name(std::move(name)) { }
+
+		presence& operator=(const presence&) = delete;
+		presence& operator=(presence&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<presence> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < presence::min_size)
+				return {};
+
+			if (*begin != util::token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != util::token_value(kind))
+				return {};
+
+			const auto name = begin + 1;
+
+			const auto name_end = std::find(
+				name,
+				end,
+				util::token_value(token::end)
+			);
+
+			if (name_end == end)
+				return {};
+
+			begin = name_end + 1;  // leave begin at the end of the parsed data.
+
+			return presence(
+				boxed_array<uint8_t>(name, name_end)
+			);
+		}
+	};
+
+	using joined = presence<token::joined>;
+	using left = presence<token::left>;
+
+
+	class renamed {
+	public:
+		static constexpr std::size_t min_size = 4; // minimum message size.
+
+		boxed_array<uint8_t> from;
+		boxed_array<uint8_t> to;
+
+		renamed(const renamed&) = delete;
+		renamed(renamed&& other) noexcept = default;
+		renamed(boxed_array<uint8_t>&& from, boxed_array<uint8_t>&& to) noexcept
+			: from(std::move(from)),
+			  to(std::move(to)) { }
+
+		renamed& operator=(const renamed&) = delete;
+		renamed& operator=(renamed&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<renamed> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < renamed::min_size)
+				return {};
+
+			if (*begin != util::token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != util::token_value(token::renamed))
+				return {};
+
+			const auto from = begin + 1;
+
+			const auto from_end = std::find(
+				from,
+				end,
+				util::token_value(token::user_sep)
+			);
+
+			if (from_end == end)
+				return {};
+
+			const auto to = from_end + 1;
+
+			const auto to_end = std::find(
+				to,
+				end,
+				util::token_value(token::end)
+			);
+
+			if (to_end == end)
+				return {};
+
+			begin = to_end + 1;  // leave begin at the end of the parsed data.
+
+			return renamed(
+				boxed_array<uint8_t>(from, from_end),
+				boxed_array<uint8_t>(to, to_end)
+			);
+		}
+	};
+
+
+	// Text message published to a room the client is in.
+	class room_text {
+	public:
+		static constexpr std::size_t min_size = 5; // minimum message size.
+
+		boxed_array<uint8_t> room;
+		boxed_array<uint8_t> sender;
+		boxed_array<uint8_t> body;
+
+		room_text(const room_text&) = delete;
+		room_text(room_text&& other) noexcept = default;
+		room_text(boxed_array<uint8_t>&& room, boxed_array<uint8_t>&& sender, boxed_array<uint8_t>&& body) noexcept
+			: room(std::move(room)),
+			  sender(std::move(sender)),
+			  body(std::move(body)) { }
+
+		room_text& operator=(const room_text&) = delete;
+		room_text& operator=(room_text&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<room_text> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < room_text::min_size)
+				return {};
+
+			if (*begin != util::token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != util::token_value(token::room_text))
+				return {};
+
+			const auto room = begin + 1;
+
+			const auto room_end = std::find(
+				room,
+				end,
+				util::token_value(token::user_sep)
+			);
+
+			if (room_end == end)
+				return {};
+
+			const auto sender = room_end + 1;
+
+			const auto sender_end = std::find(
+				sender,
+				end,
+				util::token_value(token::text_start)
+			);
+
+			if (sender_end == end)
+				return {};
+
+			const auto body = sender_end + 1;
+
+			const auto body_end = std::find(
+				body,
+				end,
+				util::token_value(token::end)
+			);
+
+			if (body_end == end)
+				return {};
+
+			begin = body_end + 1;  // leave begin at the end of the parsed data.
+
+			return room_text(
+				boxed_array<uint8_t>(room, room_end),
+				boxed_array<uint8_t>(sender, sender_end),
+				boxed_array<uint8_t>(body, body_end)
+			);
+		}
+	};
+
+
+	// A heartbeat probe from the server, to be answered with a pong, see
+	// tp3::server::message::pong. A client that doesn't answer is disconnected.
+	class ping {
+	public:
+		static constexpr std::size_t min_size = 3; // minimum message size.
+
+		ping(const ping&) = delete;
+		ping(ping&& other) noexcept = default;
+		ping() noexcept = default;
+
+		ping& operator=(const ping&) = delete;
+		ping& operator=(ping&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<ping> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < ping::min_size)
+				return {};
+
+			if (*begin != util::token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != util::token_value(token::ping))
+				return {};
+
+			++begin;
+
+			if (*begin != util::token_value(token::end))
+				return {};
+
+			++begin; // leave begin at the end of the parsed data.
+
+			return ping();
+		}
+	};
+
+
 	static constexpr std::size_t min_size = [] { // minimum message size.
 		const auto messages = {
 			error::min_size,
 			users_list::min_size,
-			text::min_size
+			text::min_size,
+			joined::min_size,
+			left::min_size,
+			renamed::min_size,
+			users_page::min_size,
+			session::min_size,
+			room_text::min_size,
+			ping::min_size
 		};
 
 		return *std::max_element(
@@ -230,7 +689,14 @@ namespace tp3::client::message {
 	using variant = std::variant<
 		error,
 		users_list,
-		text
+		text,
+		joined,
+		left,
+		renamed,
+		users_page,
+		session,
+		room_text,
+		ping
 	>;
 
 
@@ -251,33 +717,333 @@ namespace tp3::client::message {
 		if (auto message = text::decode(begin, end))
 			return std::move(*message);
 
+		begin = _begin; // rollback
+
+		if (auto message = joined::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = left::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = renamed::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = users_page::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = session::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = room_text::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = ping::decode(begin, end))
+			return std::move(*message);
+
 		return {};
 	}
 
 
+	// Frame encoders writing to a caller provided buffer, so that frames can be built without
+	// allocating. Each returns the end of the written frame.
+
+	constexpr std::size_t error_size = 4; // heading + error + code + end
+
+	inline uint8_t* encode_error(uint8_t* packet_it, error_token code) noexcept {
+		*packet_it++ = util::token_value(token::heading);
+		*packet_it++ = util::token_value(token::error);
+		*packet_it++ = util::token_value(code);
+		*packet_it++ = util::token_value(token::end);
+
+		return packet_it;
+	}
+
+
+	// The invalid_targets error frame is encoded as the targets are found unknown: the start,
+	// then each target, then the end.
+	inline uint8_t* encode_targets_error_start(uint8_t* packet_it) noexcept {
+		*packet_it++ = util::token_value(token::heading);
+		*packet_it++ = util::token_value(token::error);
+		*packet_it++ = util::token_value(error_token::invalid_targets);
+
+		return packet_it;
+	}
+
+	template<typename Target>
+	uint8_t* encode_targets_error_target(uint8_t* packet_it, const Target& target, bool first) noexcept {
+		if (!first)
+			*packet_it++ = util::token_value(token::user_sep);
+
+		return std::copy(
+			target.begin(),
+			target.end(),
+			packet_it
+		);
+	}
+
+
+	template<typename Sender, typename Body>
+	std::size_t text_size(const Sender& sender, const Body& body) noexcept {
+		return 4 // heading + text + text_start + end
+		     + sender.size()
+		     + body.size();
+	}
+
+	template<typename Sender, typename Body>
+	uint8_t* encode_text(uint8_t* packet_it, const Sender& sender, const Body& body) noexcept {
+		*packet_it++ = util::token_value(token::heading);
+		*packet_it++ = util::token_value(token::text);
+
+		packet_it = std::copy(
+			sender.begin(),
+			sender.end(),
+			packet_it
+		);
+
+		*packet_it++ = util::token_value(token::text_start);
+
+		packet_it = std::copy(
+			body.begin(),
+			body.end(),
+			packet_it
+		);
+
+		*packet_it++ = util::token_value(token::end);
+
+		return packet_it;
+	}
+
+
+	template<typename Name>
+	std::size_t presence_size(const Name& name) noexcept {
+		return 3 // heading + kind + end
+		     + name.size();
+	}
+
+	// Encode a joined or left frame.
+	template<typename Name>
+	uint8_t* encode_presence(uint8_t* packet_it, token kind, const Name& name) noexcept {
+		*packet_it++ = util::token_value(token::heading);
+		*packet_it++ = util::token_value(kind);
+
+		packet_it = std::copy(
+			name.begin(),
+			name.end(),
+			packet_it
+		);
+
+		*packet_it++ = util::token_value(token::end);
+
+		return packet_it;
+	}
+
+
+	template<typename From, typename To>
+	std::size_t renamed_size(const From& from, const To& to) noexcept {
+		return 4 // heading + renamed + user_sep + end
+		     + from.size()
+		     + to.size();
+	}
+
+	template<typename From, typename To>
+	uint8_t* encode_renamed(uint8_t* packet_it, const From& from, const To& to) noexcept {
+		*packet_it++ = util::token_value(token::heading);
+		*packet_it++ = util::token_value(token::renamed);
+
+		packet_it = std::copy(
+			from.begin(),
+			from.end(),
+			packet_it
+		);
+
+		*packet_it++ = util::token_value(token::user_sep);
+
+		packet_it = std::copy(
+			to.begin(),
+			to.end(),
+			packet_it
+		);
+
+		*packet_it++ = util::token_value(token::end);
+
+		return packet_it;
+	}
+
+
+	template<typename Room, typename Sender, typename Body>
+	std::size_t room_text_size(const Room& room, const Sender& sender, const Body& body) noexcept {
+		return 5 // heading + room_text + user_sep + text_start + end
+		     + room.size()
+		     + sender.size()
+		     + body.size();
+	}
+
+	template<typename Room, typename Sender, typename Body>
+	uint8_t* encode_room_text(uint8_t* packet_it, const Room& room, const Sender& sender, const Body& body) noexcept {
+		*packet_it++ = util::token_value(token::heading);
+		*packet_it++ = util::token_value(token::room_text);
+
+		packet_it = std::copy(
+			room.begin(),
+			room.end(),
+			packet_it
+		);
+
+		*packet_it++ = util::token_value(token::user_sep);
+
+		packet_it = std::copy(
+			sender.begin(),
+			sender.end(),
+			packet_it
+		);
+
+		*packet_it++ = util::token_value(token::text_start);
+
+		packet_it = std::copy(
+			body.begin(),
+			body.end(),
+			packet_it
+		);
+
+		*packet_it++ = util::token_value(token::end);
+
+		return packet_it;
+	}
+
+
+	// The size of a users page entry: user_sep, name, text_start and handle.
+	template<typename User>
+	std::size_t users_page_entry_size(const User& user) noexcept {
+		return 2 + user.name.size() + number_size(user.handle);
+	}
+
+	// The users are anything with a name and a handle.
+	template<typename Iterator>
+	std::size_t users_page_size(std::size_t total, Iterator begin, Iterator end) noexcept {
+		return 3 // heading + users_page + end
+		     + number_size(total)
+		     + std::accumulate(
+		       	begin,
+		       	end,
+		       	std::size_t(0),
+		       	[](std::size_t acc, const auto& user) { return acc + users_page_entry_size(user); }
+		       );
+	}
+
+	template<typename Iterator>
+	uint8_t* encode_users_page(uint8_t* packet_it, std::size_t total, Iterator begin, Iterator end) noexcept {
+		*packet_it++ = util::token_value(token::heading);
+		*packet_it++ = util::token_value(token::users_page);
+
+		packet_it = encode_number(packet_it, total);
+
+		for (; begin != end; ++begin) {
+			*packet_it++ = util::token_value(token::user_sep);
+
+			packet_it = std::copy(
+				begin->name.begin(),
+				begin->name.end(),
+				packet_it
+			);
+
+			*packet_it++ = util::token_value(token::text_start);
+			packet_it = encode_number(packet_it, begin->handle);
+		}
+
+		*packet_it++ = util::token_value(token::end);
+
+		return packet_it;
+	}
+
+
+	constexpr std::size_t session_max_size = 13; // heading + session + end + 10 digits
+
+	inline std::size_t session_size(uint32_t handle) noexcept {
+		return 3 // heading + session + end
+		     + number_size(handle);
+	}
+
+	inline uint8_t* encode_session(uint8_t* packet_it, uint32_t handle) noexcept {
+		*packet_it++ = util::token_value(token::heading);
+		*packet_it++ = util::token_value(token::session);
+
+		packet_it = encode_number(packet_it, handle);
+
+		*packet_it++ = util::token_value(token::end);
+
+		return packet_it;
+	}
+
+
+	constexpr std::size_t ping_size = 3; // heading + ping + end
+
+	inline uint8_t* encode_ping(uint8_t* packet_it) noexcept {
+		*packet_it++ = util::token_value(token::heading);
+		*packet_it++ = util::token_value(token::ping);
+		*packet_it++ = util::token_value(token::end);
+
+		return packet_it;
+	}
+
+
 	boxed_array<uint8_t> encode(variant&& message) {
 		return std::visit(
 			tp3::util::overload {
 				[](const error& msg) -> boxed_array<uint8_t> {
-					const std::size_t size = 4; // heading + error + code + end
+					if (msg.token != error_token::invalid_targets) {
+						boxed_array<uint8_t> packet(error_size);
+
+						encode_error(packet.begin(), msg.token);
+
+						return packet;
+					}
+
+					const std::size_t size = std::accumulate(
+						msg.targets.begin(),
+						msg.targets.end(),
+						error_size + msg.targets.size() - (msg.targets.empty() ? 0 : 1),
+						[](std::size_t acc, const auto& target) { return acc + target.size(); }
+					);
 
 					boxed_array<uint8_t> packet(size);
 
-					auto packet_it = packet.begin();
+					auto packet_it = encode_targets_error_start(packet.begin());
+
+					for (std::size_t i = 0; i < msg.targets.size(); ++i)
+						packet_it = encode_targets_error_target(packet_it, msg.targets[i], i == 0);
 
-					*packet_it++ = util::token_value(token::heading);
-					*packet_it++ = util::token_value(token::error);
-					*packet_it++ = util::token_value(msg.token);
 					*packet_it++ = util::token_value(token::end);
 
 					return packet;
 				},
 
 				[](const users_list& msg) -> boxed_array<uint8_t> {
+					// the anonymous users are listed last, as "anonymous(count)".
+					char anonymous[users_list::anonymous_prefix_size + 21];
+					char* anonymous_end = anonymous;
+
+					if (msg.anonymous) {
+						anonymous_end = std::copy_n(users_list::anonymous_prefix, users_list::anonymous_prefix_size, anonymous);
+						anonymous_end = std::to_chars(anonymous_end, anonymous + sizeof(anonymous) - 1, *msg.anonymous).ptr;
+						*anonymous_end++ = ')';
+					}
+
 					const std::size_t size = std::accumulate(
 						msg.users.begin(),
 						msg.users.end(),
-						2, // heading + users_list
+						2 + (msg.anonymous ? anonymous_end - anonymous + 1 : 0), // heading + users_list
 						[](const auto& acc, const auto& user) {
 							return acc + user.size() + 1;
 						}
@@ -300,6 +1066,11 @@ namespace tp3::client::message {
 						*packet_it++ = util::token_value(token::user_sep);
 					}
 
+					if (msg.anonymous) {
+						packet_it = std::copy(anonymous, anonymous_end, packet_it);
+						*packet_it++ = util::token_value(token::user_sep);
+					}
+
 					packet_it--; // get back before the last user_sep
 
 					*packet_it++ = util::token_value(token::end);
@@ -308,32 +1079,67 @@ namespace tp3::client::message {
 				},
 
 				[](const text& msg) -> boxed_array<uint8_t> {
-					const std::size_t size = 4 // heading + text + text_start + end
-					                       + msg.sender.size()
-					                       + msg.body.size();
+					boxed_array<uint8_t> packet(text_size(msg.sender, msg.body));
 
-					boxed_array<uint8_t> packet(size);
+					encode_text(packet.begin(), msg.sender, msg.body);
 
-					auto packet_it = packet.begin();
+					return packet;
+				},
 
-					*packet_it++ = util::token_value(token::heading);
-					*packet_it++ = util::token_value(token::text);
+				[](const joined& msg) -> boxed_array<uint8_t> {
+					boxed_array<uint8_t> packet(presence_size(msg.name));
 
-					packet_it = std::copy(
-						msg.sender.begin(),
-						msg.sender.end(),
-						packet_it
-					);
+					encode_presence(packet.begin(), token::joined, msg.name);
 
-					*packet_it++ = util::token_value(token::text_start);
+					return packet;
+				},
 
-					packet_it = std::copy(
-						msg.body.begin(),
-						msg.body.end(),
-						packet_it
+				[](const left& msg) -> boxed_array<uint8_t> {
+					boxed_array<uint8_t> packet(presence_size(msg.name));
+
+					encode_presence(packet.begin(), token::left, msg.name);
+
+					return packet;
+				},
+
+				[](const renamed& msg) -> boxed_array<uint8_t> {
+					boxed_array<uint8_t> packet(renamed_size(msg.from, msg.to));
+
+					encode_renamed(packet.begin(), msg.from, msg.to);
+
+					return packet;
+				},
+
+				[](const users_page& msg) -> boxed_array<uint8_t> {
+					boxed_array<uint8_t> packet(
+						users_page_size(msg.total, msg.users.begin(), msg.users.end())
 					);
 
-					*packet_it++ = util::token_value(token::end);
+					encode_users_page(packet.begin(), msg.total, msg.users.begin(), msg.users.end());
+
+					return packet;
+				},
+
+				[](const session& msg) -> boxed_array<uint8_t> {
+					boxed_array<uint8_t> packet(session_size(msg.handle));
+
+					encode_session(packet.begin(), msg.handle);
+
+					return packet;
+				},
+
+				[](const room_text& msg) -> boxed_array<uint8_t> {
+					boxed_array<uint8_t> packet(room_text_size(msg.room, msg.sender, msg.body));
+
+					encode_room_text(packet.begin(), msg.room, msg.sender, msg.body);
+
+					return packet;
+				},
+
+				[](const ping&) -> boxed_array<uint8_t> {
+					boxed_array<uint8_t> packet(ping_size);
+
+					encode_ping(packet.begin());
 
 					return packet;
 				}
@@ -19,6 +19,8 @@ namespace tp3::client {
 		tp3::socket::connection connection;
 		tp3::util::read_buffer<buffer_size> read_buffer;
 
+		bool disconnected = false; // Whether the server closed the connection.
+
 
 	public:
 		server(tp3::socket::addr&& addr)
@@ -35,14 +37,20 @@ namespace tp3::client {
 		}
 
 
-		bool connected() const {
-			return !this->connection.is_closed();
+		bool connected() const noexcept {
+			return !this->disconnected;
 		}
 
 
-		std::optional<message::variant> read() {
-			return this->read_buffer.template read<message::variant>(
-				this->connection,
+		// Receive available data from the connection into the read buffer.
+		void receive() {
+			if (!this->read_buffer.full() && this->read_buffer.read(this->connection).failed())
+				this->disconnected = true;
+		}
+
+		// Extract the next buffered message, if any.
+		std::optional<message::variant> next() {
+			return this->read_buffer.template next<message::variant>(
 				message::decode<typename decltype(read_buffer)::parser_iter>,
 				util::token_value(message::token::heading),
 				util::token_value(message::token::end)
@@ -50,15 +58,26 @@ namespace tp3::client {
 		}
 
 
-		void send(tp3::server::message::variant&& message) const {
+		void send(tp3::server::message::variant&& message) {
 			auto packet = tp3::server::message::encode(
 				std::move(message)
 			);
 
-			this->connection.send(
-				packet.get(),
-				packet.size()
-			);
+			const uint8_t* data = packet.get();
+			std::size_t size = packet.size();
+
+			// The connection is blocking, so only signals may interrupt the sending.
+			while (size > 0) {
+				const auto result = this->connection.send(data, size);
+
+				if (result.failed()) {
+					this->disconnected = true;
+					return;
+				}
+
+				data += result.size;
+				size -= result.size;
+			}
 		}
 	};
 }
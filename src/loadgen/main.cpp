@@ -0,0 +1,641 @@
+// Load generator: opens many connections to a server from a single process, and drives a
+// configurable mix of name, list_users, broadcast and unicast messages at a target rate.
+// Text messages carry their send time, so each delivery's latency is measured by the
+// receiving connection. Reports throughput, delivery latency percentiles and errors as TSV.
+// The connections are non-blocking, each with a write queue flushed when the socket is
+// writable, so that a backpressured connection doesn't stall the others.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <system_error>
+#include <variant>
+#include <vector>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <socket/connection.hpp>
+#include <client/message.hpp>
+#include <server/message.hpp>
+#include <util/boxed_array.hpp>
+#include <util/dispatch.hpp>
+#include <util/histogram.hpp>
+#include <util/overload.hpp>
+#include <util/read_buffer.hpp>
+#include <util/token.hpp>
+#include <util/write_queue.hpp>
+
+
+namespace tp3::loadgen {
+	using clock = std::chrono::steady_clock;
+
+	template<typename T>
+	using boxed_array = tp3::util::boxed_array<T>;
+
+	// The buffer sizes the connections are compiled for, selectable at runtime. The users
+	// list grows with the connections, so the default is larger than the client's.
+	using buffer_sizes = tp3::util::size_dispatch<1024, 4096, 16384, 65536>;
+
+	constexpr std::size_t default_buffer_size = 16384;
+
+
+	// Message types, in the order of tp3::server::message::variant.
+	constexpr const char* message_names[] = { "name", "list_users", "broadcast", "unicast" };
+	constexpr std::size_t message_types = std::size(message_names);
+
+
+	struct args {
+		const char* host;
+		const char* port;
+		std::size_t buffer_size = default_buffer_size;
+		std::size_t connections = 1000;
+		double duration = 10; // seconds.
+		double rate = 5000; // messages per second, across all connections.
+		std::size_t text_size = 64; // bytes of text in broadcast and unicast messages.
+		unsigned weights[message_types] = { 1, 1, 1, 97 }; // the traffic mix.
+		unsigned seed = 1;
+	};
+
+
+	struct results {
+		std::size_t connect_errors = 0; // connections that failed to establish.
+		std::size_t disconnections = 0;
+		uint64_t sent[message_types] = { };
+		uint64_t delivered = 0; // text messages received.
+		uint64_t users_lists = 0;
+		uint64_t error_replies = 0;
+		tp3::util::histogram<> latency; // delivery latency, in nanoseconds.
+	};
+
+
+	void usage(char* program) {
+		std::cerr << "Usage: " << program
+		          << " [-b buffer_size] [-c connections] [-d seconds] [-r rate] [-s text_size]"
+		          << " [-m name,list_users,broadcast,unicast] [-S seed] <host> <port>"
+		          << std::endl;
+		std::cerr << "The mix gives the relative weight of each message type (default 1,1,1,97)"
+		          << std::endl;
+		std::cerr << "Supported buffer sizes:";
+
+		for (auto size : buffer_sizes::values)
+			std::cerr << ' ' << size;
+
+		std::cerr << " (default " << default_buffer_size << ")" << std::endl;
+		::exit(1);
+	}
+
+
+	double parse_number(char* program, const char* option, const char* value) {
+		char* end;
+		const auto number = std::strtod(value, &end);
+
+		if (*value == '\0' || *end != '\0' || number <= 0) {
+			std::cerr << "Invalid " << option << ": " << value << std::endl;
+			usage(program);
+		}
+
+		return number;
+	}
+
+
+	args parse_args(int argc, char** argv) {
+		args args;
+
+		int option;
+
+		// http://man7.org/linux/man-pages/man3/getopt.3.html
+		while ((option = ::getopt(argc, argv, "b:c:d:r:s:m:S:")) != -1)
+			switch (option) {
+				case 'b':
+					args.buffer_size = parse_number(argv[0], "buffer size", optarg);
+
+					if (!buffer_sizes::contains(args.buffer_size)) {
+						std::cerr << "Invalid buffer size: " << optarg << std::endl;
+						usage(argv[0]);
+					}
+
+					break;
+
+				case 'c':
+					args.connections = parse_number(argv[0], "connections", optarg);
+					break;
+
+				case 'd':
+					args.duration = parse_number(argv[0], "duration", optarg);
+					break;
+
+				case 'r':
+					args.rate = parse_number(argv[0], "rate", optarg);
+					break;
+
+				case 's':
+					args.text_size = parse_number(argv[0], "text size", optarg);
+					break;
+
+				case 'm': {
+					unsigned total = 0;
+					const char* weight = optarg;
+
+					for (std::size_t i = 0; i < message_types; ++i) {
+						char* end;
+						args.weights[i] = std::strtoul(weight, &end, 10);
+						total += args.weights[i];
+
+						if (end == weight || *end != (i + 1 < message_types ? ',' : '\0')) {
+							std::cerr << "Invalid mix: " << optarg << std::endl;
+							usage(argv[0]);
+						}
+
+						weight = end + 1;
+					}
+
+					if (total == 0) {
+						std::cerr << "Invalid mix: " << optarg << std::endl;
+						usage(argv[0]);
+					}
+
+					break;
+				}
+
+				case 'S':
+					args.seed = std::strtoul(optarg, nullptr, 10);
+					break;
+
+				default:
+					usage(argv[0]);
+			}
+
+		if (argc - optind < 2) {
+			std::cerr << "Missing arguments" << std::endl;
+			usage(argv[0]);
+		}
+
+		args.host = argv[optind];
+		args.port = argv[optind + 1];
+
+		return args;
+	}
+
+
+	// Allow as many open files as the hard limit, as each connection takes one.
+	void raise_file_limit() {
+		rlimit limit;
+
+		// http://man7.org/linux/man-pages/man2/getrlimit.2.html
+		if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+			limit.rlim_cur = limit.rlim_max;
+			::setrlimit(RLIMIT_NOFILE, &limit);
+		}
+	}
+
+
+	uint64_t timestamp() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			clock::now().time_since_epoch()
+		)
+		.count();
+	}
+
+	// A text body carrying the send time, padded to size.
+	boxed_array<uint8_t> text_body(std::size_t size) {
+		char time[24];
+		const std::size_t time_size = std::snprintf(time, sizeof(time), "%lu ", timestamp());
+
+		boxed_array<uint8_t> body(std::max(size, time_size));
+
+		std::fill(body.begin(), body.end(), 'x');
+		std::copy(time, time + time_size, body.begin());
+
+		return body;
+	}
+
+	// The send time carried by a text body.
+	std::optional<uint64_t> text_time(const boxed_array<uint8_t>& body) {
+		uint64_t time = 0;
+		std::size_t i = 0;
+
+		for (; i < body.size() && body[i] >= '0' && body[i] <= '9'; ++i)
+			time = time * 10 + (body[i] - '0');
+
+		if (i == 0 || i == body.size() || body[i] != ' ')
+			return {};
+
+		return time;
+	}
+
+
+	// A connection to the server, non-blocking, queueing what the socket can't take at once.
+	template<std::size_t buffer_size>
+	class peer {
+		static_assert(buffer_size >= tp3::client::message::min_size);
+
+	protected:
+		tp3::socket::connection connection;
+		tp3::util::read_buffer<buffer_size> read_buffer;
+		tp3::util::write_queue write_queue;
+
+		bool _established = false; // Whether connecting finished.
+		bool disconnected = false; // Whether the server closed the connection, or it failed.
+
+
+	public:
+		peer(tp3::socket::connection&& connection)
+			: connection(std::move(connection)) { }
+
+
+		int descriptor() const noexcept {
+			return this->connection.descriptor();
+		}
+
+		bool established() const noexcept {
+			return this->_established;
+		}
+
+		bool connected() const noexcept {
+			return !this->disconnected;
+		}
+
+		// Whether there is data waiting for the socket to become writable.
+		bool pending() const noexcept {
+			return !this->write_queue.empty();
+		}
+
+
+		// Finish connecting, once the socket is writable. Returns whether connected.
+		bool establish() noexcept {
+			if (this->connection.error().failed())
+				this->disconnected = true;
+			else
+				this->_established = true;
+
+			return this->_established;
+		}
+
+
+		// Receive available data from the connection into the read buffer.
+		void receive() {
+			if (!this->read_buffer.full() && this->read_buffer.read(this->connection).failed())
+				this->disconnected = true;
+		}
+
+		// Extract the next buffered message, if any.
+		std::optional<tp3::client::message::variant> next() {
+			return this->read_buffer.template next<tp3::client::message::variant>(
+				tp3::client::message::decode<typename decltype(read_buffer)::parser_iter>,
+				tp3::util::token_value(tp3::client::message::token::heading),
+				tp3::util::token_value(tp3::client::message::token::end)
+			);
+		}
+
+
+		// Send a message, queueing what the socket can't take at once.
+		void send(tp3::server::message::variant&& message) {
+			const auto packet = tp3::server::message::encode(std::move(message));
+
+			std::size_t sent = 0;
+
+			if (this->write_queue.empty() && !this->disconnected) {
+				const auto result = this->connection.send(packet.get(), packet.size());
+
+				if (result.failed())
+					this->disconnected = true;
+
+				sent = result.size;
+			}
+
+			if (!this->disconnected && sent < packet.size())
+				this->write_queue.push(packet.get() + sent, packet.size() - sent);
+		}
+
+		// Send queued data until the socket would block.
+		void flush() {
+			if (this->write_queue.flush(this->connection).failed())
+				this->disconnected = true;
+		}
+	};
+
+
+	template<std::size_t buffer_size>
+	class generator {
+	protected:
+		using connection = loadgen::peer<buffer_size>;
+
+		const loadgen::args& args;
+
+		std::vector<connection> connections;
+		std::vector<pollfd> poll_connections;
+
+		std::size_t connecting = 0; // Connections yet to be established.
+
+		std::mt19937 random;
+		std::discrete_distribution<std::size_t> mix;
+
+		loadgen::results results;
+
+
+		// Poll for writable data, until the connection is established, and for received data.
+		void watch(std::size_t i) {
+			auto& connection = this->connections[i];
+			auto& poll_connection = this->poll_connections[i];
+
+			if (!connection.connected()) {
+				if (poll_connection.fd >= 0)
+					++this->results.disconnections;
+
+				poll_connection.fd = -1;
+				return;
+			}
+
+			poll_connection.events = POLLIN;
+
+			if (!connection.established() || connection.pending())
+				poll_connection.events |= POLLOUT;
+		}
+
+
+		// Establish, flush and receive on the ready connections, and account for the received
+		// messages.
+		void poll(int timeout) {
+			if (::poll(this->poll_connections.data(), this->poll_connections.size(), timeout) <= 0)
+				return;
+
+			const auto now = timestamp();
+
+			for (std::size_t i = 0; i < this->connections.size(); ++i) {
+				auto& poll_connection = this->poll_connections[i];
+
+				if (poll_connection.revents == 0)
+					continue;
+
+				auto& connection = this->connections[i];
+
+				if (!connection.established()) {
+					if (!(poll_connection.revents & (POLLOUT | POLLHUP | POLLERR)))
+						continue;
+
+					--this->connecting;
+
+					if (!connection.establish()) {
+						++this->results.connect_errors;
+						poll_connection.fd = -1;
+						continue;
+					}
+				}
+
+				if (poll_connection.revents & (POLLOUT | POLLERR))
+					connection.flush();
+
+				if (poll_connection.revents & (POLLIN | POLLHUP | POLLERR)) {
+					connection.receive();
+
+					while (auto message = connection.next())
+						std::visit(
+							tp3::util::overload {
+								[&](const tp3::client::message::error&) {
+									++this->results.error_replies;
+								},
+
+								[&](const tp3::client::message::users_list&) {
+									++this->results.users_lists;
+								},
+
+								[&](const tp3::client::message::text& msg) {
+									++this->results.delivered;
+
+									if (auto time = text_time(msg.body))
+										this->results.latency.record(now - std::min(now, *time));
+								},
+
+								[&](const tp3::client::message::ping&) {
+									connection.send(tp3::server::message::pong());
+								},
+
+								[](const auto&) { } // presence deltas, never subscribed to.
+							},
+							*message
+						);
+				}
+
+				this->watch(i);
+			}
+		}
+
+
+		// A message of the given type from the given connection. Connections are named by
+		// their index.
+		tp3::server::message::variant message(std::size_t type, std::size_t from) {
+			switch (type) {
+				case 0:
+					return tp3::server::message::name(boxed_array<uint8_t>(std::to_string(from).c_str()));
+
+				case 1:
+					return tp3::server::message::list_users();
+
+				case 2:
+					return tp3::server::message::broadcast(text_body(this->args.text_size));
+
+				default: {
+					const std::size_t to = this->random() % this->connections.size();
+
+					return tp3::server::message::unicast(
+						boxed_array<uint8_t>(std::to_string(to).c_str()),
+						text_body(this->args.text_size)
+					);
+				}
+			}
+		}
+
+		// Send a random message from a random connection.
+		void send_one() {
+			const std::size_t from = this->random() % this->connections.size();
+			const std::size_t type = this->mix(this->random);
+
+			auto& connection = this->connections[from];
+
+			if (!connection.established() || !connection.connected())
+				return;
+
+			connection.send(this->message(type, from));
+			this->watch(from);
+
+			++this->results.sent[type];
+		}
+
+
+	public:
+		generator(const loadgen::args& args)
+			: args(args),
+			  random(args.seed),
+			  mix(std::begin(args.weights), std::end(args.weights))
+		{
+			// Resolve once, as every connection is to the same address.
+			const tp3::socket::addr address(
+				tp3::socket::name(args.host, args.port),
+				(addrinfo) {
+					.ai_family = AF_UNSPEC,
+					.ai_socktype = SOCK_STREAM
+				}
+			);
+
+			this->connections.reserve(args.connections);
+			this->poll_connections.reserve(args.connections);
+
+			for (std::size_t i = 0; i < args.connections; ++i) {
+				auto [result, connection] = tp3::socket::connection::connect(tp3::socket::addr(address));
+
+				if (!connection) {
+					++this->results.connect_errors;
+					continue;
+				}
+
+				this->connections.emplace_back(std::move(*connection));
+				this->poll_connections.push_back(
+					pollfd {
+						.fd = this->connections.back().descriptor(),
+						.events = POLLOUT
+					}
+				);
+
+				++this->connecting;
+			}
+		}
+
+
+		const loadgen::results& run() {
+			if (this->connections.empty())
+				return this->results;
+
+			// Wait for the connections to be established, for a while.
+			const auto established = clock::now() + std::chrono::seconds(10);
+
+			while (this->connecting > 0 && clock::now() < established)
+				this->poll(10);
+
+			// Name every connection, so that they can be unicast targets.
+			for (std::size_t i = 0; i < this->connections.size(); ++i)
+				if (this->connections[i].established()) {
+					this->connections[i].send(tp3::server::message::name(boxed_array<uint8_t>(std::to_string(i).c_str())));
+					this->watch(i);
+				}
+
+			const auto settle = clock::now() + std::chrono::milliseconds(200);
+
+			while (clock::now() < settle)
+				this->poll(10);
+
+			this->results = { this->results.connect_errors, this->results.disconnections };
+
+			// Send at the target rate, polling in between.
+			const auto start = clock::now();
+			const auto end = start + std::chrono::duration<double>(this->args.duration);
+			uint64_t sent = 0;
+
+			for (auto now = start; now < end; now = clock::now()) {
+				const auto due = uint64_t(
+					std::chrono::duration<double>(now - start).count() * this->args.rate
+				);
+
+				for (; sent < due; ++sent)
+					this->send_one();
+
+				this->poll(1);
+			}
+
+			// Collect the messages still in flight.
+			const auto drain = clock::now() + std::chrono::seconds(1);
+
+			while (clock::now() < drain)
+				this->poll(10);
+
+			// the connections that never got established failed to connect.
+			this->results.connect_errors += this->connecting;
+
+			return this->results;
+		}
+	};
+
+
+	void report(const args& args, const results& results) {
+		uint64_t sent = 0;
+
+		for (auto count : results.sent)
+			sent += count;
+
+		auto micros = [&](double p) {
+			return results.latency.percentile(p) / 1000.0;
+		};
+
+		std::printf("connections\tconnect_errors\tdisconnections\tseconds\tsent\tsent_per_sec");
+
+		for (auto name : message_names)
+			std::printf("\tsent_%s", name);
+
+		std::printf("\tdelivered\tdelivered_per_sec\tusers_lists\terror_replies");
+		std::printf("\tlatency_p50_us\tlatency_p99_us\tlatency_p999_us\tlatency_max_us\n");
+
+		std::printf(
+			"%zu\t%zu\t%zu\t%.3f\t%lu\t%.0f",
+			args.connections,
+			results.connect_errors,
+			results.disconnections,
+			args.duration,
+			sent,
+			sent / args.duration
+		);
+
+		for (auto count : results.sent)
+			std::printf("\t%lu", count);
+
+		std::printf(
+			"\t%lu\t%.0f\t%lu\t%lu\t%.3f\t%.3f\t%.3f\t%.3f\n",
+			results.delivered,
+			results.delivered / args.duration,
+			results.users_lists,
+			results.error_replies,
+			micros(0.5),
+			micros(0.99),
+			micros(0.999),
+			results.latency.max() / 1000.0
+		);
+	}
+
+
+	int main(int argc, char* argv[]) try {
+		const args args = parse_args(argc, argv);
+
+		raise_file_limit();
+
+		buffer_sizes::call(
+			args.buffer_size,
+			[&](auto buffer_size) {
+				generator<buffer_size> generator(args);
+
+				report(args, generator.run());
+			}
+		);
+
+		return 0;
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Fatal: " << e.what() << std::endl;
+		return -1;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	return tp3::loadgen::main(argc, argv);
+}
@@ -0,0 +1,582 @@
+// Network impairment proxy: forwards TCP connections to an upstream server, delaying,
+// throttling, splitting and coalescing the data in both directions, to reproduce the
+// conditions of a real network on loopback.
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <socket/addr.hpp>
+#include <socket/connection.hpp>
+#include <socket/server.hpp>
+#include <util/boxed_array.hpp>
+
+
+namespace tp3::proxy {
+	using clock = std::chrono::steady_clock;
+	using milliseconds = std::chrono::duration<double, std::milli>;
+
+	template<typename T>
+	using boxed_array = tp3::util::boxed_array<T>;
+
+
+	// The impairments applied to each direction of each connection.
+	struct impairment {
+		double latency = 0; // milliseconds added to every segment.
+		double jitter = 0; // maximum milliseconds added to or removed from the latency.
+		double bandwidth = 0; // bytes per second, 0 for unlimited.
+		std::size_t split = 0; // maximum bytes per send, 0 for unlimited.
+		double coalesce = 0; // milliseconds to hold data to send it at once, 0 to disable.
+	};
+
+
+	struct args {
+		tp3::socket::addr listen;
+		tp3::socket::addr upstream;
+		tp3::proxy::impairment impairment;
+		unsigned seed;
+	};
+
+
+	constexpr std::size_t read_size = 65536;
+	// The time between the segments split from a read, a poll tick, so that they are sent in
+	// separate iterations, and the receiver doesn't get them coalesced again.
+	constexpr auto split_spacing = std::chrono::milliseconds(1);
+	// Sources aren't read while the data queued from them exceeds this, so that a slow
+	// destination slows the source down as TCP would.
+	constexpr std::size_t queue_limit = 4 << 20;
+
+
+	// One direction of a proxied connection.
+	class pipe {
+	protected:
+		struct segment {
+			clock::time_point due; // When the segment may be sent.
+			boxed_array<uint8_t> data;
+		};
+
+		proxy::impairment impairment;
+
+		std::deque<segment> segments;
+		std::size_t offset = 0; // Bytes of the front segment that were already sent.
+		std::size_t _size = 0; // Queued bytes, excluding the offset.
+
+		clock::time_point last_due; // Segments are never reordered.
+		clock::time_point release; // When the coalesced data is next sent.
+
+		double tokens = 0; // Bytes that may be sent under the bandwidth limit.
+		clock::time_point refill;
+
+		std::vector<uint8_t> scratch; // Data gathered for a send.
+
+
+		void refill_tokens(clock::time_point now) {
+			const auto bandwidth = this->impairment.bandwidth;
+
+			// allow bursts of up to 10 ms of traffic, and at least one read.
+			const double burst = std::max(bandwidth / 100, double(read_size));
+
+			this->tokens = std::min(
+				burst,
+				this->tokens + bandwidth * std::chrono::duration<double>(now - this->refill).count()
+			);
+
+			this->refill = now;
+		}
+
+		// Gather due data to send, up to limit bytes.
+		void gather(clock::time_point now, std::size_t limit) {
+			this->scratch.clear();
+
+			std::size_t offset = this->offset;
+
+			for (const auto& segment : this->segments) {
+				if (segment.due > now || this->scratch.size() >= limit)
+					break;
+
+				const std::size_t size = std::min(segment.data.size() - offset, limit - this->scratch.size());
+
+				this->scratch.insert(
+					this->scratch.end(),
+					segment.data.begin() + offset,
+					segment.data.begin() + offset + size
+				);
+
+				offset = 0;
+
+				// without coalescing, each segment is sent by itself.
+				if (this->impairment.coalesce == 0)
+					break;
+			}
+		}
+
+		void consume(std::size_t size) {
+			this->_size -= size;
+
+			while (size > 0) {
+				const std::size_t front = this->segments.front().data.size() - this->offset;
+
+				if (size < front) {
+					this->offset += size;
+					return;
+				}
+
+				size -= front;
+				this->segments.pop_front();
+				this->offset = 0;
+			}
+		}
+
+
+	public:
+		bool closed = false; // Whether the source closed the connection.
+		bool blocked = false; // Whether the destination can't take more data.
+
+
+		pipe(const proxy::impairment& impairment)
+			: impairment(impairment),
+			  refill(clock::now()) { }
+
+
+		bool empty() const noexcept {
+			return this->segments.empty();
+		}
+
+		bool full() const noexcept {
+			return this->_size >= queue_limit;
+		}
+
+
+		// Queue data read from the source.
+		void push(const uint8_t data[], std::size_t size, clock::time_point now, std::mt19937& random) {
+			double delay = this->impairment.latency;
+
+			if (this->impairment.jitter > 0)
+				delay += std::uniform_real_distribution<double>(
+					-this->impairment.jitter,
+					this->impairment.jitter
+				)(random);
+
+			auto due = std::max(
+				this->last_due,
+				now + std::chrono::duration_cast<clock::duration>(milliseconds(std::max(delay, 0.0)))
+			);
+
+			const std::size_t split = this->impairment.split > 0 ? this->impairment.split : size;
+
+			for (std::size_t i = 0; i < size; i += split) {
+				if (i > 0)
+					due += split_spacing;
+
+				this->segments.push_back(
+					segment {
+						.due = due,
+						.data = boxed_array<uint8_t>(data + i, data + std::min(size, i + split))
+					}
+				);
+			}
+
+			this->last_due = due;
+
+			this->_size += size;
+		}
+
+
+		// Send the due data to the destination, until it would block or nothing else is due.
+		// Returns false if the destination failed.
+		bool flush(const tp3::socket::connection& destination, clock::time_point now) {
+			this->blocked = false;
+
+			const bool coalesce = this->impairment.coalesce > 0;
+
+			if (coalesce && now < this->release)
+				return true;
+
+			while (!this->segments.empty() && this->segments.front().due <= now) {
+				std::size_t limit = this->_size;
+
+				if (this->impairment.bandwidth > 0) {
+					this->refill_tokens(now);
+
+					if (this->tokens < 1)
+						break;
+
+					limit = std::min(limit, std::size_t(this->tokens));
+				}
+
+				this->gather(now, limit);
+
+				const auto result = destination.send(this->scratch.data(), this->scratch.size());
+
+				if (result.failed())
+					return false;
+
+				this->consume(result.size);
+				this->tokens -= result.size;
+
+				if (result.size < this->scratch.size()) { // the destination is full.
+					this->blocked = true;
+					break;
+				}
+
+				if (coalesce) {
+					this->release = now + std::chrono::duration_cast<clock::duration>(
+						milliseconds(this->impairment.coalesce)
+					);
+					break;
+				}
+			}
+
+			return true;
+		}
+
+
+		// When there will be data to send, if any.
+		std::optional<clock::time_point> wakeup() const {
+			if (this->segments.empty() || this->blocked)
+				return {};
+
+			auto time = this->segments.front().due;
+
+			if (this->impairment.coalesce > 0)
+				time = std::max(time, this->release);
+
+			if (this->impairment.bandwidth > 0 && this->tokens < 1)
+				time = std::max(
+					time,
+					this->refill + std::chrono::duration_cast<clock::duration>(
+						std::chrono::duration<double>((1 - this->tokens) / this->impairment.bandwidth)
+					)
+				);
+
+			return time;
+		}
+	};
+
+
+	// A proxied connection.
+	struct session {
+		tp3::socket::connection client;
+		tp3::socket::connection upstream;
+
+		proxy::pipe up; // client to upstream.
+		proxy::pipe down; // upstream to client.
+
+		bool failed = false;
+
+
+		bool done() const noexcept {
+			return this->failed
+			    || (this->up.closed && this->up.empty())
+			    || (this->down.closed && this->down.empty());
+		}
+	};
+
+
+	void usage(char* program) {
+		std::cerr << "Usage: " << program
+		          << " [-l latency_ms] [-j jitter_ms] [-w bytes_per_sec] [-s split_bytes]"
+		          << " [-c coalesce_ms] [-S seed] <port> <upstream_host> <upstream_port>"
+		          << std::endl;
+		std::cerr << "Impairments apply to each direction of each connection" << std::endl;
+		::exit(1);
+	}
+
+
+	double parse_number(char* program, const char* option, const char* value) {
+		char* end;
+		const auto number = std::strtod(value, &end);
+
+		if (*value == '\0' || *end != '\0' || number < 0) {
+			std::cerr << "Invalid " << option << ": " << value << std::endl;
+			usage(program);
+		}
+
+		return number;
+	}
+
+
+	args parse_args(int argc, char** argv) {
+		proxy::impairment impairment;
+		unsigned seed = 1;
+
+		int option;
+
+		// http://man7.org/linux/man-pages/man3/getopt.3.html
+		while ((option = ::getopt(argc, argv, "l:j:w:s:c:S:")) != -1)
+			switch (option) {
+				case 'l':
+					impairment.latency = parse_number(argv[0], "latency", optarg);
+					break;
+
+				case 'j':
+					impairment.jitter = parse_number(argv[0], "jitter", optarg);
+					break;
+
+				case 'w':
+					impairment.bandwidth = parse_number(argv[0], "bandwidth", optarg);
+					break;
+
+				case 's':
+					impairment.split = parse_number(argv[0], "split size", optarg);
+					break;
+
+				case 'c':
+					impairment.coalesce = parse_number(argv[0], "coalescing delay", optarg);
+					break;
+
+				case 'S':
+					seed = parse_number(argv[0], "seed", optarg);
+					break;
+
+				default:
+					usage(argv[0]);
+			}
+
+		if (argc - optind < 3) {
+			std::cerr << "Missing arguments" << std::endl;
+			usage(argv[0]);
+		}
+
+		return (args) {
+			.listen = tp3::socket::addr(
+				tp3::socket::name("::", argv[optind]),
+				(addrinfo) {
+					.ai_family = AF_UNSPEC,
+					.ai_socktype = SOCK_STREAM
+				}
+			),
+			.upstream = tp3::socket::addr(
+				tp3::socket::name(argv[optind + 1], argv[optind + 2]),
+				(addrinfo) {
+					.ai_family = AF_UNSPEC,
+					.ai_socktype = SOCK_STREAM
+				}
+			),
+			.impairment = impairment,
+			.seed = seed
+		};
+	}
+
+
+	// Make a connection non-blocking, and send segments as they are written, so that split
+	// segments are not merged again.
+	void configure(const tp3::socket::connection& connection) {
+		const int fd = connection.descriptor();
+		const int nodelay = 1;
+
+		// http://man7.org/linux/man-pages/man2/fcntl.2.html
+		if (::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+			throw std::system_error(errno, std::generic_category());
+
+		// http://man7.org/linux/man-pages/man7/tcp.7.html
+		if (::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) < 0)
+			throw std::system_error(errno, std::generic_category());
+	}
+
+
+	class forwarder {
+	protected:
+		const proxy::args& config;
+
+		tp3::socket::server socket;
+
+		std::vector<session> sessions;
+		std::vector<pollfd> poll_sockets; // server socket : (client, upstream) per session
+
+		std::mt19937 random;
+
+		uint8_t buffer[read_size];
+
+
+		void accept() {
+			while (true) {
+				auto [result, client] = tp3::socket::connection::accept(this->socket);
+
+				if (!client)
+					return;
+
+				try {
+					tp3::socket::connection upstream { tp3::socket::addr(this->config.upstream) };
+
+					configure(*client);
+					configure(upstream);
+
+					this->sessions.push_back(
+						session {
+							.client = std::move(*client),
+							.upstream = std::move(upstream),
+							.up = pipe(this->config.impairment),
+							.down = pipe(this->config.impairment)
+						}
+					);
+				}
+				catch (const std::system_error& e) {
+					std::cerr << "upstream connection failed: " << e.what() << std::endl;
+				}
+			}
+		}
+
+
+		// Read from source into pipe.
+		void forward(const tp3::socket::connection& source, pipe& pipe, session& session) {
+			const auto result = source.recv(this->buffer, sizeof(this->buffer));
+
+			if (result.status == tp3::socket::status::closed)
+				pipe.closed = true;
+			else if (result.failed())
+				session.failed = true;
+			else if (result)
+				pipe.push(this->buffer, result.size, clock::now(), this->random);
+		}
+
+
+		// Build the poll set, returning the poll timeout.
+		int prepare(clock::time_point now) {
+			this->poll_sockets.resize(1 + 2 * this->sessions.size());
+
+			std::optional<clock::time_point> wakeup;
+
+			auto earliest = [&](std::optional<clock::time_point> time) {
+				if (time && (!wakeup || *time < *wakeup))
+					wakeup = time;
+			};
+
+			for (std::size_t i = 0; i < this->sessions.size(); ++i) {
+				const auto& session = this->sessions[i];
+
+				auto events = [](const pipe& from, const pipe& to) {
+					return short(
+						(from.closed || from.full() ? 0 : POLLIN)
+						| (to.blocked ? POLLOUT : 0)
+					);
+				};
+
+				this->poll_sockets[1 + 2 * i] = pollfd {
+					.fd = session.client.descriptor(),
+					.events = events(session.up, session.down)
+				};
+
+				this->poll_sockets[2 + 2 * i] = pollfd {
+					.fd = session.upstream.descriptor(),
+					.events = events(session.down, session.up)
+				};
+
+				earliest(session.up.wakeup());
+				earliest(session.down.wakeup());
+			}
+
+			if (!wakeup)
+				return -1;
+
+			return std::max<long>(
+				0,
+				std::chrono::ceil<std::chrono::milliseconds>(*wakeup - now).count()
+			);
+		}
+
+
+	public:
+		forwarder(const proxy::args& args)
+			: config(args),
+			  socket(tp3::socket::addr(args.listen), SOMAXCONN),
+			  poll_sockets {
+			  	pollfd {
+			  		.fd = this->socket.descriptor(),
+			  		.events = POLLIN
+			  	}
+			  },
+			  random(args.seed) { }
+
+
+		void process(const volatile std::sig_atomic_t& stop) {
+			while (!stop) {
+				const int timeout = this->prepare(clock::now());
+
+				if (::poll(this->poll_sockets.data(), this->poll_sockets.size(), timeout) < 0) {
+					if (errno == EINTR)
+						continue;
+
+					throw std::system_error(errno, std::generic_category());
+				}
+
+				for (std::size_t i = 0; i < this->sessions.size(); ++i) {
+					auto& session = this->sessions[i];
+
+					const auto client = this->poll_sockets[1 + 2 * i].revents;
+					const auto upstream = this->poll_sockets[2 + 2 * i].revents;
+
+					if (client & (POLLIN | POLLHUP | POLLERR))
+						this->forward(session.client, session.up, session);
+
+					if (upstream & (POLLIN | POLLHUP | POLLERR))
+						this->forward(session.upstream, session.down, session);
+
+					const auto now = clock::now();
+
+					if (!session.up.flush(session.upstream, now) || !session.down.flush(session.client, now))
+						session.failed = true;
+				}
+
+				// sessions are independent, so order doesn't matter:
+				for (std::size_t i = 0; i < this->sessions.size(); )
+					if (this->sessions[i].done()) {
+						std::swap(this->sessions[i], this->sessions.back());
+						this->sessions.pop_back();
+					}
+					else
+						++i;
+
+				if (this->poll_sockets.front().revents & POLLIN)
+					this->accept();
+			}
+		}
+	};
+
+
+	volatile std::sig_atomic_t stop = 0;
+
+
+	int main(int argc, char* argv[]) try {
+		struct sigaction action { };
+		action.sa_handler = [](int) { stop = 1; };
+		::sigemptyset(&action.sa_mask);
+		::sigaction(SIGINT, &action, nullptr);
+
+		const args args = parse_args(argc, argv);
+
+		forwarder forwarder(args);
+		forwarder.process(stop);
+
+		return 0;
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Fatal: " << e.what() << std::endl;
+		return -1;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	return tp3::proxy::main(argc, argv);
+}
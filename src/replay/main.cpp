@@ -0,0 +1,386 @@
+// Traffic replay: plays a capture made by the server's -C option against a server,
+// opening, feeding and closing the connections as they were captured, at the captured
+// pace or accelerated. The data of each record is sent at once, so that the fragmentation
+// seen by the capturing server is reproduced as closely as TCP allows. Connections are
+// opened without blocking, the data played while connecting being queued, so that connect
+// latency doesn't shift the schedule.
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <server/capture.hpp>
+#include <socket/addr.hpp>
+#include <socket/connection.hpp>
+#include <util/write_queue.hpp>
+
+
+namespace tp3::replay {
+	using clock = std::chrono::steady_clock;
+
+	namespace capture = tp3::server::capture;
+
+
+	struct args {
+		const char* trace;
+		tp3::socket::addr server;
+		double speed; // 0 to replay as fast as possible.
+	};
+
+
+	void usage(char* program) {
+		std::cerr << "Usage: " << program << " [-x speed] <trace_file> <host> <port>" << std::endl;
+		std::cerr << "The speed multiplies the captured pace, 0 for as fast as possible (default 1)"
+		          << std::endl;
+		::exit(1);
+	}
+
+
+	double parse_number(char* program, const char* option, const char* value) {
+		char* end;
+		const auto number = std::strtod(value, &end);
+
+		if (*value == '\0' || *end != '\0' || number < 0) {
+			std::cerr << "Invalid " << option << ": " << value << std::endl;
+			usage(program);
+		}
+
+		return number;
+	}
+
+
+	args parse_args(int argc, char** argv) {
+		double speed = 1;
+
+		int option;
+
+		// http://man7.org/linux/man-pages/man3/getopt.3.html
+		while ((option = ::getopt(argc, argv, "x:")) != -1)
+			switch (option) {
+				case 'x':
+					speed = parse_number(argv[0], "speed", optarg);
+					break;
+
+				default:
+					usage(argv[0]);
+			}
+
+		if (argc - optind < 3) {
+			std::cerr << "Missing arguments" << std::endl;
+			usage(argv[0]);
+		}
+
+		return (args) {
+			.trace = argv[optind],
+			.server = tp3::socket::addr(
+				tp3::socket::name(argv[optind + 1], argv[optind + 2]),
+				(addrinfo) {
+					.ai_family = AF_UNSPEC,
+					.ai_socktype = SOCK_STREAM
+				}
+			),
+			.speed = speed
+		};
+	}
+
+
+	// Send segments as they are written, so that the captured reads are not merged.
+	void configure(const tp3::socket::connection& connection) {
+		const int fd = connection.descriptor();
+		const int nodelay = 1;
+
+		// http://man7.org/linux/man-pages/man7/tcp.7.html
+		if (::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) < 0)
+			throw std::system_error(errno, std::generic_category());
+	}
+
+
+	struct session {
+		tp3::socket::connection connection;
+		tp3::util::write_queue queue; // Also holds the data played while connecting.
+		bool connecting = true; // Until the connection is writable.
+		bool closing = false; // Disconnected in the trace, close once the queue is sent.
+		bool done = false;
+	};
+
+
+	struct report {
+		uint64_t records = 0;
+		uint64_t connections = 0;
+		uint64_t failed = 0; // Connections that could not be opened.
+		uint64_t bytes_sent = 0;
+		uint64_t bytes_received = 0;
+		double elapsed = 0; // seconds.
+		double max_lag = 0; // milliseconds behind the schedule.
+		double total_lag = 0;
+	};
+
+
+	class player {
+	protected:
+		const replay::args& config;
+
+		std::ifstream trace;
+		std::optional<capture::record> next; // The next record to play, if any.
+
+		std::unordered_map<uint32_t, session> sessions; // By captured connection id.
+		std::vector<pollfd> poll_sockets;
+		std::vector<uint32_t> poll_ids; // The session of each poll_sockets entry.
+
+		clock::time_point start;
+		replay::report _report;
+
+		uint8_t buffer[65536];
+
+
+		clock::time_point due(const capture::record& record) const {
+			if (this->config.speed == 0)
+				return this->start;
+
+			return this->start + std::chrono::duration_cast<clock::duration>(
+				std::chrono::duration<double, std::nano>(record.time / this->config.speed)
+			);
+		}
+
+
+		void play(capture::record& record, clock::time_point now) {
+			const double lag = std::chrono::duration<double, std::milli>(now - this->due(record)).count();
+
+			++this->_report.records;
+			this->_report.max_lag = std::max(this->_report.max_lag, lag);
+			this->_report.total_lag += lag;
+
+			if (record.type == capture::type::connected) {
+				// connect without blocking, so that connecting doesn't delay the later records.
+				auto [result, connection] = tp3::socket::connection::connect(tp3::socket::addr(this->config.server));
+
+				try {
+					if (!connection)
+						throw std::system_error(result.code());
+
+					configure(*connection);
+
+					this->sessions.insert_or_assign(record.connection, session { .connection = std::move(*connection) });
+				}
+				catch (const std::system_error& e) {
+					std::cerr << "connection failed: " << e.what() << std::endl;
+					++this->_report.failed;
+				}
+
+				return;
+			}
+
+			const auto session = this->sessions.find(record.connection);
+
+			if (session == this->sessions.end()) // failed to connect, or captured mid-connection.
+				return;
+
+			if (record.type == capture::type::disconnected)
+				session->second.closing = true;
+			else {
+				session->second.queue.push(record.data.data(), record.data.size());
+				this->_report.bytes_sent += record.data.size();
+
+				if (!session->second.connecting)
+					this->flush(session->second);
+			}
+		}
+
+
+		// Finish connecting, once the connection is writable.
+		void establish(session& session) {
+			session.connecting = false;
+
+			if (const auto result = session.connection.error(); result.failed()) {
+				std::cerr << "connection failed: " << result.code().message() << std::endl;
+				++this->_report.failed;
+				session.done = true;
+			}
+			else
+				++this->_report.connections;
+		}
+
+
+		void flush(session& session) {
+			if (session.queue.flush(session.connection).failed())
+				session.done = true;
+		}
+
+
+		// Read and discard the server's replies.
+		void drain(session& session) {
+			while (true) {
+				const auto result = session.connection.recv(this->buffer, sizeof(this->buffer));
+
+				this->_report.bytes_received += result.size;
+
+				if (result.status == tp3::socket::status::closed || result.failed())
+					session.done = true;
+
+				if (!result || result.size < sizeof(this->buffer))
+					return;
+			}
+		}
+
+
+		// Build the poll set, returning the poll timeout.
+		int prepare(clock::time_point now) {
+			this->poll_sockets.clear();
+			this->poll_ids.clear();
+
+			for (const auto& [id, session] : this->sessions) {
+				this->poll_sockets.push_back(
+					pollfd {
+						.fd = session.connection.descriptor(),
+						.events = short(POLLIN | (session.connecting || !session.queue.empty() ? POLLOUT : 0))
+					}
+				);
+
+				this->poll_ids.push_back(id);
+			}
+
+			if (!this->next)
+				return 100; // keep draining replies until the connections close.
+
+			return std::max<long>(
+				0,
+				std::chrono::ceil<std::chrono::milliseconds>(this->due(*this->next) - now).count()
+			);
+		}
+
+
+	public:
+		player(const replay::args& args)
+			: config(args),
+			  trace(args.trace, std::ios::binary)
+		{
+			if (!this->trace || !capture::read_header(this->trace))
+				throw std::runtime_error(std::string("invalid trace file: ") + args.trace);
+
+			this->next = capture::read(this->trace);
+		}
+
+
+		const replay::report& report() const noexcept {
+			return this->_report;
+		}
+
+
+		void process(const volatile std::sig_atomic_t& stop) {
+			this->start = clock::now();
+
+			while (!stop && (this->next || !this->sessions.empty())) {
+				auto now = clock::now();
+
+				while (this->next && this->due(*this->next) <= now) {
+					this->play(*this->next, now);
+					this->next = capture::read(this->trace);
+				}
+
+				// at the end of the trace, connections still open are closed once sent.
+				if (!this->next)
+					for (auto& [id, session] : this->sessions)
+						session.closing = true;
+
+				const int timeout = this->prepare(now);
+
+				if (::poll(this->poll_sockets.data(), this->poll_sockets.size(), timeout) < 0) {
+					if (errno == EINTR)
+						continue;
+
+					throw std::system_error(errno, std::generic_category());
+				}
+
+				for (std::size_t i = 0; i < this->poll_sockets.size(); ++i) {
+					auto& session = this->sessions.at(this->poll_ids[i]);
+					const auto events = this->poll_sockets[i].revents;
+
+					if (session.connecting) {
+						if (!(events & (POLLOUT | POLLHUP | POLLERR)))
+							continue;
+
+						this->establish(session);
+
+						if (session.done)
+							continue;
+					}
+
+					if (events & POLLOUT)
+						this->flush(session);
+
+					if (events & (POLLIN | POLLHUP | POLLERR))
+						this->drain(session);
+				}
+
+				for (auto it = this->sessions.begin(); it != this->sessions.end(); )
+					if (it->second.done || (it->second.closing && !it->second.connecting && it->second.queue.empty()))
+						it = this->sessions.erase(it);
+					else
+						++it;
+			}
+
+			this->_report.elapsed = std::chrono::duration<double>(clock::now() - this->start).count();
+		}
+	};
+
+
+	volatile std::sig_atomic_t stop = 0;
+
+
+	int main(int argc, char* argv[]) try {
+		struct sigaction action { };
+		action.sa_handler = [](int) { stop = 1; };
+		::sigemptyset(&action.sa_mask);
+		::sigaction(SIGINT, &action, nullptr);
+
+		const args args = parse_args(argc, argv);
+
+		player player(args);
+		player.process(stop);
+
+		const auto& report = player.report();
+
+		std::cout << "records\tconnections\tfailed\tbytes_sent\tbytes_received\telapsed_s"
+		          << "\tmax_lag_ms\tmean_lag_ms" << std::endl;
+
+		std::cout << report.records
+		          << '\t' << report.connections
+		          << '\t' << report.failed
+		          << '\t' << report.bytes_sent
+		          << '\t' << report.bytes_received
+		          << '\t' << report.elapsed
+		          << '\t' << report.max_lag
+		          << '\t' << (report.records == 0 ? 0 : report.total_lag / report.records)
+		          << std::endl;
+
+		return 0;
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Fatal: " << e.what() << std::endl;
+		return -1;
+	}
+}
+
+
+int main(int argc, char* argv[]) {
+	return tp3::replay::main(argc, argv);
+}
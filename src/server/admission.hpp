@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+
+namespace tp3::server {
+	// The admission controller: rates the server's load from the event loop's iteration
+	// time, how long an iteration takes to handle its events, which bounds how long events
+	// ready meanwhile wait, and from the bytes queued for the clients, each against its
+	// limit. A loaded server stops accepting connections, which wait in the listen backlog,
+	// and an overloaded one also sheds broadcasts, whose fan-out costs the most. A level is
+	// entered at its threshold, and only left under half of it, so that the level doesn't
+	// flap around a threshold.
+	class admission {
+	public:
+		using time = std::chrono::nanoseconds;
+
+		// How often to rate the load while not normal, for an idle server to recover.
+		static constexpr time recheck = std::chrono::milliseconds(10);
+
+		// The iteration time is averaged over about this long, weighting each iteration by the time
+		// since the previous one, so that a single slow iteration among many fast ones
+		// doesn't swing the level.
+		static constexpr time window = std::chrono::milliseconds(100);
+
+		enum class level : uint8_t {
+			normal,
+			loaded,    // The load is at its limits.
+			overloaded // The load is at twice its limits.
+		};
+
+	protected:
+		// The load, in thousandths of the limits, at which each level is entered.
+		static constexpr uint64_t thresholds[] = { 0, 1000, 2000 };
+
+		time iteration_limit;
+		uint64_t queue_limit;
+
+		time _iteration { 0 }; // Averaged over the window.
+		time last { 0 }; // When the load was last rated.
+		level _level = level::normal;
+
+
+	public:
+		// The limits, zero to ignore each.
+		admission(time iteration_limit, uint64_t queue_limit) noexcept
+			: iteration_limit(iteration_limit),
+			  queue_limit(queue_limit) { }
+
+
+		bool enabled() const noexcept {
+			return this->iteration_limit.count() > 0 || this->queue_limit > 0;
+		}
+
+		admission::level level() const noexcept {
+			return this->_level;
+		}
+
+		time iteration() const noexcept {
+			return this->_iteration;
+		}
+
+		bool accepting() const noexcept {
+			return this->_level == level::normal;
+		}
+
+		bool shedding() const noexcept {
+			return this->_level == level::overloaded;
+		}
+
+
+		// Rate the load after an iteration ending now that took iteration, leaving queued bytes
+		// for the clients. Returns whether the level changed.
+		bool update(time now, time iteration, uint64_t queued) noexcept {
+			const time elapsed = std::min(now - this->last, window);
+			this->last = now;
+
+			this->_iteration += (iteration - this->_iteration) * elapsed.count() / window.count();
+
+			uint64_t load = 0; // thousandths of the limits.
+
+			if (this->iteration_limit.count() > 0)
+				load = std::max<uint64_t>(load, this->_iteration.count() * 1000 / this->iteration_limit.count());
+
+			if (this->queue_limit > 0)
+				load = std::max<uint64_t>(load, queued * 1000 / this->queue_limit);
+
+			// the highest level whose threshold the load reaches, or half of it for the
+			// levels up to the current one.
+			auto next = level::normal;
+
+			for (std::size_t i = std::size(thresholds) - 1; i > 0; --i) {
+				const bool held = i <= std::size_t(this->_level);
+
+				if (load >= (held ? thresholds[i] / 2 : thresholds[i])) {
+					next = static_cast<enum level>(i);
+					break;
+				}
+			}
+
+			if (next == this->_level)
+				return false;
+
+			this->_level = next;
+			return true;
+		}
+	};
+}
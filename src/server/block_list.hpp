@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <server/sessions.hpp>
+
+
+namespace tp3::server {
+	// The sessions a client ignores. Filtering a fan-out tests a bit per recipient, in a 64
+	// bit summary kept in place, with a bit per session slot modulo 64: the sorted handles
+	// are only searched when the bit is set. A list of k sessions sets up to k of the bits, so
+	// the search is mostly skipped for a few blocks, but with dozens most tests search, and
+	// from 64 on the summary may be saturated: the worst case is a binary search, O(log k),
+	// per recipient. Sessions leave the lists when closed, see
+	// tp3::server::server, so closed ones don't hold bits.
+	// A dense bitset over all the slots would take slots / 8 bytes per client, and a cache
+	// miss per recipient to test.
+	class block_list {
+	public:
+		using handle = tp3::server::sessions::handle;
+
+	protected:
+		uint64_t summary = 0;
+		std::vector<handle> handles; // The blocked sessions, sorted.
+
+
+		static uint64_t bit(handle session) noexcept {
+			return uint64_t(1) << (sessions::slot(session) % 64);
+		}
+
+		void summarize() noexcept {
+			this->summary = 0;
+
+			for (auto session : this->handles)
+				this->summary |= bit(session);
+		}
+
+
+	public:
+		bool empty() const noexcept {
+			return this->handles.empty();
+		}
+
+		std::vector<handle>::const_iterator begin() const noexcept {
+			return this->handles.begin();
+		}
+
+		std::vector<handle>::const_iterator end() const noexcept {
+			return this->handles.end();
+		}
+
+		bool contains(handle session) const noexcept {
+			return (this->summary & bit(session))
+			    && std::binary_search(this->handles.begin(), this->handles.end(), session);
+		}
+
+
+		// Insert a session, returning whether it wasn't blocked yet.
+		bool insert(handle session) {
+			const auto it = std::lower_bound(this->handles.begin(), this->handles.end(), session);
+
+			if (it != this->handles.end() && *it == session)
+				return false;
+
+			this->handles.insert(it, session);
+			this->summary |= bit(session);
+
+			return true;
+		}
+
+		// Erase a session, returning whether it was blocked.
+		bool erase(handle session) noexcept {
+			const auto it = std::lower_bound(this->handles.begin(), this->handles.end(), session);
+
+			if (it == this->handles.end() || *it != session)
+				return false;
+
+			this->handles.erase(it);
+			this->summarize();
+
+			return true;
+		}
+	};
+}
@@ -0,0 +1,128 @@
+#include "capture.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <signal.h>
+
+
+bool tp3::server::capture::read_header(std::istream& stream) {
+	char header[sizeof(magic) + 1];
+
+	if (!stream.read(header, sizeof(header)))
+		return false;
+
+	return std::equal(magic, magic + sizeof(magic), header)
+	    && uint8_t(header[sizeof(magic)]) == version;
+}
+
+
+std::optional<tp3::server::capture::record> tp3::server::capture::read(std::istream& stream) {
+	uint8_t header[header_size];
+
+	if (!stream.read(reinterpret_cast<char*>(header), sizeof(header)))
+		return {};
+
+	record record {
+		.type = capture::type(header[0]),
+		.time = 0,
+		.connection = 0
+	};
+
+	uint32_t size = 0;
+
+	for (int i = 0; i < 8; ++i)
+		record.time |= uint64_t(header[1 + i]) << (8 * i);
+
+	for (int i = 0; i < 4; ++i) {
+		record.connection |= uint32_t(header[9 + i]) << (8 * i);
+		size |= uint32_t(header[13 + i]) << (8 * i);
+	}
+
+	record.data.resize(size);
+
+	if (!stream.read(reinterpret_cast<char*>(record.data.data()), size))
+		return {};
+
+	return record;
+}
+
+
+tp3::server::capture::writer::writer(const std::string& path)
+	: start(std::chrono::steady_clock::now()),
+	  file(path, std::ios::binary),
+	  thread()
+{
+	if (!this->file)
+		throw std::runtime_error("failed to open capture file: " + path);
+
+	this->file.write(magic, sizeof(magic));
+	this->file.put(char(version));
+
+	this->thread = std::thread(&writer::run, this);
+}
+
+tp3::server::capture::writer::~writer() {
+	{
+		std::lock_guard lock(this->mutex);
+		this->pending.insert(this->pending.end(), this->buffer.begin(), this->buffer.end());
+		this->stopping = true;
+	}
+
+	this->ready.notify_one();
+	this->thread.join();
+}
+
+
+void tp3::server::capture::writer::flush() {
+	if (this->buffer.empty())
+		return;
+
+	std::unique_lock lock(this->mutex, std::try_to_lock);
+
+	if (!lock || this->busy || !this->pending.empty()) // the writer is busy, keep buffering.
+		return;
+
+	this->pending.swap(this->buffer);
+	lock.unlock();
+
+	this->ready.notify_one();
+}
+
+
+void tp3::server::capture::writer::run() {
+	// Signals must be handled by the event loop thread, so that they interrupt its poll.
+	sigset_t signals;
+	::sigfillset(&signals);
+	// http://man7.org/linux/man-pages/man3/pthread_sigmask.3.html
+	::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	std::vector<uint8_t> records;
+
+	std::unique_lock lock(this->mutex);
+
+	while (true) {
+		this->ready.wait(
+			lock,
+			[this] { return this->stopping || !this->pending.empty(); }
+		);
+
+		if (this->pending.empty()) // stopping, and everything was written.
+			break;
+
+		// Take the pending records, without copying them under the lock. The records appended
+		// by the destructor meanwhile are left in pending, for the next pass.
+		records.clear();
+		records.swap(this->pending);
+		this->busy = true;
+		lock.unlock();
+
+		this->file.write(reinterpret_cast<const char*>(records.data()), records.size());
+
+		lock.lock();
+		this->busy = false;
+	}
+
+	this->file.flush();
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Capture of the server's inbound traffic, for replay.
+// The trace file starts with the magic "TP3C" and a version byte, followed by records of:
+// type (uint8), time in nanoseconds since the capture started (uint64), connection id
+// (uint32) and data size (uint32), all little endian, followed by the data.
+namespace tp3::server::capture {
+	enum class type : uint8_t {
+		connected,
+		data, // Bytes received from the connection, as read.
+		disconnected
+	};
+
+	constexpr char magic[] = { 'T', 'P', '3', 'C' };
+	constexpr uint8_t version = 1;
+
+	constexpr std::size_t header_size = 1 + 8 + 4 + 4;
+
+
+	struct record {
+		capture::type type;
+		uint64_t time;
+		uint32_t connection;
+		std::vector<uint8_t> data;
+	};
+
+
+	// Read the trace file header. Returns false if the file is not a trace.
+	bool read_header(std::istream&);
+	// Read the next record. Returns an empty optional at the end of the trace.
+	std::optional<record> read(std::istream&);
+
+
+	// Writes the records from the event loop thread to the trace file in a background
+	// thread. Records are appended to a buffer, which is handed to the writer thread at the
+	// end of an event loop iteration if the writer is idle. Records are dropped if the
+	// writer can't keep up.
+	class writer {
+	protected:
+		// Buffered bytes above which records are dropped.
+		static constexpr std::size_t max_size = 64 << 20;
+
+		const std::chrono::steady_clock::time_point start;
+
+		std::ofstream file;
+
+		std::vector<uint8_t> buffer; // Records being appended by the event loop.
+
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::vector<uint8_t> pending; // Records handed to the writer thread.
+		bool busy = false; // Whether the writer thread is writing records.
+		bool stopping = false;
+
+		std::atomic<uint64_t> _dropped = 0;
+
+		std::thread thread; // Must be the last member, as it uses all the others.
+
+
+		void run();
+
+
+	public:
+		writer(const std::string& path);
+		writer(const writer&) = delete;
+		~writer(); // Writes the remaining records.
+
+		writer& operator=(const writer&) = delete;
+
+
+		// Append a record. Called by the event loop thread.
+		void write(capture::type type, uint32_t connection, const uint8_t data[] = nullptr, std::size_t size = 0) {
+			if (this->buffer.size() + header_size + size > max_size) {
+				this->_dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			const uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - this->start
+			)
+			.count();
+
+			uint8_t header[header_size];
+			header[0] = uint8_t(type);
+
+			for (int i = 0; i < 8; ++i)
+				header[1 + i] = time >> (8 * i);
+
+			for (int i = 0; i < 4; ++i) {
+				header[9 + i] = connection >> (8 * i);
+				header[13 + i] = uint32_t(size) >> (8 * i);
+			}
+
+			this->buffer.insert(this->buffer.end(), header, header + header_size);
+
+			if (size > 0)
+				this->buffer.insert(this->buffer.end(), data, data + size);
+		}
+
+		// Hand the buffered records to the writer thread, if it is idle. Called by the event
+		// loop thread.
+		void flush();
+
+		uint64_t dropped() const noexcept {
+			return this->_dropped.load(std::memory_order_relaxed);
+		}
+	};
+}
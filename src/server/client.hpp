@@ -3,41 +3,110 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <memory>
 #include <optional>
 #include <vector>
 
 #include <socket/connection.hpp>
 #include <socket/server.hpp>
 
+#include <server/block_list.hpp>
 #include <server/message.hpp>
+#include <server/token_bucket.hpp>
 #include <client/message.hpp>
+#include <util/algorithm.hpp>
+#include <util/array_view.hpp>
 #include <util/read_buffer.hpp>
 #include <util/boxed_array.hpp>
+#include <util/write_queue.hpp>
 
 
 namespace tp3::server {
-	// A client in the server.
-	template<std::size_t buffer_size>
+	// A client in the server, connected through a Connection socket of the server's transport.
+	template<std::size_t buffer_size, typename Connection = tp3::socket::connection>
 	class client {
 		static_assert(buffer_size >= message::min_size);
 
 		template<typename T>
 		using boxed_array = tp3::util::boxed_array<T>;
 
+		template<typename T>
+		using array_view = tp3::util::array_view<T>;
+
 
 	protected:
-		tp3::socket::connection connection;
+		Connection connection;
 		tp3::util::read_buffer<buffer_size> read_buffer;
+		tp3::util::write_queue write_queue;
+
+		std::size_t send_queue_limit; // Maximum bytes in write_queue.
+
+		// The sessions the client ignores, tested while sending, next to the send state. Both
+		// sides are kept, so that a session leaves the lists that name it when it closes.
+		tp3::server::block_list blocked;
+		std::vector<uint32_t> blockers; // The sessions ignoring this one.
+
+		// The input rate limits, in messages and bytes.
+		tp3::server::token_bucket message_tokens;
+		tp3::server::token_bucket byte_tokens;
+
+		// While the client's input is held, when to resume it, see tp3::server::server::hold.
+		token_bucket::time _resume { 0 };
+
+		// When the client last sent anything, and whether it was pinged since, see
+		// tp3::server::server::expire.
+		token_bucket::time _active { 0 };
+		bool _pinged = false;
+
+		uint32_t _id; // Unique among the server's connections.
+		uint32_t _handle = 0; // The session handle, see tp3::server::sessions.
+
+		// The name's storage is kept across renames, so that renaming doesn't allocate once
+		// the storage is large enough. Moving the client keeps the storage in place.
+		std::vector<uint8_t> _name;
+		bool named = false; // A client might be anonymous.
+
+		// The client's position among the presence subscribers, if subscribed.
+		std::optional<std::size_t> _subscription;
+
+		uint64_t last_multicast = 0; // The last multicast delivered to the client.
+
+		// The rooms the client is in, with its position among each room's members.
+		struct membership {
+			std::size_t room;
+			std::size_t position;
+		};
+
+		std::vector<membership> memberships;
+
+		// Whether the peer closed the connection or a socket operation failed.
+		bool disconnected = false;
+
+		// Whether the peer shut down its side of the connection, and whether its input was
+		// handled since, in which case the client is only left to send what is queued.
+		bool _shut_down = false;
+		bool _finished = false;
+
+		// While traced, when the reads with data still buffered took place, by the bytes
+		// received up to the end of each, see read_time.
+		struct read {
+			uint64_t end;
+			uint64_t time;
+		};
+
+		std::deque<read> reads;
+		uint64_t received_bytes = 0;
 
 
 	public:
 		static const inline boxed_array<uint8_t> anon_name = boxed_array<uint8_t>("anonymous");
 
-		std::optional<boxed_array<uint8_t>> name; // A client might be anonymous.
-
 
-		client(tp3::socket::connection&& connection)
-			: connection(std::move(connection)) { }
+		client(Connection&& connection, std::size_t send_queue_limit, uint32_t id = 0)
+			: connection(std::move(connection)),
+			  send_queue_limit(send_queue_limit),
+			  _id(id) { }
 
 		client(const client&) = delete;
 		client(client&&) = default;
@@ -49,35 +118,398 @@ namespace tp3::server {
 			return this->connection.descriptor();
 		}
 
+		uint32_t id() const noexcept {
+			return this->_id;
+		}
+
+		uint32_t handle() const noexcept {
+			return this->_handle;
+		}
+
+		void set_handle(uint32_t handle) noexcept {
+			this->_handle = handle;
+		}
+
+		const tp3::socket::addr& address() const noexcept {
+			return this->connection.address();
+		}
+
+
+		void set_limits(const token_bucket& messages, const token_bucket& bytes) noexcept {
+			this->message_tokens = messages;
+			this->byte_tokens = bytes;
+		}
+
+		// The messages and bytes the client may send at a time, by its rate limits.
+		uint64_t message_allowance(token_bucket::time now) const noexcept {
+			return this->message_tokens.available(now);
+		}
+
+		uint64_t byte_allowance(token_bucket::time now) const noexcept {
+			return this->byte_tokens.available(now);
+		}
+
+		// When the client may send again, after reaching a rate limit.
+		token_bucket::time allowed(token_bucket::time now) const noexcept {
+			return std::max(this->message_tokens.ready(now), this->byte_tokens.ready(now));
+		}
+
+		void handled(token_bucket::time now, std::size_t messages) noexcept {
+			this->message_tokens.take(now, messages);
+		}
+
+
+		token_bucket::time resume() const noexcept {
+			return this->_resume;
+		}
+
+		void set_resume(token_bucket::time resume) noexcept {
+			this->_resume = resume;
+		}
+
+
+		token_bucket::time active() const noexcept {
+			return this->_active;
+		}
+
+		// Count the client as active at a time, answering any ping.
+		void touch(token_bucket::time now) noexcept {
+			this->_active = now;
+			this->_pinged = false;
+		}
+
+		bool pinged() const noexcept {
+			return this->_pinged;
+		}
+
+		void set_pinged() noexcept {
+			this->_pinged = true;
+		}
+
+
+		// The client's name, if not anonymous. Only valid until the name changes.
+		std::optional<array_view<uint8_t>> name() const noexcept {
+			if (!this->named)
+				return {};
+
+			return array_view<uint8_t>(this->_name.data(), this->_name.data() + this->_name.size());
+		}
+
+		// The name to show as the sender of the client's messages.
+		array_view<uint8_t> sender() const noexcept {
+			return this->named ? *this->name() : array_view<uint8_t>(anon_name);
+		}
+
+		void set_name(array_view<uint8_t> name) {
+			this->_name.assign(name.begin(), name.end());
+			this->named = true;
+		}
+
+		void clear_name() noexcept {
+			this->named = false;
+		}
+
+
+		std::optional<std::size_t> subscription() const noexcept {
+			return this->_subscription;
+		}
+
+		void set_subscription(std::optional<std::size_t> position) noexcept {
+			this->_subscription = position;
+		}
+
+
+		// The client's position among a room's members, if a member.
+		std::optional<std::size_t> room_position(std::size_t room) const noexcept {
+			for (const auto& membership : this->memberships)
+				if (membership.room == room)
+					return membership.position;
+
+			return {};
+		}
+
+		// Set the client's position among a room's members, joining it if not a member.
+		void set_room_position(std::size_t room, std::size_t position) {
+			for (auto& membership : this->memberships)
+				if (membership.room == room) {
+					membership.position = position;
+					return;
+				}
+
+			this->memberships.push_back(membership { room, position });
+		}
+
+		void leave_room(std::size_t room) noexcept {
+			for (auto it = this->memberships.begin(); it != this->memberships.end(); ++it)
+				if (it->room == room) {
+					*it = this->memberships.back();
+					this->memberships.pop_back();
+					return;
+				}
+		}
+
+		// A room the client is in, if any.
+		std::optional<std::size_t> any_room() const noexcept {
+			if (this->memberships.empty())
+				return {};
+
+			return this->memberships.back().room;
+		}
+
+
+		// Whether the client ignores the messages of a session.
+		bool ignores(uint32_t session) const noexcept {
+			return this->blocked.contains(session);
+		}
+
+		// Ignore a session, returning whether it wasn't blocked yet.
+		bool block(uint32_t session) {
+			return this->blocked.insert(session);
+		}
+
+		// Stop ignoring a session, returning whether it was blocked.
+		bool unblock(uint32_t session) noexcept {
+			return this->blocked.erase(session);
+		}
+
+		// The sessions the client ignores.
+		const tp3::server::block_list& blocks() const noexcept {
+			return this->blocked;
+		}
+
+		// The sessions ignoring the client.
+		const std::vector<uint32_t>& blocked_by() const noexcept {
+			return this->blockers;
+		}
+
+		// Whether another client ignores this one, in which case its messages must be
+		// filtered, see tp3::server::server::deliver.
+		bool ignored() const noexcept {
+			return !this->blockers.empty();
+		}
+
+		void add_blocker(uint32_t session) {
+			this->blockers.push_back(session);
+		}
+
+		void remove_blocker(uint32_t session) noexcept {
+			tp3::util::algorithm::swap_pop(
+				this->blockers,
+				std::find(this->blockers.begin(), this->blockers.end(), session)
+			);
+		}
+
+
+		// Whether the given multicast wasn't delivered to the client yet, marking it delivered,
+		// so that a target listed twice gets the message once.
+		bool deliver_once(uint64_t multicast) noexcept {
+			if (this->last_multicast == multicast)
+				return false;
+
+			this->last_multicast = multicast;
+			return true;
+		}
+
+
+		bool connected() const noexcept {
+			return !this->disconnected;
+		}
+
+		// Disconnect the client for being idle.
+		void time_out() noexcept {
+			this->disconnected = true;
+		}
+
+		// Whether there is data waiting for the socket to become writable.
+		bool pending() const noexcept {
+			return !this->write_queue.empty();
+		}
+
+
+		// Whether the peer shut down its side of the connection, see finish.
+		bool shut_down() const noexcept {
+			return this->_shut_down;
+		}
+
+		// Whether the client's input was handled after it shut down, see finish.
+		bool finished() const noexcept {
+			return this->_finished;
+		}
+
+		// Stop reading from a client that shut down, its input handled: it is disconnected
+		// once its write queue drains, so that it still gets the answers to what it sent.
+		void finish() noexcept {
+			this->_finished = true;
+
+			if (this->write_queue.empty())
+				this->disconnected = true;
+		}
+
+
+		// Receive available data from the connection into the read buffer, up to the byte
+		// allowance at the given time, taking the received bytes from it. Receiving anything
+		// counts the client as active. A zero length read means the peer shut down its side,
+		// see shut_down.
+		// Returns the number of bytes received.
+		std::size_t receive(token_bucket::time now) {
+			if (this->_shut_down || this->read_buffer.full())
+				return 0;
+
+			const auto requested = std::min<uint64_t>(this->read_buffer.tail(), this->byte_allowance(now));
+
+			if (requested == 0)
+				return 0;
+
+			const auto result = this->read_buffer.read(this->connection, requested);
+
+			// a reset connection reports its error, a shut down one just closes.
+			if (result.status == tp3::socket::status::closed && result.error == 0)
+				this->_shut_down = true;
+			else if (result.failed())
+				this->disconnected = true;
+
+			this->byte_tokens.take(now, result.size);
+
+			if (result.size > 0)
+				this->touch(now);
+
+			return result.size;
+		}
+
+		// Whether there is received data not yet extracted by next.
+		bool buffered() const noexcept {
+			return !this->read_buffer.empty();
+		}
+
+
+		// The data received by the last call to receive. Only valid until next is called.
+		const uint8_t* received() const noexcept {
+			return this->read_buffer.last_read();
+		}
 
-		bool connected() const {
-			return !this->connection.is_closed();
+		// The size of the last message extracted by next.
+		std::size_t frame_size() const noexcept {
+			return this->read_buffer.frame_size();
 		}
 
 
-		std::optional<message::variant> read() {
-			return this->read_buffer.template read<message::variant>(
-				this->connection,
-				message::decode<typename decltype(read_buffer)::parser_iter>,
+		// Record the time of the last call to receive, which received the given bytes, for
+		// read_time. Only needed while messages are traced.
+		void timestamp(std::size_t received, uint64_t time) {
+			if (received == 0)
+				return;
+
+			this->received_bytes += received;
+			this->reads.push_back(read { this->received_bytes, time });
+		}
+
+		// The time of the read that completed the last message extracted by next, as recorded
+		// by timestamp, or 0 if not recorded.
+		uint64_t read_time() {
+			const auto consumed = this->received_bytes - this->read_buffer.buffered();
+
+			// Reads that ended before the message did can't complete any later message.
+			while (!this->reads.empty() && this->reads.front().end < consumed)
+				this->reads.pop_front();
+
+			return this->reads.empty() ? 0 : this->reads.front().time;
+		}
+
+		// Extract the next buffered message, if any. The message refers to the read buffer, so
+		// it is only valid until the next call to receive.
+		std::optional<message::view_variant> next() {
+			return this->read_buffer.template next<message::view_variant>(
+				message::decode<typename decltype(read_buffer)::parser_iter, array_view<uint8_t>>,
 				message::token_value(message::token::heading),
 				message::token_value(message::token::end)
 			);
 		}
 
 
-		void send(tp3::client::message::variant&& message) const {
-			this->send(
-				tp3::client::message::encode(
-					std::move(message)
-				)
-			);
+	protected:
+		// Send what the socket takes at once, unless data is already queued. Returns how many
+		// bytes were sent, or nothing if the packet must be dropped because the client
+		// disconnected or the queue is full.
+		std::optional<std::size_t> send_direct(const uint8_t packet[], std::size_t size) {
+			std::size_t sent = 0;
+
+			if (this->write_queue.empty() && !this->disconnected) {
+				const auto result = this->connection.send(packet, size);
+
+				sent = result.size;
+
+				if (result.failed())
+					this->disconnected = true;
+				else if (sent == size)
+					return sent;
+			}
+
+			if (this->disconnected)
+				return {};
+
+			const bool partial = sent > 0; // must queue the rest to keep the framing.
+
+			if (!partial && this->write_queue.size() + size > this->send_queue_limit)
+				return {};
+
+			return sent;
 		}
 
-		void send(const boxed_array<uint8_t>& packet) const {
-			this->connection.send(
-				packet.get(),
-				packet.size()
-			);
+
+	public:
+		// Send a packet, queueing what the socket can't take at once.
+		// Returns false if the packet was dropped because the queue is full.
+		bool send(const uint8_t packet[], std::size_t size) {
+			const auto sent = this->send_direct(packet, size);
+
+			if (!sent)
+				return false;
+
+			if (*sent < size)
+				this->write_queue.push(packet + *sent, size - *sent);
+
+			return true;
+		}
+
+		bool send(const boxed_array<uint8_t>& packet) {
+			return this->send(packet.get(), packet.size());
+		}
+
+		// Send a shared packet, queueing a reference to what the socket can't take at once.
+		bool send(const std::shared_ptr<const std::vector<uint8_t>>& packet) {
+			const auto sent = this->send_direct(packet->data(), packet->size());
+
+			if (!sent)
+				return false;
+
+			if (*sent < packet->size())
+				this->write_queue.push(packet, *sent);
+
+			return true;
+		}
+
+
+		// Bytes waiting in the write queue.
+		std::size_t backlog() const noexcept {
+			return this->write_queue.size();
+		}
+
+		// Stream positions of the write queue, see tp3::util::write_queue.
+		uint64_t sent() const noexcept {
+			return this->write_queue.sent();
+		}
+
+		uint64_t queued() const noexcept {
+			return this->write_queue.queued();
+		}
+
+
+		// Send queued data until the socket would block.
+		void flush() {
+			if (this->write_queue.flush(this->connection).failed())
+				this->disconnected = true;
+			else if (this->_finished && this->write_queue.empty())
+				this->disconnected = true;
 		}
 	};
 }
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/socket.h>
+
+
+namespace tp3::server {
+	// Server tuning parameters.
+	struct config {
+		// The listen backlog. The kernel caps it to net.core.somaxconn.
+		uint32_t backlog = SOMAXCONN;
+		// Maximum connections accepted per event loop iteration.
+		std::size_t accept_budget = 256;
+		// Maximum messages handled per client per event loop iteration, so that a client
+		// pipelining many messages doesn't delay the others. The rest wait for the next
+		// iteration in the client's buffer.
+		std::size_t message_budget = 64;
+		// Per client input rate limits, in messages and bytes per second, zero for
+		// unlimited, and the bursts allowed above them, zero for a second's worth. A client
+		// over its limits is not read until back under them, leaving its traffic in the
+		// kernel's buffers, which pushes back on the sender.
+		uint64_t message_rate = 0;
+		uint64_t message_burst = 0;
+		uint64_t byte_rate = 0;
+		uint64_t byte_burst = 0;
+		// Disconnect a client after this long without receiving anything from it, zero to
+		// never. Catches the peers that vanished without closing the connection.
+		std::chrono::milliseconds idle_timeout { 0 };
+		// Ping a client after this long without receiving anything from it, and disconnect
+		// it if it doesn't answer within as long again, zero to never ping.
+		std::chrono::milliseconds heartbeat { 0 };
+		// Overload limits: the time an event loop iteration takes, smoothed, and the bytes
+		// queued for all clients, zero to ignore each. At the limits, the server stops
+		// accepting connections, and at twice the limits, it also sheds broadcasts, see
+		// tp3::server::admission.
+		std::chrono::milliseconds iteration_limit { 0 };
+		std::size_t queue_limit = 0;
+		// Maximum bytes queued for a client whose socket is not writable. Messages that
+		// don't fit are dropped for that client.
+		std::size_t send_queue_limit = 1 << 20;
+		// Maximum size of a users page frame, in bytes. The default fits the smallest client
+		// buffer.
+		std::size_t page_bytes = 512;
+		// The local UDP port of the metrics endpoint. Empty to disable it.
+		std::string admin_port;
+		// Trace the latency of one in this many messages. Zero to disable tracing.
+		std::size_t trace_sample_rate = 0;
+		// Where to write the traces, if anywhere.
+		std::string trace_file;
+		// Where to capture the inbound traffic for replay, if anywhere.
+		std::string capture_file;
+	};
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <util/log.hpp>
+
+
+// Server log events.
+namespace tp3::server::events {
+	using tp3::util::log::event;
+	using tp3::util::log::level;
+
+	inline constexpr event accepted { level::info, "client {} connected from {}" };
+	inline constexpr event accept_failed { level::error, "accept failed: {}" };
+	inline constexpr event disconnected { level::info, "client {} disconnected" };
+	inline constexpr event name_set { level::info, "client {} set name to '{}'" };
+	inline constexpr event name_anonymous { level::info, "client {} set name to anonymous" };
+	inline constexpr event name_taken { level::info, "client {} can't set name to '{}': already in use" };
+	inline constexpr event subscribed { level::info, "client {} subscribed to presence" };
+	inline constexpr event unsubscribed { level::info, "client {} unsubscribed from presence" };
+	inline constexpr event room_joined { level::info, "client {} joined room '{}'" };
+	inline constexpr event room_left { level::info, "client {} left room '{}'" };
+	inline constexpr event blocked { level::info, "client {} blocked '{}'" };
+	inline constexpr event unblocked { level::info, "client {} unblocked '{}'" };
+	inline constexpr event pinged { level::debug, "client {} idle, pinged" };
+	inline constexpr event timed_out { level::info, "client {} timed out" };
+	inline constexpr event loaded { level::warning, "loaded, iteration {} us, {} bytes queued: not accepting" };
+	inline constexpr event overloaded { level::warning, "overloaded, iteration {} us, {} bytes queued: shedding broadcasts" };
+	inline constexpr event load_normal { level::info, "load normal, iteration {} us, {} bytes queued: accepting" };
+	inline constexpr event message { level::debug, "client {} sent a message of type {}" };
+}
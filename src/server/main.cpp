@@ -3,37 +3,188 @@
 #include <algorithm>
 #include <iostream>
 #include <cerrno>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <iterator>
 
 #include <netdb.h>
 #include <signal.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include <server/server.hpp>
 
 
 namespace tp3::server::main {
+	void usage(char* program) {
+		std::cerr << "Usage: " << program
+		          << " [-b buffer_size] [-q backlog] [-a accept_budget] [-B message_budget]"
+		          << " [-r message_rate] [-R byte_rate] [-i idle_timeout] [-k heartbeat]"
+		          << " [-L iteration_limit] [-Q queue_limit] [-l log_level] [-m admin_port]"
+		          << " [-t trace_sample_rate] [-T trace_file] [-C capture_file] <port>"
+		          << std::endl;
+		std::cerr << "Supported buffer sizes:";
+
+		for (auto size : buffer_sizes::values)
+			std::cerr << ' ' << size;
+
+		std::cerr << " (default " << default_buffer_size << ")" << std::endl;
+		std::cerr << "Log levels: debug info warning error (default info)" << std::endl;
+		std::cerr << "The message budget limits the messages handled per client per iteration (default "
+		          << tp3::server::config().message_budget << ")" << std::endl;
+		std::cerr << "The rates limit each client's messages and bytes per second (default unlimited)" << std::endl;
+		std::cerr << "The idle timeout disconnects clients silent for that many seconds (default never)" << std::endl;
+		std::cerr << "The heartbeat pings clients silent for that many seconds, disconnecting those that"
+		          << " don't answer within as long again (default never)" << std::endl;
+		std::cerr << "The overload limits, on the event loop's iteration time in milliseconds and the bytes queued for"
+		          << " the clients in megabytes, pause accepting and shed broadcasts (default none)" << std::endl;
+		std::cerr << "The admin port serves metrics over UDP on localhost (default disabled)" << std::endl;
+		std::cerr << "Tracing samples one in trace_sample_rate messages (default disabled)" << std::endl;
+		std::cerr << "The capture file records the inbound traffic, for replay (default disabled)" << std::endl;
+		::exit(1);
+	}
+
+
+	std::size_t parse_count(char* program, const char* option, const char* value) {
+		char* end;
+		const auto count = std::strtoul(value, &end, 10);
+
+		if (*value == '\0' || *end != '\0' || count == 0) {
+			std::cerr << "Invalid " << option << ": " << value << std::endl;
+			usage(program);
+		}
+
+		return count;
+	}
+
+
 	args parse_args(int argc, char** argv) {
-		if (argc < 2) {
+		std::size_t buffer_size = default_buffer_size;
+		tp3::server::config config;
+		auto log_level = tp3::util::log::level::info;
+
+		int option;
+
+		// http://man7.org/linux/man-pages/man3/getopt.3.html
+		while ((option = ::getopt(argc, argv, "b:q:a:B:r:R:i:k:L:Q:l:m:t:T:C:")) != -1)
+			switch (option) {
+				case 'b':
+					buffer_size = parse_count(argv[0], "buffer size", optarg);
+
+					if (!buffer_sizes::contains(buffer_size)) {
+						std::cerr << "Invalid buffer size: " << optarg << std::endl;
+						usage(argv[0]);
+					}
+
+					break;
+
+				case 'q':
+					config.backlog = parse_count(argv[0], "backlog", optarg);
+					break;
+
+				case 'a':
+					config.accept_budget = parse_count(argv[0], "accept budget", optarg);
+					break;
+
+				case 'B':
+					config.message_budget = parse_count(argv[0], "message budget", optarg);
+					break;
+
+				case 'r':
+					config.message_rate = parse_count(argv[0], "message rate", optarg);
+					break;
+
+				case 'R':
+					config.byte_rate = parse_count(argv[0], "byte rate", optarg);
+					break;
+
+				case 'i':
+					config.idle_timeout = std::chrono::seconds(parse_count(argv[0], "idle timeout", optarg));
+					break;
+
+				case 'k':
+					config.heartbeat = std::chrono::seconds(parse_count(argv[0], "heartbeat", optarg));
+					break;
+
+				case 'L':
+					config.iteration_limit = std::chrono::milliseconds(parse_count(argv[0], "iteration limit", optarg));
+					break;
+
+				case 'Q': {
+					const auto megabytes = parse_count(argv[0], "queue limit", optarg);
+
+					// in bytes, it must not overflow.
+					if (megabytes > SIZE_MAX >> 20) {
+						std::cerr << "Invalid queue limit: " << optarg << std::endl;
+						usage(argv[0]);
+					}
+
+					config.queue_limit = megabytes << 20;
+					break;
+				}
+
+				case 'l': {
+					const char* levels[] = { "debug", "info", "warning", "error" };
+
+					const auto level = std::find_if(
+						std::begin(levels),
+						std::end(levels),
+						[](const char* level) { return std::strcmp(level, optarg) == 0; }
+					);
+
+					if (level == std::end(levels)) {
+						std::cerr << "Invalid log level: " << optarg << std::endl;
+						usage(argv[0]);
+					}
+
+					log_level = tp3::util::log::level(level - std::begin(levels));
+					break;
+				}
+
+				case 'm':
+					parse_count(argv[0], "admin port", optarg);
+					config.admin_port = optarg;
+					break;
+
+				case 't':
+					config.trace_sample_rate = parse_count(argv[0], "trace sample rate", optarg);
+					break;
+
+				case 'T':
+					config.trace_file = optarg;
+					break;
+
+				case 'C':
+					config.capture_file = optarg;
+					break;
+
+				default:
+					usage(argv[0]);
+			}
+
+		if (optind >= argc) {
 			std::cerr << "Missing port argument" << std::endl;
-			std::cerr << "Usage: " << argv[0] << " <port>" << std::endl;
-			::exit(1);
+			usage(argv[0]);
 		}
 
 		return (args) {
 			.address = tp3::socket::addr(
-				tp3::socket::name("::", argv[1]),
+				tp3::socket::name("::", argv[optind]),
 				(addrinfo) {
 					.ai_family = AF_UNSPEC, // accept both ipv4 and ipv6
 					.ai_socktype = SOCK_STREAM // force TCP
 				}
-			)
+			),
+			.buffer_size = buffer_size,
+			.config = config,
+			.log_level = log_level
 		};
 	}
 
 
 	void sig_handler(int signal, void (*handler)(int)) {
-		struct sigaction action;
+		struct sigaction action { };
 		action.sa_handler = handler;
 
 		if (::sigemptyset(&action.sa_mask) != 0)
@@ -61,19 +212,37 @@ namespace tp3::server::main {
 	}
 
 
+	volatile std::sig_atomic_t stop = 0;
+
+
 	int main(int argc, char* argv[]) try {
 		sig_handler(
 			SIGINT,
-			[](int) { }
+			[](int) { stop = 1; }
+		);
+
+		sig_handler(
+			SIGUSR1,
+			[](int) { tp3::util::log::request_dump(); }
 		);
 
 		args args = parse_args(argc, argv);
 
-		tp3::server::server<1024> server(
-			std::move(args.address)
-		);
+		tp3::util::log::writer log_writer(std::cout, args.log_level);
+
+		buffer_sizes::call(
+			args.buffer_size,
+			[&](auto buffer_size) {
+				tp3::server::server<buffer_size> server(
+					std::move(args.address),
+					args.config
+				);
 
-		server.process();
+				server.process(stop);
+
+				std::cerr << server.stats() << std::endl;
+			}
+		);
 
 		return interrupted();
 	}
@@ -1,17 +1,32 @@
 #pragma once
 
+#include <csignal>
 #include <cstddef>
 #include <exception>
 #include <system_error>
 
+#include <server/config.hpp>
 #include <socket/addr.hpp>
+#include <util/dispatch.hpp>
+#include <util/log.hpp>
 
 
 namespace tp3::server::main {
+	// The buffer sizes the server is compiled for, selectable at runtime.
+	using buffer_sizes = tp3::util::size_dispatch<512, 1024, 4096, 16384, 65536>;
+
+	constexpr std::size_t default_buffer_size = 1024;
+
+
 	struct args {
 		tp3::socket::addr address;
+		std::size_t buffer_size;
+		tp3::server::config config;
+		tp3::util::log::level log_level;
 	};
 
+	void usage(char* program);
+	std::size_t parse_count(char* program, const char* option, const char* value);
 	args parse_args(int argc, char** argv);
 
 
@@ -20,5 +35,8 @@ namespace tp3::server::main {
 	int exception(const std::exception&);
 	int sys_error(const std::system_error&);
 
+	// Set by SIGINT to stop the server.
+	extern volatile std::sig_atomic_t stop;
+
 	int main(int argc, char* argv[]);
 }
@@ -1,16 +1,24 @@
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <string>
 #include <type_traits>
 #include <variant>
 #include <optional>
+#include <vector>
 
+#include <util/array_view.hpp>
 #include <util/boxed_array.hpp>
+#include <util/number.hpp>
 #include <util/overload.hpp>
 
 
 // Messages received by the server.
+// The messages carrying text are templates on the text type: boxed_array owns it, for
+// building messages, while array_view refers to the decoded frame, for handling messages
+// without copying them. The views are only valid until the frame's buffer is reused.
 namespace tp3::server::message {
 	enum class token : uint8_t {
 		name = 0x84,			 // Index character.
@@ -19,7 +27,18 @@ namespace tp3::server::message {
 		unicast = 0x9E,    // Private message character.
 		heading = 0x01,    // Start of heading character.
 		end = 0x04,        // End of transmission character.
-		text = 0x02        // Start of text character.
+		text = 0x02,       // Start of text character.
+		user_sep = 0x1F,   // Unit separator character.
+		subscribe = 0x11,  // Device control one (XON) character.
+		unsubscribe = 0x13, // Device control three (XOFF) character.
+		unicast_handle = 0x91, // Private use one character.
+		multicast = 0x92,  // Private use two character.
+		join = 0x0E,       // Shift out character.
+		leave = 0x0F,      // Shift in character.
+		publish = 0x93,    // Set transmit state character.
+		block = 0x14,      // Device control four character.
+		unblock = 0x12,    // Device control two character.
+		pong = 0x07        // Bell character.
 	};
 
 	constexpr auto token_value(token tok) noexcept {
@@ -32,27 +51,31 @@ namespace tp3::server::message {
 	template<typename T>
 	using boxed_array = tp3::util::boxed_array<T>;
 
+	template<typename T>
+	using array_view = tp3::util::array_view<T>;
+
 
 	// Set name message.
-	class name {
+	template<typename Text>
+	class basic_name {
 	public:
 		static constexpr std::size_t min_size = 3; // minimum message size.
 
-		boxed_array<uint8_t> text;
+		Text text;
 
 
-		name(const name&) = delete;
-		name(name&& other) noexcept = default;
-		name(boxed_array<uint8_t>&& text)
+		basic_name(const basic_name&) = delete;
+		basic_name(basic_name&& other) noexcept = default;
+		basic_name(Text&& text)
 			: text(std::move(text)) { }
 
-		name& operator=(const name&) = delete;
-		name& operator=(name&&) = default;
+		basic_name& operator=(const basic_name&) = delete;
+		basic_name& operator=(basic_name&&) = default;
 
 
 		template<typename ForwardIterator>
-		static std::optional<name> decode(ForwardIterator& begin, ForwardIterator end) {
-			if (std::distance(begin, end) < name::min_size)
+		static std::optional<basic_name> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < basic_name::min_size)
 				return {};
 
 			if (*begin != token_value(token::heading))
@@ -76,28 +99,43 @@ namespace tp3::server::message {
 
 			begin = text_end + 1;  // leave begin at the end of the parsed data.
 
-			return name(
-				boxed_array<uint8_t>(text, text_end)
+			return basic_name(
+				Text(text, text_end)
 			);
 		}
 	};
 
 
-	class list_users {
+	// List users message. Without a query, the whole users list is requested. With a query,
+	// a page of the names starting with a prefix, in byte order:
+	// heading list_users offset user_sep limit user_sep prefix end.
+	template<typename Text>
+	class basic_list_users {
 	public:
 		static constexpr std::size_t min_size = 3; // minimum message size.
 
-		list_users(const list_users&) = delete;
-		list_users(list_users&& other) noexcept = default;
-		list_users() noexcept = default;
+		struct page {
+			std::size_t offset; // Matching names to skip.
+			std::size_t limit; // Maximum names to list, zero for as many as fit a frame.
+			Text prefix;
+		};
+
+		std::optional<page> query;
 
-		list_users& operator=(const list_users&) = delete;
-		list_users& operator=(list_users&&) = default;
+
+		basic_list_users(const basic_list_users&) = delete;
+		basic_list_users(basic_list_users&& other) noexcept = default;
+		basic_list_users() noexcept = default;
+		basic_list_users(std::size_t offset, std::size_t limit, Text&& prefix)
+			: query(page { offset, limit, std::move(prefix) }) { }
+
+		basic_list_users& operator=(const basic_list_users&) = delete;
+		basic_list_users& operator=(basic_list_users&&) = default;
 
 
 		template<typename ForwardIterator>
-		static std::optional<list_users> decode(ForwardIterator& begin, ForwardIterator end) {
-			if (std::distance(begin, end) < list_users::min_size)
+		static std::optional<basic_list_users> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < basic_list_users::min_size)
 				return {};
 
 			if (*begin != token_value(token::heading))
@@ -110,35 +148,65 @@ namespace tp3::server::message {
 
 			++begin;
 
-			if (*begin != token_value(token::end))
+			if (*begin == token_value(token::end)) {
+				++begin; // leave begin at the end of the parsed data.
+
+				return basic_list_users();
+			}
+
+			const auto body_end = std::find(begin, end, token_value(token::end));
+
+			if (body_end == end)
 				return {};
 
-			++begin; // leave begin at the end of the parsed data.
+			const auto offset_end = std::find(begin, body_end, token_value(token::user_sep));
+
+			if (offset_end == body_end)
+				return {};
+
+			const auto limit_end = std::find(offset_end + 1, body_end, token_value(token::user_sep));
+
+			if (limit_end == body_end)
+				return {};
 
-			return list_users();
+			// there are no more sessions than handles, larger numbers are out of range.
+			const auto offset = tp3::util::decode_number(begin, offset_end, UINT32_MAX);
+			const auto limit = tp3::util::decode_number(offset_end + 1, limit_end, UINT32_MAX);
+
+			if (!offset || !limit)
+				return {};
+
+			begin = body_end + 1;  // leave begin at the end of the parsed data.
+
+			return basic_list_users(
+				*offset,
+				*limit,
+				Text(limit_end + 1, body_end)
+			);
 		}
 	};
 
 
-	class broadcast {
+	template<typename Text>
+	class basic_broadcast {
 	public:
 		static constexpr std::size_t min_size = 3; // minimum message size.
 
-		boxed_array<uint8_t> text;
+		Text text;
 
 
-		broadcast(const broadcast&) = delete;
-		broadcast(broadcast&& other) noexcept = default;
-		broadcast(boxed_array<uint8_t>&& text)
+		basic_broadcast(const basic_broadcast&) = delete;
+		basic_broadcast(basic_broadcast&& other) noexcept = default;
+		basic_broadcast(Text&& text)
 			: text(std::move(text)) { }
 
-		broadcast& operator=(const broadcast&) = delete;
-		broadcast& operator=(broadcast&&) = default;
+		basic_broadcast& operator=(const basic_broadcast&) = delete;
+		basic_broadcast& operator=(basic_broadcast&&) = default;
 
 
 		template<typename ForwardIterator>
-		static std::optional<broadcast> decode(ForwardIterator& begin, ForwardIterator end) {
-			if (std::distance(begin, end) < broadcast::min_size)
+		static std::optional<basic_broadcast> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < basic_broadcast::min_size)
 				return {};
 
 			if (*begin != token_value(token::heading))
@@ -162,33 +230,34 @@ namespace tp3::server::message {
 
 			begin = text_end + 1;  // leave begin at the end of the parsed data.
 
-			return broadcast(
-				boxed_array<uint8_t>(text, text_end)
+			return basic_broadcast(
+				Text(text, text_end)
 			);
 		}
 	};
 
 
-	class unicast {
+	template<typename Text>
+	class basic_unicast {
 	public:
 		static constexpr std::size_t min_size = 4; // minimum message size.
 
-		boxed_array<uint8_t> target;
-		boxed_array<uint8_t> text;
+		Text target;
+		Text text;
 
-		unicast(const unicast&) = delete;
-		unicast(unicast&& other) noexcept = default;
-		unicast(boxed_array<uint8_t>&& target, boxed_array<uint8_t>&& text)
+		basic_unicast(const basic_unicast&) = delete;
+		basic_unicast(basic_unicast&& other) noexcept = default;
+		basic_unicast(Text&& target, Text&& text)
 			: target(std::move(target)),
 			  text(std::move(text)) { }
 
-		unicast& operator=(const unicast&) = delete;
-		unicast& operator=(unicast&&) = default;
+		basic_unicast& operator=(const basic_unicast&) = delete;
+		basic_unicast& operator=(basic_unicast&&) = default;
 
 
 		template<typename ForwardIterator>
-		static std::optional<unicast> decode(ForwardIterator& begin, ForwardIterator end) {
-			if (std::distance(begin, end) < unicast::min_size)
+		static std::optional<basic_unicast> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < basic_unicast::min_size)
 				return {};
 
 			if (*begin != token_value(token::heading))
@@ -223,20 +292,450 @@ namespace tp3::server::message {
 
 			begin = text_end + 1;  // leave begin at the end of the parsed data.
 
-			return unicast(
-				boxed_array<uint8_t>(target, target_end),
-				boxed_array<uint8_t>(text, text_end)
+			return basic_unicast(
+				Text(target, target_end),
+				Text(text, text_end)
+			);
+		}
+	};
+
+
+	// Unicast message addressed by session handle, see tp3::client::message::session.
+	template<typename Text>
+	class basic_unicast_handle {
+	public:
+		static constexpr std::size_t min_size = 5; // minimum message size.
+
+		uint32_t target;
+		Text text;
+
+		basic_unicast_handle(const basic_unicast_handle&) = delete;
+		basic_unicast_handle(basic_unicast_handle&& other) noexcept = default;
+		basic_unicast_handle(uint32_t target, Text&& text)
+			: target(target),
+			  text(std::move(text)) { }
+
+		basic_unicast_handle& operator=(const basic_unicast_handle&) = delete;
+		basic_unicast_handle& operator=(basic_unicast_handle&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<basic_unicast_handle> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < basic_unicast_handle::min_size)
+				return {};
+
+			if (*begin != token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != token_value(token::unicast_handle))
+				return {};
+
+			const auto target = begin + 1;
+
+			const auto target_end = std::find(
+				target,
+				end,
+				token_value(token::text)
+			);
+
+			if (target_end == end)
+				return {};
+
+			const auto text = target_end + 1;
+
+			const auto text_end = std::find(
+				text,
+				end,
+				token_value(token::end)
+			);
+
+			if (text_end == end)
+				return {};
+
+			const auto handle = tp3::util::decode_number(target, target_end, UINT32_MAX);
+
+			if (!handle)
+				return {};
+
+			begin = text_end + 1;  // leave begin at the end of the parsed data.
+
+			return basic_unicast_handle(
+				*handle,
+				Text(text, text_end)
+			);
+		}
+	};
+
+
+	// Multicast message: one text to a list of targets, by name:
+	// heading multicast target user_sep target ... text text end.
+	// The targets are kept as they were framed, see for_each_target.
+	template<typename Text>
+	class basic_multicast {
+	public:
+		static constexpr std::size_t min_size = 4; // minimum message size.
+
+		Text targets;
+		Text text;
+
+
+		basic_multicast(const basic_multicast&) = delete;
+		basic_multicast(basic_multicast&& other) noexcept = default;
+		basic_multicast(Text&& targets, Text&& text)
+			: targets(std::move(targets)),
+			  text(std::move(text)) { }
+
+		// Build from a list of targets. Only for owning text types.
+		basic_multicast(const std::vector<Text>& targets, Text&& text)
+			: targets(join(targets)),
+			  text(std::move(text)) { }
+
+		basic_multicast& operator=(const basic_multicast&) = delete;
+		basic_multicast& operator=(basic_multicast&&) = default;
+
+
+		static Text join(const std::vector<Text>& targets) {
+			std::size_t size = targets.empty() ? 0 : targets.size() - 1; // user_sep
+
+			for (const auto& target : targets)
+				size += target.size();
+
+			Text joined(size);
+			auto joined_it = joined.begin();
+
+			for (std::size_t i = 0; i < targets.size(); ++i) {
+				if (i > 0)
+					*joined_it++ = token_value(token::user_sep);
+
+				joined_it = std::copy(targets[i].begin(), targets[i].end(), joined_it);
+			}
+
+			return joined;
+		}
+
+
+		// Call f with a view of each target, in order.
+		template<typename F>
+		void for_each_target(F f) const {
+			auto begin = this->targets.begin();
+			const auto end = this->targets.end();
+
+			if (begin == end)
+				return;
+
+			while (true) {
+				const auto separator = std::find(begin, end, token_value(token::user_sep));
+				f(array_view<uint8_t>(begin, separator));
+
+				// past the last target, there is no separator to step over.
+				if (separator == end)
+					break;
+
+				begin = separator + 1;
+			}
+		}
+
+
+		template<typename ForwardIterator>
+		static std::optional<basic_multicast> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < basic_multicast::min_size)
+				return {};
+
+			if (*begin != token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != token_value(token::multicast))
+				return {};
+
+			const auto targets = begin + 1;
+
+			const auto targets_end = std::find(
+				targets,
+				end,
+				token_value(token::text)
+			);
+
+			if (targets_end == end)
+				return {};
+
+			const auto text = targets_end + 1;
+
+			const auto text_end = std::find(
+				text,
+				end,
+				token_value(token::end)
+			);
+
+			if (text_end == end)
+				return {};
+
+			begin = text_end + 1;  // leave begin at the end of the parsed data.
+
+			return basic_multicast(
+				Text(targets, targets_end),
+				Text(text, text_end)
+			);
+		}
+	};
+
+
+	// Room membership messages: join a room, creating it if needed, or leave it.
+	template<typename Text, token kind>
+	class basic_membership {
+	public:
+		static constexpr std::size_t min_size = 3; // minimum message size.
+
+		Text room;
+
+
+		basic_membership(const basic_membership&) = delete;
+		basic_membership(basic_membership&& other) noexcept = default;
+		basic_membership(Text&& room)
+			: room(std::move(room)) { }
+
+		basic_membership& operator=(const basic_membership&) = delete;
+		basic_membership& operator=(basic_membership&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<basic_membership> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < basic_membership::min_size)
+				return {};
+
+			if (*begin != token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != token_value(kind))
+				return {};
+
+			const auto room = begin + 1;
+
+			const auto room_end = std::find(
+				room,
+				end,
+				token_value(token::end)
+			);
+
+			if (room_end == end)
+				return {};
+
+			begin = room_end + 1;  // leave begin at the end of the parsed data.
+
+			return basic_membership(
+				Text(room, room_end)
+			);
+		}
+	};
+
+	template<typename Text>
+	using basic_join = basic_membership<Text, token::join>;
+
+	template<typename Text>
+	using basic_leave = basic_membership<Text, token::leave>;
+
+
+	// Text message to the members of a room.
+	template<typename Text>
+	class basic_publish {
+	public:
+		static constexpr std::size_t min_size = 4; // minimum message size.
+
+		Text room;
+		Text text;
+
+		basic_publish(const basic_publish&) = delete;
+		basic_publish(basic_publish&& other) noexcept = default;
+		basic_publish(Text&& room, Text&& text)
+			: room(std::move(room)),
+			  text(std::move(text)) { }
+
+		basic_publish& operator=(const basic_publish&) = delete;
+		basic_publish& operator=(basic_publish&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<basic_publish> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < basic_publish::min_size)
+				return {};
+
+			if (*begin != token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != token_value(token::publish))
+				return {};
+
+			const auto room = begin + 1;
+
+			const auto room_end = std::find(
+				room,
+				end,
+				token_value(token::text)
+			);
+
+			if (room_end == end)
+				return {};
+
+			const auto text = room_end + 1;
+
+			const auto text_end = std::find(
+				text,
+				end,
+				token_value(token::end)
+			);
+
+			if (text_end == end)
+				return {};
+
+			begin = text_end + 1;  // leave begin at the end of the parsed data.
+
+			return basic_publish(
+				Text(room, room_end),
+				Text(text, text_end)
+			);
+		}
+	};
+
+
+	// Block list messages: ignore the messages of a user, by name, or stop ignoring them.
+	// A user is blocked by session, so the block lasts through renames until it disconnects.
+	template<typename Text, token kind>
+	class basic_blocking {
+	public:
+		static constexpr std::size_t min_size = 3; // minimum message size.
+
+		Text target;
+
+
+		basic_blocking(const basic_blocking&) = delete;
+		basic_blocking(basic_blocking&& other) noexcept = default;
+		basic_blocking(Text&& target)
+			: target(std::move(target)) { }
+
+		basic_blocking& operator=(const basic_blocking&) = delete;
+		basic_blocking& operator=(basic_blocking&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<basic_blocking> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < basic_blocking::min_size)
+				return {};
+
+			if (*begin != token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != token_value(kind))
+				return {};
+
+			const auto target = begin + 1;
+
+			const auto target_end = std::find(
+				target,
+				end,
+				token_value(token::end)
+			);
+
+			if (target_end == end)
+				return {};
+
+			begin = target_end + 1;  // leave begin at the end of the parsed data.
+
+			return basic_blocking(
+				Text(target, target_end)
 			);
 		}
 	};
 
+	template<typename Text>
+	using basic_block = basic_blocking<Text, token::block>;
+
+	template<typename Text>
+	using basic_unblock = basic_blocking<Text, token::unblock>;
+
+
+	// Messages without a payload: subscribe to the presence deltas, starting with the users
+	// list, or unsubscribe from them, and pong, the answer to a ping from the server, which
+	// tells that the client is alive. A client may also send pongs unprompted, to keep an
+	// idle connection open.
+	template<token kind>
+	class signal {
+	public:
+		static constexpr std::size_t min_size = 3; // minimum message size.
+
+		signal(const signal&) = delete;
+		signal(signal&& other) noexcept = default;
+		signal() noexcept = default;
+
+		signal& operator=(const signal&) = delete;
+		signal& operator=(signal&&) = default;
+
+
+		template<typename ForwardIterator>
+		static std::optional<signal> decode(ForwardIterator& begin, ForwardIterator end) {
+			if (std::distance(begin, end) < signal::min_size)
+				return {};
+
+			if (*begin != token_value(token::heading))
+				return {};
+
+			++begin;
+
+			if (*begin != token_value(kind))
+				return {};
+
+			++begin;
+
+			if (*begin != token_value(token::end))
+				return {};
+
+			++begin; // leave begin at the end of the parsed data.
+
+			return signal();
+		}
+	};
+
+
+	using name = basic_name<boxed_array<uint8_t>>;
+	using list_users = basic_list_users<boxed_array<uint8_t>>;
+	using broadcast = basic_broadcast<boxed_array<uint8_t>>;
+	using unicast = basic_unicast<boxed_array<uint8_t>>;
+	using unicast_handle = basic_unicast_handle<boxed_array<uint8_t>>;
+	using multicast = basic_multicast<boxed_array<uint8_t>>;
+	using join = basic_join<boxed_array<uint8_t>>;
+	using leave = basic_leave<boxed_array<uint8_t>>;
+	using publish = basic_publish<boxed_array<uint8_t>>;
+	using block = basic_block<boxed_array<uint8_t>>;
+	using unblock = basic_unblock<boxed_array<uint8_t>>;
+	using subscribe = signal<token::subscribe>;
+	using unsubscribe = signal<token::unsubscribe>;
+	using pong = signal<token::pong>;
+
 
 	static constexpr std::size_t min_size = [] { // minimum message size.
 		const auto messages = {
 			name::min_size,
 			list_users::min_size,
 			broadcast::min_size,
-			unicast::min_size
+			unicast::min_size,
+			subscribe::min_size,
+			unsubscribe::min_size,
+			unicast_handle::min_size,
+			multicast::min_size,
+			join::min_size,
+			leave::min_size,
+			publish::min_size,
+			block::min_size,
+			unblock::min_size,
+			pong::min_size
 		};
 
 		return *std::max_element(
@@ -245,34 +744,98 @@ namespace tp3::server::message {
 		);
 	}();
 
-	using variant = std::variant<
-		name,
-		list_users,
-		broadcast,
-		unicast
+	template<typename Text>
+	using basic_variant = std::variant<
+		basic_name<Text>,
+		basic_list_users<Text>,
+		basic_broadcast<Text>,
+		basic_unicast<Text>,
+		subscribe,
+		unsubscribe,
+		basic_unicast_handle<Text>,
+		basic_multicast<Text>,
+		basic_join<Text>,
+		basic_leave<Text>,
+		basic_publish<Text>,
+		basic_block<Text>,
+		basic_unblock<Text>,
+		pong
 	>;
 
+	using variant = basic_variant<boxed_array<uint8_t>>;
+	using view_variant = basic_variant<array_view<uint8_t>>;
+
 
-	template<typename ForwardIterator>
-	std::optional<variant> decode(ForwardIterator& begin, ForwardIterator end) {
+	template<typename ForwardIterator, typename Text = boxed_array<uint8_t>>
+	std::optional<basic_variant<Text>> decode(ForwardIterator& begin, ForwardIterator end) {
 		const ForwardIterator _begin = begin;
 
-		if (auto message = name::decode(begin, end))
+		if (auto message = basic_name<Text>::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = basic_list_users<Text>::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = basic_broadcast<Text>::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = basic_unicast<Text>::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = subscribe::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = unsubscribe::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = basic_unicast_handle<Text>::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = basic_multicast<Text>::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = basic_join<Text>::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = basic_leave<Text>::decode(begin, end))
+			return std::move(*message);
+
+		begin = _begin; // rollback
+
+		if (auto message = basic_publish<Text>::decode(begin, end))
 			return std::move(*message);
 
 		begin = _begin; // rollback
 
-		if (auto message = list_users::decode(begin, end))
+		if (auto message = basic_block<Text>::decode(begin, end))
 			return std::move(*message);
 
 		begin = _begin; // rollback
 
-		if (auto message = broadcast::decode(begin, end))
+		if (auto message = basic_unblock<Text>::decode(begin, end))
 			return std::move(*message);
 
 		begin = _begin; // rollback
 
-		if (auto message = unicast::decode(begin, end))
+		if (auto message = pong::decode(begin, end))
 			return std::move(*message);
 
 		return {};
@@ -305,7 +868,18 @@ namespace tp3::server::message {
 				},
 
 				[](const list_users& msg) -> boxed_array<uint8_t> {
-					const std::size_t size = 3; // heading + list_users + end
+					std::string offset, limit;
+
+					if (msg.query) {
+						offset = std::to_string(msg.query->offset);
+						limit = std::to_string(msg.query->limit);
+					}
+
+					const std::size_t size = 3 // heading + list_users + end
+					                       + (msg.query ? 2 : 0) // user_sep + user_sep
+					                       + offset.size()
+					                       + limit.size()
+					                       + (msg.query ? msg.query->prefix.size() : 0);
 
 					boxed_array<uint8_t> packet(size);
 
@@ -313,6 +887,21 @@ namespace tp3::server::message {
 
 					*packet_it++ = token_value(token::heading);
 					*packet_it++ = token_value(token::list_users);
+
+					if (msg.query) {
+						packet_it = std::copy(offset.begin(), offset.end(), packet_it);
+						*packet_it++ = token_value(token::user_sep);
+
+						packet_it = std::copy(limit.begin(), limit.end(), packet_it);
+						*packet_it++ = token_value(token::user_sep);
+
+						packet_it = std::copy(
+							msg.query->prefix.begin(),
+							msg.query->prefix.end(),
+							packet_it
+						);
+					}
+
 					*packet_it++ = token_value(token::end);
 
 					return packet;
@@ -368,6 +957,231 @@ namespace tp3::server::message {
 
 					*packet_it++ = token_value(token::end);
 
+					return packet;
+				},
+
+				[](const unicast_handle& msg) -> boxed_array<uint8_t> {
+					const std::string target = std::to_string(msg.target);
+
+					const std::size_t size = 4 // heading + unicast_handle + text + end
+					                       + target.size()
+					                       + msg.text.size();
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::unicast_handle);
+
+					packet_it = std::copy(
+						target.begin(),
+						target.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::text);
+
+					packet_it = std::copy(
+						msg.text.begin(),
+						msg.text.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::end);
+
+					return packet;
+				},
+
+				[](const multicast& msg) -> boxed_array<uint8_t> {
+					const std::size_t size = 4 // heading + multicast + text + end
+					                       + msg.targets.size()
+					                       + msg.text.size();
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::multicast);
+
+					packet_it = std::copy(
+						msg.targets.begin(),
+						msg.targets.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::text);
+
+					packet_it = std::copy(
+						msg.text.begin(),
+						msg.text.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::end);
+
+					return packet;
+				},
+
+				[](const join& msg) -> boxed_array<uint8_t> {
+					const std::size_t size = 3 // heading + join + end
+					                       + msg.room.size();
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::join);
+
+					packet_it = std::copy(
+						msg.room.begin(),
+						msg.room.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::end);
+
+					return packet;
+				},
+
+				[](const leave& msg) -> boxed_array<uint8_t> {
+					const std::size_t size = 3 // heading + leave + end
+					                       + msg.room.size();
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::leave);
+
+					packet_it = std::copy(
+						msg.room.begin(),
+						msg.room.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::end);
+
+					return packet;
+				},
+
+				[](const publish& msg) -> boxed_array<uint8_t> {
+					const std::size_t size = 4 // heading + publish + text + end
+					                       + msg.room.size()
+					                       + msg.text.size();
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::publish);
+
+					packet_it = std::copy(
+						msg.room.begin(),
+						msg.room.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::text);
+
+					packet_it = std::copy(
+						msg.text.begin(),
+						msg.text.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::end);
+
+					return packet;
+				},
+
+				[](const block& msg) -> boxed_array<uint8_t> {
+					const std::size_t size = 3 // heading + block + end
+					                       + msg.target.size();
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::block);
+
+					packet_it = std::copy(
+						msg.target.begin(),
+						msg.target.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::end);
+
+					return packet;
+				},
+
+				[](const unblock& msg) -> boxed_array<uint8_t> {
+					const std::size_t size = 3 // heading + unblock + end
+					                       + msg.target.size();
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::unblock);
+
+					packet_it = std::copy(
+						msg.target.begin(),
+						msg.target.end(),
+						packet_it
+					);
+
+					*packet_it++ = token_value(token::end);
+
+					return packet;
+				},
+
+				[](const subscribe& msg) -> boxed_array<uint8_t> {
+					const std::size_t size = 3; // heading + subscribe + end
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::subscribe);
+					*packet_it++ = token_value(token::end);
+
+					return packet;
+				},
+
+				[](const unsubscribe& msg) -> boxed_array<uint8_t> {
+					const std::size_t size = 3; // heading + unsubscribe + end
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::unsubscribe);
+					*packet_it++ = token_value(token::end);
+
+					return packet;
+				},
+
+				[](const pong& msg) -> boxed_array<uint8_t> {
+					const std::size_t size = 3; // heading + pong + end
+
+					boxed_array<uint8_t> packet(size);
+
+					auto packet_it = packet.begin();
+
+					*packet_it++ = token_value(token::heading);
+					*packet_it++ = token_value(token::pong);
+					*packet_it++ = token_value(token::end);
+
 					return packet;
 				}
 			},
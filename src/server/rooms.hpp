@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <util/algorithm.hpp>
+#include <util/array_view.hpp>
+#include <util/boxed_array.hpp>
+
+
+namespace tp3::server {
+	// Rooms, by name, each with a dense array of its members' session handles, so that
+	// publishing to a room costs its members only. A room exists while it has members.
+	// Members are removed by position, which each client keeps for its rooms, see
+	// tp3::server::client::room_position.
+	class rooms {
+	public:
+		using handle = uint32_t;
+
+	protected:
+		struct room {
+			tp3::util::boxed_array<uint8_t> name;
+			std::vector<handle> members;
+		};
+
+		std::vector<room> _rooms;
+		std::vector<std::size_t> free_rooms;
+
+		// Room ids by name. The keys refer to the rooms' name storage.
+		std::unordered_map<tp3::util::array_view<uint8_t>, std::size_t> ids;
+
+
+	public:
+		std::optional<std::size_t> find(tp3::util::array_view<uint8_t> name) const {
+			const auto id = this->ids.find(name);
+
+			if (id == this->ids.end())
+				return {};
+
+			return id->second;
+		}
+
+		// Find a room, creating it if there is none, returning its id.
+		std::size_t open(tp3::util::array_view<uint8_t> name) {
+			if (auto id = this->find(name))
+				return *id;
+
+			std::size_t id;
+
+			if (this->free_rooms.empty()) {
+				id = this->_rooms.size();
+				this->_rooms.emplace_back();
+			}
+			else {
+				id = this->free_rooms.back();
+				this->free_rooms.pop_back();
+			}
+
+			this->_rooms[id].name = tp3::util::boxed_array<uint8_t>(name.begin(), name.end());
+			this->ids.emplace(this->_rooms[id].name, id);
+
+			return id;
+		}
+
+
+		tp3::util::array_view<uint8_t> name(std::size_t id) const noexcept {
+			return this->_rooms[id].name;
+		}
+
+		const std::vector<handle>& members(std::size_t id) const noexcept {
+			return this->_rooms[id].members;
+		}
+
+
+		// Add a member, returning its position.
+		std::size_t add(std::size_t id, handle member) {
+			auto& members = this->_rooms[id].members;
+			members.push_back(member);
+
+			return members.size() - 1;
+		}
+
+		// Remove the member at a position, closing the room if it was the last one. Returns
+		// the member moved into the position, if any, whose position must be updated.
+		std::optional<handle> remove(std::size_t id, std::size_t position) {
+			auto& room = this->_rooms[id];
+
+			tp3::util::algorithm::swap_pop(room.members, room.members.begin() + position);
+
+			if (room.members.empty()) {
+				this->ids.erase(tp3::util::array_view<uint8_t>(room.name));
+				this->free_rooms.push_back(id);
+				return {};
+			}
+
+			if (position == room.members.size()) // the last member, nothing moved.
+				return {};
+
+			return room.members[position];
+		}
+	};
+}
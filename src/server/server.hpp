@@ -2,42 +2,126 @@
 
 #include <poll.h>
 
-#include <iostream>
 #include <algorithm>
 #include <cerrno>
+#include <chrono>
+#include <csignal>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
 #include <system_error>
 #include <sstream>
 #include <vector>
 
 #include <socket/server.hpp>
 #include <socket/connection.hpp>
+#include <socket/push.hpp>
+#include <socket/transport.hpp>
+#include <server/admission.hpp>
+#include <server/capture.hpp>
 #include <server/client.hpp>
+#include <server/config.hpp>
+#include <server/events.hpp>
+#include <server/stats.hpp>
+#include <server/trace.hpp>
+#include <server/rooms.hpp>
+#include <server/sessions.hpp>
+#include <server/timer_wheel.hpp>
+#include <server/token_bucket.hpp>
+#include <server/users_index.hpp>
+#include <server/users_list.hpp>
 #include <util/algorithm.hpp>
+#include <util/array_view.hpp>
 #include <util/boxed_array.hpp>
 #include <util/overload.hpp>
+#include <util/tsc.hpp>
 
 
 namespace tp3::server {
 	template<typename T>
 	using boxed_array = tp3::util::boxed_array<T>;
 
+	template<typename T>
+	using array_view = tp3::util::array_view<T>;
+
 
-	template<std::size_t buffer_size>
+	// The chat server, serving clients through a Transport, see tp3::socket::kernel.
+	template<std::size_t buffer_size, typename Transport = tp3::socket::kernel>
 	class server {
 	protected:
-		tp3::socket::server socket;
+		using client_type = tp3::server::client<buffer_size, typename Transport::connection>;
+
+
+		const tp3::server::config config;
+
+		Transport transport;
+
+		typename Transport::server socket;
+		std::optional<tp3::socket::push> admin; // The metrics endpoint, if enabled.
 
-		std::vector<client<buffer_size>> clients;
+		std::vector<client_type> clients;
 
-		std::vector<pollfd> poll_sockets; // server socket : clients sockets
+		// server socket : admin socket : clients sockets
+		// The admin socket's descriptor is -1 when disabled, which poll ignores.
+		std::vector<pollfd> poll_sockets;
+		static constexpr std::ptrdiff_t clients_offset = 2;
 
+		// A named client's index, and its entry in the users list.
+		struct listing {
+			std::size_t client;
+			std::size_t entry;
+		};
+
+		// Listings by name. The keys refer to the clients' name storage.
 		std::unordered_map<
-			boxed_array<uint8_t>,
-			std::size_t
+			array_view<uint8_t>,
+			listing
 		> catalogue;
 
+		// Nodes extracted from the catalogue, reused to insert names without allocating.
+		std::vector<typename decltype(catalogue)::node_type> spare_nodes;
+
+		// Outgoing frames are encoded here, reusing the capacity.
+		std::vector<uint8_t> packet;
+
+		// The error frame listing the unknown targets of a multicast, reusing the capacity.
+		std::vector<uint8_t> unknown_targets;
+		uint64_t multicasts = 0; // Multicasts handled, numbering them for deliver_once.
+
+		// The encoded users list, kept up to date with the catalogue.
+		tp3::server::users_list users;
+		// The names in order, for listing pages of users.
+		tp3::server::users_index index;
+
+		// The clients' session handles, for unicast by handle.
+		tp3::server::sessions sessions;
+
+		tp3::server::rooms rooms;
+
+		// Indexes of the clients subscribed to presence deltas.
+		std::vector<std::size_t> subscribers;
+
+		// The clients' rate limits, copied to each accepted client.
+		tp3::server::token_bucket message_limit;
+		tp3::server::token_bucket byte_limit;
+
+		// When the first held client resumes, if any is held, see hold.
+		std::optional<token_bucket::time> wake;
+
+		// A timer per client, by session slot, checking its idleness, see expire.
+		tp3::server::timer_wheel timers;
+
+		tp3::server::admission admission;
+
+		tp3::server::stats loop_stats;
+		tp3::server::tracer tracer;
+
+		std::unique_ptr<capture::writer> capture; // The traffic capture, if enabled.
+		uint32_t next_id = 0; // The id of the next accepted connection.
+
 
 		using clients_iter = typename decltype(clients)::iterator;
 		using sockets_iter = typename decltype(poll_sockets)::iterator;
@@ -47,240 +131,1025 @@ namespace tp3::server {
 		server(const server&) = delete;
 		server(server&&) noexcept = default;
 
-		server(tp3::socket::addr&& address, uint32_t queue_size = 32)
-			: socket(std::move(address), queue_size),
-			  poll_sockets {
-			  	pollfd {
-			  		.fd = this->socket.descriptor(),
-			  		.events = POLLIN
-			  	}
-			  } { }
+		// Serve on the given address, with the kernel's transport.
+		server(tp3::socket::addr&& address, const tp3::server::config& config = {})
+			: server(
+			  	Transport(),
+			  	typename Transport::server(std::move(address), config.backlog),
+			  	config
+			  ) { }
+
+		server(
+			Transport transport,
+			typename Transport::server&& socket,
+			const tp3::server::config& config = {}
+		)
+			: config(config),
+			  transport(transport),
+			  socket(std::move(socket)),
+			  message_limit(config.message_rate, config.message_burst),
+			  byte_limit(config.byte_rate, config.byte_burst),
+			  timers(std::chrono::milliseconds(1), this->now()),
+			  admission(config.iteration_limit, config.queue_limit),
+			  tracer(config.trace_sample_rate, config.trace_file)
+		{
+			if (!config.capture_file.empty())
+				this->capture = std::make_unique<capture::writer>(config.capture_file);
+
+			if (!config.admin_port.empty())
+				this->admin.emplace(
+					tp3::socket::addr(
+						tp3::socket::name("localhost", config.admin_port.c_str()),
+						(addrinfo) {
+							.ai_family = AF_UNSPEC,
+							.ai_socktype = SOCK_DGRAM
+						}
+					),
+					tp3::socket::sock::bind
+				);
+
+			this->poll_sockets = {
+				pollfd {
+					.fd = this->socket.descriptor(),
+					.events = POLLIN
+				},
+				pollfd {
+					.fd = this->admin ? this->admin->descriptor() : -1,
+					.events = POLLIN
+				}
+			};
+		}
 
 
 		// Get a client iterator from a sockets iterator.
 		clients_iter get_client(const sockets_iter& it) {
 			auto begin = this->poll_sockets.begin();
 
-			// As the poll_sockets vector starts with the server socket, we must subtract 1.
-			const auto ix = std::distance(begin, it) - 1;
+			// As the poll_sockets vector starts with the server and admin sockets, we must
+			// subtract their count.
+			const auto ix = std::distance(begin, it) - clients_offset;
 
 			return this->clients.begin() + ix;
 		}
 
 
-		std::vector<boxed_array<uint8_t>> list_users() const {
-			std::vector<boxed_array<uint8_t>> usernames;
+		// Event loop statistics. Syscalls are counted for the calling thread, which must be the
+		// thread running the event loop.
+		tp3::server::stats stats() const noexcept {
+			auto stats = this->loop_stats;
+			stats.connections = this->clients.size();
+			stats.load_level = uint64_t(this->admission.level());
+			std::copy(this->tracer.latency().begin(), this->tracer.latency().end(), stats.latency);
+			stats.abandoned = this->tracer.abandoned();
+			stats.syscalls = tp3::socket::syscalls;
+
+			return stats;
+		}
 
-			usernames.reserve(
-				this->clients.size()
+
+		// The time, as the duration since the epoch of the transport's clock.
+		token_bucket::time now() const noexcept {
+			return std::chrono::duration_cast<token_bucket::time>(
+				this->transport.now().time_since_epoch()
 			);
+		}
 
-			std::size_t anonymous = 0;
 
-			for (auto& client : clients)
-				if (auto& name = client.name)
-					usernames.emplace_back(*name);
-				else
-					++anonymous;
+		// Poll the sockets, waiting until the first held client resumes or the first timer
+		// expires, if any, and no longer than the admission controller's recheck while the
+		// load is not normal.
+		int poll() noexcept {
+			int timeout = -1; // infinite timeout
+
+			auto until = this->wake;
+
+			if (const auto next = this->timers.next())
+				until = std::min(until.value_or(*next), *next);
 
-			if (anonymous > 0) {
-				std::stringstream stream;
-				stream << "anonymous(" << anonymous << ")";
+			if (!this->admission.accepting()) {
+				const auto recheck = this->now() + admission::recheck;
+				until = std::min(until.value_or(recheck), recheck);
+			}
+
+			if (until) {
+				const auto wait = std::chrono::ceil<std::chrono::milliseconds>(*until - this->now());
+				timeout = std::max<std::chrono::milliseconds::rep>(wait.count(), 0);
+			}
+
+			return this->transport.poll(
+				this->poll_sockets.data(),
+				this->poll_sockets.size(),
+				timeout
+			);
+		}
 
-				auto string = stream.str();
 
-				usernames.emplace_back(
-					string.begin(),
-					string.end()
+		// Accept pending connections, up to the accept budget.
+		void accept(token_bucket::time now) {
+			for (std::size_t i = 0; i < this->config.accept_budget; ++i) {
+				auto [result, connection] = this->transport.accept(this->socket);
+
+				if (result.status == tp3::socket::status::closed) // aborted before accepted.
+					continue;
+
+				if (!connection) {
+					if (result.failed()) // e.g. out of file descriptors, try again later.
+						tp3::util::log::write<events::accept_failed>(
+							tp3::util::log::error_code { result.error }
+						);
+
+					return;
+				}
+
+				++this->loop_stats.accepted;
+
+				this->clients.emplace_back(
+					std::move(*connection),
+					this->config.send_queue_limit,
+					this->next_id++
+				);
+
+				this->clients.back().set_handle(this->sessions.open(this->clients.size() - 1));
+				this->clients.back().set_limits(this->message_limit, this->byte_limit);
+				this->clients.back().touch(now);
+
+				if (this->timed())
+					this->timers.arm(
+						sessions::slot(this->clients.back().handle()),
+						this->deadline(this->clients.back())
+					);
+
+				if (this->capture)
+					this->capture->write(capture::type::connected, this->clients.back().id());
+
+				this->poll_sockets.emplace_back(
+					pollfd {
+						.fd = this->clients.back().descriptor(),
+						.events = POLLIN | POLLRDHUP
+					}
+				);
+
+				tp3::util::log::write<events::accepted>(
+					this->clients.back().descriptor(),
+					this->clients.back().address()
 				);
 			}
+		}
+
+
+		// Account for a packet sent to a client, watching the client's socket for
+		// writability if the packet could not be sent at once.
+		void sent(clients_iter client, bool accepted, std::size_t size) {
+			if (accepted) {
+				this->loop_stats.bytes_out += size;
 
-			return usernames;
+				if (this->tracer.tracing())
+					this->tracer.sent(client->descriptor(), client->pending(), client->queued());
+			}
+			else
+				++this->loop_stats.drops;
+
+			if (client->pending())
+				this->poll_sockets[client - this->clients.begin() + clients_offset].events |= POLLOUT;
 		}
 
+		// Send a packet to a client.
+		void send(clients_iter client, const uint8_t packet[], std::size_t size) {
+			this->sent(client, client->send(packet, size), size);
+		}
 
-		int poll() noexcept {
-			return ::poll(
-				this->poll_sockets.data(),
-				this->poll_sockets.size(),
-				-1 // infinite timeout
+		// Send a shared packet to a client, queueing a reference to it if needed.
+		void send(clients_iter client, const std::shared_ptr<const std::vector<uint8_t>>& packet) {
+			this->sent(client, client->send(packet), packet->size());
+		}
+
+		void send(clients_iter client, tp3::client::message::error_token error) {
+			uint8_t packet[tp3::client::message::error_size];
+
+			this->send(
+				client,
+				packet,
+				tp3::client::message::encode_error(packet, error) - packet
 			);
 		}
 
+		// Send the packet to a recipient of a sender's message, unless the recipient ignores
+		// the sender. Returns whether the packet was sent.
+		bool deliver(clients_iter recipient, clients_iter sender) {
+			if (sender->ignored() && recipient->ignores(sender->handle()))
+				return false;
+
+			this->send(recipient, this->packet.data(), this->packet.size());
+			return true;
+		}
 
-		// Accept new connection.
-		void accept() {
-			std::cout << "incoming client, ";
+		// Send a client its session handle.
+		void send_session(clients_iter client) {
+			uint8_t packet[tp3::client::message::session_max_size];
 
-			this->clients.emplace_back(
-				tp3::socket::connection(this->socket)
+			this->send(
+				client,
+				packet,
+				tp3::client::message::encode_session(packet, client->handle()) - packet
 			);
+		}
 
-			this->poll_sockets.emplace_back(
-				pollfd {
-					.fd = this->clients.back().descriptor(),
-					.events = POLLIN
+		// Add a target to the error frame listing the unknown targets of a multicast.
+		void unknown_target(array_view<uint8_t> name) {
+			const bool first = this->unknown_targets.empty();
+			const std::size_t size = this->unknown_targets.size();
+
+			this->unknown_targets.resize(
+				size + (first ? tp3::client::message::error_size - 1 : 1) + name.size()
+			);
+
+			uint8_t* packet_it = this->unknown_targets.data() + size;
+
+			if (first)
+				packet_it = tp3::client::message::encode_targets_error_start(packet_it);
+
+			tp3::client::message::encode_targets_error_target(packet_it, name, first);
+		}
+
+		// Encode a text frame into packet.
+		void encode_text(array_view<uint8_t> sender, array_view<uint8_t> body) {
+			this->packet.resize(tp3::client::message::text_size(sender, body));
+			tp3::client::message::encode_text(this->packet.data(), sender, body);
+		}
+
+
+		// Encode a joined or left frame into packet.
+		void encode_presence(tp3::client::message::token kind, array_view<uint8_t> name) {
+			this->packet.resize(tp3::client::message::presence_size(name));
+			tp3::client::message::encode_presence(this->packet.data(), kind, name);
+		}
+
+		// Encode a renamed frame into packet.
+		void encode_renamed(array_view<uint8_t> from, array_view<uint8_t> to) {
+			this->packet.resize(tp3::client::message::renamed_size(from, to));
+			tp3::client::message::encode_renamed(this->packet.data(), from, to);
+		}
+
+		// Encode a page of the names starting with prefix into packet. The page is bounded by
+		// the limit, if any, and by the page frame size, but always lists a name if any is left.
+		void encode_page(std::size_t offset, std::size_t limit, array_view<uint8_t> prefix) {
+			const auto found = this->index.find(prefix);
+
+			const auto begin = found.begin + std::min(offset, found.size());
+			const auto last = begin + std::min<std::size_t>(
+				limit == 0 ? found.size() : limit,
+				found.end - begin
+			);
+
+			auto end = begin;
+			std::size_t size = tp3::client::message::users_page_size(found.size(), begin, end);
+
+			for (; end != last; ++end) {
+				const std::size_t entry = tp3::client::message::users_page_entry_size(*end);
+
+				if (end != begin && size + entry > this->config.page_bytes)
+					break;
+
+				size += entry;
+			}
+
+			this->packet.resize(size);
+			tp3::client::message::encode_users_page(this->packet.data(), found.size(), begin, end);
+		}
+
+
+		// Send the frame in packet to the presence subscribers.
+		void publish_presence() {
+			for (auto subscriber : this->subscribers)
+				this->send(this->clients.begin() + subscriber, this->packet.data(), this->packet.size());
+		}
+
+
+		// Subscribe a client to presence deltas, sending the users list they apply to.
+		// Subscribing again just sends the list, for the client to resynchronise.
+		void subscribe(clients_iter client) {
+			if (!client->subscription()) {
+				client->set_subscription(this->subscribers.size());
+				this->subscribers.push_back(client - this->clients.begin());
+			}
+
+			this->send(
+				client,
+				this->users.frame(this->clients.size() - this->catalogue.size())
+			);
+		}
+
+		void unsubscribe(clients_iter client) {
+			if (auto position = client->subscription()) {
+				// the last subscriber takes the position, see swap_pop.
+				this->clients[this->subscribers.back()].set_subscription(*position);
+				client->set_subscription({});
+
+				tp3::util::algorithm::swap_pop(
+					this->subscribers,
+					this->subscribers.begin() + *position
+				);
+			}
+		}
+
+
+		// Add a client to a room, creating the room if needed.
+		void join_room(clients_iter client, array_view<uint8_t> name) {
+			const std::size_t room = this->rooms.open(name);
+
+			if (!client->room_position(room))
+				client->set_room_position(room, this->rooms.add(room, client->handle()));
+		}
+
+		void leave_room(clients_iter client, std::size_t room) {
+			const auto position = client->room_position(room);
+
+			if (!position)
+				return;
+
+			client->leave_room(room);
+
+			// the last member takes the position, see swap_pop.
+			if (auto moved = this->rooms.remove(room, *position))
+				this->clients[*this->sessions.find(*moved)].set_room_position(room, *position);
+		}
+
+		// Encode a room text frame into packet.
+		void encode_room_text(array_view<uint8_t> room, array_view<uint8_t> sender, array_view<uint8_t> body) {
+			this->packet.resize(tp3::client::message::room_text_size(room, sender, body));
+			tp3::client::message::encode_room_text(this->packet.data(), room, sender, body);
+		}
+
+
+		// Remove a client's name from the catalogue and the users list, keeping the node for
+		// reuse, and tell the subscribers.
+		void forget_name(clients_iter client) {
+			if (auto name = client->name()) {
+				this->encode_presence(tp3::client::message::token::left, *name);
+
+				this->index.erase(*name);
+
+				auto node = this->catalogue.extract(*name);
+				this->users.remove(node.mapped().entry);
+				this->spare_nodes.push_back(std::move(node));
+
+				this->publish_presence();
+			}
+		}
+
+
+		// Whether the clients' idleness is checked.
+		bool timed() const noexcept {
+			return this->config.idle_timeout.count() > 0 || this->config.heartbeat.count() > 0;
+		}
+
+		// When a client's idleness must be checked next: when it times out, or is due a ping.
+		token_bucket::time deadline(const client_type& client) const noexcept {
+			auto deadline = token_bucket::time::max();
+
+			if (this->config.idle_timeout.count() > 0)
+				deadline = client.active() + this->config.idle_timeout;
+
+			if (this->config.heartbeat.count() > 0)
+				deadline = std::min<token_bucket::time>(
+					deadline,
+					client.active() + this->config.heartbeat * (client.pinged() ? 2 : 1)
+				);
+
+			return deadline;
+		}
+
+		// Check the idleness of the clients whose timers expired: disconnect those idle for
+		// the idle timeout, or that didn't answer a ping within the heartbeat, and ping those
+		// idle for the heartbeat. A timer is not rearmed as its client sends, only when it
+		// expires, for the client's next deadline, so that the timers cost nothing per
+		// message.
+		void expire(token_bucket::time now) {
+			this->timers.advance(
+				now,
+				[&](timer_wheel::id slot) {
+					const auto client = this->clients.begin() + this->sessions.client(slot);
+					const auto& socket = this->poll_sockets[client - this->clients.begin() + clients_offset];
+
+					// a client with data waiting, to be read in this iteration or held, is active.
+					if ((socket.revents & POLLIN) || !(socket.events & POLLIN))
+						client->touch(now);
+
+					const auto idle = now - client->active();
+
+					const bool timed_out = (this->config.idle_timeout.count() > 0 && idle >= this->config.idle_timeout)
+					                    || (client->pinged() && idle >= 2 * this->config.heartbeat);
+
+					if (timed_out) {
+						tp3::util::log::write<events::timed_out>(client->descriptor());
+						++this->loop_stats.timed_out;
+						client->time_out();
+						return;
+					}
+
+					if (this->config.heartbeat.count() > 0 && !client->pinged() && idle >= this->config.heartbeat) {
+						uint8_t packet[tp3::client::message::ping_size];
+
+						tp3::util::log::write<events::pinged>(client->descriptor());
+						++this->loop_stats.pings;
+
+						this->send(client, packet, tp3::client::message::encode_ping(packet) - packet);
+						client->set_pinged();
+					}
+
+					this->timers.arm(slot, this->deadline(*client));
 				}
 			);
+		}
+
+
+		// Rate the load after an iteration that started at a time, see
+		// tp3::server::admission. The server socket is only polled while accepting.
+		void rate_load(token_bucket::time start, uint64_t queued) {
+			const auto now = this->now();
+			const auto iteration = now - start;
+
+			this->loop_stats.iteration_time.record(iteration.count());
+
+			if (!this->admission.update(now, iteration, queued))
+				return;
+
+			const uint64_t iteration_us = std::chrono::duration_cast<std::chrono::microseconds>(this->admission.iteration()).count();
+
+			switch (this->admission.level()) {
+				case admission::level::normal:
+					tp3::util::log::write<events::load_normal>(iteration_us, queued);
+					++this->loop_stats.load_normal;
+					break;
 
-			std::cout << "accepted." << std::endl;
+				case admission::level::loaded:
+					tp3::util::log::write<events::loaded>(iteration_us, queued);
+					++this->loop_stats.loaded;
+					break;
+
+				case admission::level::overloaded:
+					tp3::util::log::write<events::overloaded>(iteration_us, queued);
+					++this->loop_stats.overloaded;
+					break;
+			}
+
+			this->poll_sockets[0].events = this->admission.accepting() ? POLLIN : 0;
+		}
+
+
+		// Hold a client's input until a time: its socket is not polled for reading, so that
+		// what it sends waits in the kernel's buffers, pushing back on it. A client is held
+		// while its socket's events lack POLLIN.
+		void hold(clients_iter client, token_bucket::time until) {
+			client->set_resume(until);
+			this->poll_sockets[client - this->clients.begin() + clients_offset].events &= ~(POLLIN | POLLRDHUP);
 		}
 
+		void release(clients_iter client) {
+			this->poll_sockets[client - this->clients.begin() + clients_offset].events |= POLLIN | POLLRDHUP;
+		}
+
+		// Stop reading from a client that shut down its side, once its input is handled. It
+		// is not held, but only polled to send what is left, see client::finish.
+		void finish(clients_iter client) {
+			client->finish();
+			this->poll_sockets[client - this->clients.begin() + clients_offset].events &= ~(POLLIN | POLLRDHUP);
+		}
+
+
+		// Process the incoming messages from the given client, within its budget and rate
+		// limits, holding its input if it has more to send than they allow.
+		void process_client(clients_iter client, token_bucket::time now) {
+			const auto received = client->receive(now);
+			this->loop_stats.bytes_in += received;
+
+			if (this->tracer.enabled())
+				client->timestamp(received, tp3::util::tsc::now());
+
+			// Captured as read, before framing, so that replay reproduces the fragmentation.
+			if (this->capture && received > 0)
+				this->capture->write(capture::type::data, client->id(), client->received(), received);
+
+			const std::size_t budget = std::min<uint64_t>(
+				this->config.message_budget,
+				client->message_allowance(now)
+			);
+
+			std::size_t handled = 0;
+
+			for (; handled < budget; ++handled) {
+				auto message = client->next();
+
+				if (!message)
+					break;
+
+				++this->loop_stats.messages;
+				++this->loop_stats.messages_by_type[message->index()];
+				this->loop_stats.message_size.record(client->frame_size());
+
+				if (this->tracer.enabled())
+					this->tracer.decoded(message->index(), client->read_time());
+
+				tp3::util::log::write<events::message>(client->descriptor(), message->index());
 
-		// Process one message from the given client.
-		void process_client(clients_iter client) {
-			if (auto message = client->read())
 				std::visit(
 					tp3::util::overload {
-						[&](const message::name& msg) {
-							if (auto& name = client->name)
-								this->catalogue.erase(*name);
-
+						[&](const message::basic_name<array_view<uint8_t>>& msg) {
 							if (msg.text.size() == 0) {
-								std::cout << "set name to anonymous, ";
-								client->name.reset();
+								tp3::util::log::write<events::name_anonymous>(client->descriptor());
+								this->forget_name(client);
+								client->clear_name();
+								return;
 							}
-							else {
-								std::cout << "set name to '" << msg.text << "', ";
 
-								if (this->catalogue.find(msg.text) != this->catalogue.end()) {
-									std::cout << "there is already a client with that name, denying."
-									          << std::endl;
-
-									client->send(
-										tp3::client::message::error(
-											tp3::client::message::error_token::invalid_name
-										)
-									);
+							const std::size_t index = client - this->clients.begin();
+							const auto taken = this->catalogue.find(msg.text);
 
+							if (taken != this->catalogue.end()) {
+								if (taken->second.client == index) { // already named so.
+									tp3::util::log::write<events::name_set>(client->descriptor(), msg.text);
+									this->send_session(client);
 									return;
 								}
 
-								client->name = std::move(msg.text);
+								tp3::util::log::write<events::name_taken>(client->descriptor(), msg.text);
+								this->send(client, tp3::client::message::error_token::invalid_name);
+								return;
+							}
+
+							// Reuse the client's own node, or a spare one, so that naming doesn't
+							// allocate in the steady state. The node is out of the catalogue while
+							// the name changes, as its key refers to the name's storage.
+							typename decltype(this->catalogue)::node_type node;
+							std::size_t entry;
+
+							if (auto name = client->name()) {
+								this->encode_renamed(*name, msg.text);
+								this->index.erase(*name);
+
+								node = this->catalogue.extract(*name);
+								entry = this->users.rename(node.mapped().entry, msg.text);
+							}
+							else {
+								this->encode_presence(tp3::client::message::token::joined, msg.text);
+
+								entry = this->users.add(msg.text);
+
+								if (!this->spare_nodes.empty()) {
+									node = std::move(this->spare_nodes.back());
+									this->spare_nodes.pop_back();
+								}
+							}
+
+							client->set_name(msg.text);
+							this->index.insert(*client->name(), client->handle());
 
-								this->catalogue[*client->name] = client - this->clients.begin();
+							if (node) {
+								node.key() = *client->name();
+								node.mapped() = listing { index, entry };
+								this->catalogue.insert(std::move(node));
 							}
+							else
+								this->catalogue.emplace(*client->name(), listing { index, entry });
+
+							tp3::util::log::write<events::name_set>(client->descriptor(), *client->name());
 
-							std::cout << "done." << std::endl;
+							this->send_session(client);
+							this->publish_presence();
 						},
 
-						[&](const message::list_users&) {
-							client->send(
-								tp3::client::message::users_list(
-									this->list_users()
-								)
-							);
+						[&](const message::basic_list_users<array_view<uint8_t>>& msg) {
+							this->tracer.routed();
+
+							if (!msg.query) {
+								this->send(
+									client,
+									this->users.frame(this->clients.size() - this->catalogue.size())
+								);
+								return;
+							}
+
+							this->encode_page(msg.query->offset, msg.query->limit, msg.query->prefix);
+							this->send(client, this->packet.data(), this->packet.size());
 						},
 
-						[&](message::broadcast& msg) {
-							auto packet = tp3::client::message::encode(
-								tp3::client::message::text(
-									boxed_array<uint8_t>(
-										client->name ? *client->name
-										             : tp3::server::client<buffer_size>::anon_name
-									),
-									std::move(msg.text)
-								)
-							);
+						[&](const message::subscribe&) {
+							this->tracer.routed();
 
-							// avoid sending message to sender:
+							tp3::util::log::write<events::subscribed>(client->descriptor());
+							this->subscribe(client);
+						},
+
+						[&](const message::unsubscribe&) {
+							this->tracer.routed();
+
+							tp3::util::log::write<events::unsubscribed>(client->descriptor());
+							this->unsubscribe(client);
+						},
+
+						[&](const message::basic_broadcast<array_view<uint8_t>>& msg) {
+							if (this->admission.shedding()) {
+								this->tracer.routed();
+
+								++this->loop_stats.shed;
+								this->send(client, tp3::client::message::error_token::server_busy);
+								return;
+							}
+
+							this->encode_text(client->sender(), msg.text);
+
+							this->tracer.routed();
+
+							// avoid sending message to sender, and filtering the recipients if
+							// no one ignores the sender:
+
+							if (client->ignored()) {
+								std::size_t recipients = 0;
+
+								for (auto other = this->clients.begin(); other != client; ++other)
+									recipients += this->deliver(other, client);
+
+								for (auto other = client + 1; other != this->clients.end(); ++other)
+									recipients += this->deliver(other, client);
+
+								this->loop_stats.fan_out.record(recipients);
+								return;
+							}
 
 							for (auto other = this->clients.begin(); other != client; ++other)
-								other->send(packet);
+								this->send(other, this->packet.data(), this->packet.size());
 
 							for (auto other = client + 1; other != this->clients.end(); ++other)
-								other->send(packet);
+								this->send(other, this->packet.data(), this->packet.size());
+
+							this->loop_stats.fan_out.record(this->clients.size() - 1);
 						},
 
-						[&](message::unicast& msg) {
+						[&](const message::basic_unicast<array_view<uint8_t>>& msg) {
 							const auto target = this->catalogue.find(msg.target);
 
+							this->tracer.routed();
+
 							if (target == this->catalogue.end()) {
-								client->send(
-									tp3::client::message::error(
-										tp3::client::message::error_token::invalid_target
-									)
+								this->send(client, tp3::client::message::error_token::invalid_target);
+								return;
+							}
+
+							this->encode_text(client->sender(), msg.text);
+
+							this->loop_stats.fan_out.record(
+								this->deliver(this->clients.begin() + target->second.client, client)
+							);
+						},
+
+						[&](const message::basic_multicast<array_view<uint8_t>>& msg) {
+							this->tracer.routed();
+
+							this->encode_text(client->sender(), msg.text);
+
+							const uint64_t multicast = ++this->multicasts;
+							std::size_t recipients = 0;
+
+							this->unknown_targets.clear();
+
+							msg.for_each_target(
+								[&](array_view<uint8_t> name) {
+									const auto target = this->catalogue.find(name);
+
+									if (target == this->catalogue.end()) {
+										this->unknown_target(name);
+										return;
+									}
+
+									const auto recipient = this->clients.begin() + target->second.client;
+
+									if (!recipient->deliver_once(multicast))
+										return;
+
+									recipients += this->deliver(recipient, client);
+								}
+							);
+
+							this->loop_stats.fan_out.record(recipients);
+
+							if (!this->unknown_targets.empty()) {
+								this->unknown_targets.push_back(
+									tp3::util::token_value(tp3::client::message::token::end)
 								);
 
+								this->send(client, this->unknown_targets.data(), this->unknown_targets.size());
+							}
+						},
+
+						[&](const message::basic_join<array_view<uint8_t>>& msg) {
+							this->tracer.routed();
+
+							if (msg.room.size() == 0) {
+								this->send(client, tp3::client::message::error_token::invalid_name);
+								return;
+							}
+
+							tp3::util::log::write<events::room_joined>(client->descriptor(), msg.room);
+							this->join_room(client, msg.room);
+						},
+
+						[&](const message::basic_leave<array_view<uint8_t>>& msg) {
+							this->tracer.routed();
+
+							if (auto room = this->rooms.find(msg.room)) {
+								tp3::util::log::write<events::room_left>(client->descriptor(), msg.room);
+								this->leave_room(client, *room);
+							}
+						},
+
+						[&](const message::basic_publish<array_view<uint8_t>>& msg) {
+							const auto room = this->rooms.find(msg.room);
+
+							this->tracer.routed();
+
+							if (!room) {
+								this->send(client, tp3::client::message::error_token::invalid_target);
+								return;
+							}
+
+							this->encode_room_text(msg.room, client->sender(), msg.text);
+
+							const auto& members = this->rooms.members(*room);
+							std::size_t recipients = 0;
+
+							// avoid sending message to sender:
+
+							for (auto member : members) {
+								const auto recipient = this->clients.begin() + *this->sessions.find(member);
+
+								if (recipient != client)
+									recipients += this->deliver(recipient, client);
+							}
+
+							this->loop_stats.fan_out.record(recipients);
+						},
+
+						[&](const message::basic_unicast_handle<array_view<uint8_t>>& msg) {
+							const auto target = this->sessions.find(msg.target);
+
+							this->tracer.routed();
+
+							if (!target) {
+								this->send(client, tp3::client::message::error_token::invalid_target);
 								return;
 							}
 
-							const auto& target_client = this->clients[target->second];
+							this->encode_text(client->sender(), msg.text);
 
-							target_client.send(
-								tp3::client::message::text(
-									boxed_array<uint8_t>(
-										client->name ? *client->name
-										             : tp3::server::client<buffer_size>::anon_name
-									),
-									std::move(msg.text)
-								)
+							this->loop_stats.fan_out.record(
+								this->deliver(this->clients.begin() + *target, client)
 							);
+						},
+
+						[&](const message::basic_block<array_view<uint8_t>>& msg) {
+							const auto target = this->catalogue.find(msg.target);
+
+							this->tracer.routed();
+
+							if (target == this->catalogue.end()) {
+								this->send(client, tp3::client::message::error_token::invalid_target);
+								return;
+							}
+
+							tp3::util::log::write<events::blocked>(client->descriptor(), msg.target);
+
+							auto& blocked = this->clients[target->second.client];
+
+							if (client->block(blocked.handle()))
+								blocked.add_blocker(client->handle());
+						},
+
+						[&](const message::pong&) {
+							// receiving it counted the client as active.
+							this->tracer.routed();
+						},
+
+						[&](const message::basic_unblock<array_view<uint8_t>>& msg) {
+							const auto target = this->catalogue.find(msg.target);
+
+							this->tracer.routed();
+
+							if (target == this->catalogue.end()) {
+								this->send(client, tp3::client::message::error_token::invalid_target);
+								return;
+							}
+
+							tp3::util::log::write<events::unblocked>(client->descriptor(), msg.target);
+
+							auto& blocked = this->clients[target->second.client];
+
+							if (client->unblock(blocked.handle()))
+								blocked.remove_blocker(client->handle());
 						}
 					},
 					*message
 				);
+
+				this->tracer.handled();
+			}
+
+			client->handled(now, handled);
+
+			if (client->message_allowance(now) == 0 || client->byte_allowance(now) == 0) {
+				++this->loop_stats.throttled;
+				this->hold(client, client->allowed(now));
+			}
+			else if (handled == this->config.message_budget && client->buffered()) {
+				// the rest waits for the next iteration, after the other clients.
+				++this->loop_stats.deferred;
+				this->hold(client, now);
+			}
+			else if (client->shut_down())
+				this->finish(client);
 		}
 
 
-		// Run the server's event loop.
-		// This function does not return (infinite loop), but it may throw exceptions.
-		void process() {
-			while (true) {
-				if (this->poll() < 0)
-					throw std::system_error(errno, std::generic_category());
+		// Answer a metrics request from the admin socket. The request is a single datagram:
+		// "binary" for the compact binary snapshot, anything else for the text snapshot.
+		void process_admin() {
+			uint8_t request[64];
+
+			auto [result, sender] = this->admin->recv(request, sizeof(request));
+
+			if (!result || !sender)
+				return;
+
+			static constexpr char binary[] = "binary";
+
+			std::string reply;
+
+			if (result.size >= sizeof(binary) - 1 && std::equal(binary, binary + sizeof(binary) - 1, request))
+				write_binary(reply, this->stats());
+			else {
+				std::ostringstream stream;
+				write_text(stream, this->stats());
+				reply = stream.str();
+			}
+
+			this->admin->send(
+				reinterpret_cast<const uint8_t*>(reply.data()),
+				reply.size(),
+				*sender
+			);
+		}
 
-				// handle server socket:
-				auto socket = this->poll_sockets.begin();
 
-				if (socket->revents & POLLIN) { // new client incoming
-					this->accept();
-					// accept inserts in poll_sockets, invalidating all iterators:
-					socket = this->poll_sockets.begin();
+		// Run one iteration of the event loop: poll the sockets and handle the ready ones.
+		// This function may throw exceptions.
+		void step() {
+			if (this->poll() < 0) {
+				if (errno == EINTR) // a signal was handled, maybe setting stop.
+					return;
+
+				throw std::system_error(errno, std::generic_category());
+			}
+
+			++this->loop_stats.iterations;
+
+			const auto now = this->now();
+			this->wake.reset();
+
+			// handle server socket:
+			auto socket = this->poll_sockets.begin();
+
+			if (socket->revents & POLLIN) { // new client incoming
+				this->accept(now);
+				// accept inserts in poll_sockets, invalidating all iterators:
+				socket = this->poll_sockets.begin();
+			}
+
+			// handle admin socket:
+			if (this->poll_sockets[1].revents & POLLIN)
+				this->process_admin();
+
+			// handle timers, disconnecting the timed out clients below:
+			this->expire(now);
+
+			// handle client connections:
+			socket += clients_offset;
+			auto end = this->poll_sockets.end();
+
+			uint64_t queued = 0; // bytes queued for the clients, for the admission controller.
+
+			while (socket != end) {
+				auto client = this->get_client(socket);
+
+				if (socket->revents & POLLOUT) { // client can take queued data
+					client->flush();
+					this->tracer.flushed(client->descriptor(), client->sent());
+
+					if (!client->pending())
+						socket->events &= ~POLLOUT;
 				}
 
-				// handle client connections:
-				++socket;
-				auto end = this->poll_sockets.end();
-
-				while (socket != end) {
-					if (socket->revents & POLLIN) { // incoming message
-						auto client = this->get_client(socket);
-
-						if (client->connected())
-							this->process_client(client);
-						else { // client disconnected, remove from collection:
-							if (auto& name = client->name)
-								this->catalogue.erase(*name);
-
-							tp3::util::algorithm::swap_pop(this->poll_sockets, socket);
-							tp3::util::algorithm::swap_pop(this->clients, client);
-
-							// make sure our iterators are not invalid:
-							if (this->clients.empty())
-								// if the container is unitary, swap_pop will clear it, invalidating all
-								// iterators. Therefore, we must break from the loop because socket is no
-								// longer valid.
-								break;
-
-							if (socket + 1 == end)
-								// socket was the last element, invalidated by pop_back.
-								break;
-
-							// iterator was invalidated by removing from the vector:
-							end = this->poll_sockets.end();
-
-							// the last client was swapped, therefore we must update its index in the
-							// catalogue. Note that this should not be done if socket is the last
-							// element, as swap_pop won't swap in such case.
-							if (auto& name = client->name)
-								this->catalogue[*name] = client - this->clients.begin();
-						}
+				// Disconnections are detected by the read itself: POLLRDHUP, POLLHUP and POLLERR
+				// also require a read to get the remaining data or the error.
+				bool readable = socket->revents & (POLLIN | POLLRDHUP | POLLHUP | POLLERR);
+
+				// a failed connection can't send any more, and poll reports it regardless of the
+				// events, so its limits are lifted to drain what is left, within the budget.
+				if (socket->revents & (POLLHUP | POLLERR))
+					client->set_limits({}, {});
+
+				// a held client, not polled for reading, is resumed when its time comes.
+				if (!(socket->events & POLLIN) && !client->finished()) {
+					if (client->resume() <= now || (socket->revents & (POLLHUP | POLLERR))) {
+						this->release(client);
+						readable = true;
 					}
+				}
+
+				if (readable)
+					this->process_client(client, now);
+
+				if (!(socket->events & POLLIN) && !client->finished())
+					this->wake = std::min(this->wake.value_or(client->resume()), client->resume());
+
+				// only the clients polled for writability have data queued.
+				if (socket->events & POLLOUT)
+					queued += client->backlog();
 
-					++socket;
+				if (!client->connected()) { // client disconnected, remove from collection:
+					tp3::util::log::write<events::disconnected>(client->descriptor());
+					++this->loop_stats.disconnected;
+					this->tracer.disconnected(client->descriptor());
+
+					if (this->capture)
+						this->capture->write(capture::type::disconnected, client->id());
+
+					this->unsubscribe(client);
+					this->forget_name(client);
+
+					while (auto room = client->any_room())
+						this->leave_room(client, *room);
+
+					// leave the block lists on both sides, so that none holds a closed session.
+					for (auto session : client->blocks())
+						this->clients[*this->sessions.find(session)].remove_blocker(client->handle());
+
+					for (auto session : client->blocked_by())
+						this->clients[*this->sessions.find(session)].unblock(client->handle());
+
+					this->timers.cancel(sessions::slot(client->handle()));
+					this->sessions.close(client->handle());
+
+					tp3::util::algorithm::swap_pop(this->poll_sockets, socket);
+					tp3::util::algorithm::swap_pop(this->clients, client);
+
+					// make sure our iterators are not invalid:
+					if (this->clients.empty())
+						// if the container is unitary, swap_pop will clear it, invalidating all
+						// iterators. Therefore, we must break from the loop because socket is no
+						// longer valid.
+						break;
+
+					if (socket + 1 == end)
+						// socket was the last element, invalidated by pop_back.
+						break;
+
+					// iterator was invalidated by removing from the vector:
+					end = this->poll_sockets.end();
+
+					// the last client was swapped, therefore we must update its index in the
+					// catalogue, the subscribers and the sessions. Note that this should not be
+					// done if socket is the last element, as swap_pop won't swap in such case.
+					if (auto name = client->name())
+						this->catalogue.find(*name)->second.client = client - this->clients.begin();
+
+					if (auto position = client->subscription())
+						this->subscribers[*position] = client - this->clients.begin();
+
+					this->sessions.move(client->handle(), client - this->clients.begin());
+
+					// the swapped client is only visited in the next iteration, at once if it
+					// timed out too, as no event may come for it.
+					if (!client->connected())
+						this->wake = now;
+					else if (!(socket->events & POLLIN) && !client->finished())
+						this->wake = std::min(this->wake.value_or(client->resume()), client->resume());
 				}
+
+				++socket;
 			}
+
+			if (this->admission.enabled())
+				this->rate_load(now, queued);
+
+			if (this->capture)
+				this->capture->flush();
+		}
+
+
+		// Run the server's event loop until stop is set, usually by a signal handler.
+		// This function may throw exceptions.
+		void process(const volatile std::sig_atomic_t& stop) {
+			while (!stop)
+				this->step();
 		}
 	};
 }
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+
+namespace tp3::server {
+	// Session handles: compact numbers naming the connected clients, resolved by indexing a
+	// table instead of hashing a name. A handle holds the session's slot in the table, in the
+	// high bits, and the slot's generation, in the low bits, so that the handle of a closed
+	// session doesn't reach the next session in the same slot. The generation goes in the low
+	// bits to keep the handles of small tables short. Free slots are reused oldest first, so
+	// that a slot's generation only wraps around after many sessions.
+	class sessions {
+	public:
+		using handle = uint32_t;
+
+		static constexpr unsigned generation_bits = 8; // Up to 16M sessions.
+
+	protected:
+		static constexpr std::size_t npos = -1;
+
+		struct slot {
+			std::size_t client = npos; // The client's index, npos when free.
+			uint8_t generation = 0;
+		};
+
+		std::vector<slot> slots;
+		std::deque<handle> free_slots;
+
+
+		static handle make_handle(handle slot, uint8_t generation) noexcept {
+			return slot << generation_bits | generation;
+		}
+
+
+	public:
+		// The slot of a session, unique among the open sessions.
+		static handle slot(handle session) noexcept {
+			return session >> generation_bits;
+		}
+
+
+		// Open a session for the client at the given index, returning its handle.
+		handle open(std::size_t client) {
+			handle slot;
+
+			if (this->free_slots.empty()) {
+				slot = this->slots.size();
+				this->slots.emplace_back();
+			}
+			else {
+				slot = this->free_slots.front();
+				this->free_slots.pop_front();
+			}
+
+			this->slots[slot].client = client;
+
+			return make_handle(slot, this->slots[slot].generation);
+		}
+
+		void close(handle session) {
+			auto& slot = this->slots[sessions::slot(session)];
+
+			slot.client = npos;
+			++slot.generation;
+
+			this->free_slots.push_back(sessions::slot(session));
+		}
+
+		// Update the index of a session's client, after the client moved in the table.
+		void move(handle session, std::size_t client) noexcept {
+			this->slots[sessions::slot(session)].client = client;
+		}
+
+
+		// The index of the client in a slot, which must hold an open session.
+		std::size_t client(handle slot) const noexcept {
+			return this->slots[slot].client;
+		}
+
+		// The index of the session's client, if the session is open.
+		std::optional<std::size_t> find(handle session) const noexcept {
+			const handle index = sessions::slot(session);
+
+			if (index >= this->slots.size())
+				return {};
+
+			const auto& slot = this->slots[index];
+
+			if (slot.client == npos || make_handle(index, slot.generation) != session)
+				return {};
+
+			return slot.client;
+		}
+	};
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <variant>
+
+#include <server/message.hpp>
+#include <socket/counters.hpp>
+#include <util/histogram.hpp>
+
+
+namespace tp3::server {
+	// Event loop statistics and metrics. Counters are owned by the event loop thread, so
+	// updating them costs a plain increment.
+	struct stats {
+		static constexpr std::size_t message_types = std::variant_size_v<message::variant>;
+
+		// The names of the message types, in the order of message::variant.
+		static constexpr const char* message_names[] = {
+			"name",
+			"list_users",
+			"broadcast",
+			"unicast",
+			"subscribe",
+			"unsubscribe",
+			"unicast_handle",
+			"multicast",
+			"join",
+			"leave",
+			"publish",
+			"block",
+			"unblock",
+			"pong"
+		};
+
+		static_assert(std::size(message_names) == message_types);
+
+		// The traced latency stages, see tp3::server::tracer.
+		static constexpr const char* latency_names[] = {
+			"decode",
+			"route",
+			"enqueue",
+			"flush",
+			"total"
+		};
+
+		static constexpr std::size_t latency_stages = std::size(latency_names);
+
+
+		uint64_t iterations = 0; // Event loop iterations.
+		uint64_t messages = 0; // Messages received from clients.
+		uint64_t messages_by_type[message_types] = { };
+
+		uint64_t connections = 0; // Currently connected clients.
+		uint64_t accepted = 0;
+		uint64_t disconnected = 0;
+
+		uint64_t bytes_in = 0; // Bytes received from clients.
+		uint64_t bytes_out = 0; // Bytes sent or queued to clients.
+		uint64_t drops = 0; // Packets dropped because a client's send queue was full.
+		uint64_t deferred = 0; // Clients left with messages for the next iteration, by the budget.
+		uint64_t throttled = 0; // Clients held by their rate limits.
+		uint64_t pings = 0; // Heartbeat probes sent to idle clients.
+		uint64_t timed_out = 0; // Clients disconnected for being idle, or not answering a ping.
+
+		// The admission controller's level, see tp3::server::admission, and the changes into
+		// each level.
+		uint64_t load_level = 0;
+		uint64_t load_normal = 0;
+		uint64_t loaded = 0;
+		uint64_t overloaded = 0;
+		uint64_t shed = 0; // Broadcasts shed while overloaded.
+
+		tp3::util::histogram<> message_size; // Received frame sizes, in bytes.
+		tp3::util::histogram<> fan_out; // Recipients per delivered message.
+		tp3::util::histogram<> iteration_time; // Event loop iteration time, in nanoseconds, if measured.
+
+		// Latency of the sampled messages per stage, in nanoseconds.
+		tp3::util::histogram<> latency[latency_stages];
+		uint64_t abandoned = 0; // Sampled messages a recipient disconnected with still queued.
+
+		tp3::socket::counters syscalls;
+	};
+
+
+	inline std::ostream& operator<<(std::ostream& stream, const stats& stats) {
+		const auto& syscalls = stats.syscalls;
+
+		stream << "iterations: " << stats.iterations
+		       << ", messages: " << stats.messages
+		       << ", syscalls: poll " << syscalls.poll
+		       << ", accept " << syscalls.accept
+		       << ", recv " << syscalls.recv
+		       << ", send " << syscalls.send;
+
+		if (stats.messages > 0)
+			stream << " (recv per message: "
+			       << double(syscalls.recv) / stats.messages
+			       << ")";
+
+		return stream;
+	}
+
+
+	// Write a histogram summary as text.
+	template<unsigned precision>
+	void write_text(std::ostream& stream, const std::string& name, const tp3::util::histogram<precision>& histogram) {
+		stream << name << ".count " << histogram.count() << '\n'
+		       << name << ".mean " << histogram.mean() << '\n'
+		       << name << ".p50 " << histogram.percentile(0.5) << '\n'
+		       << name << ".p90 " << histogram.percentile(0.9) << '\n'
+		       << name << ".p99 " << histogram.percentile(0.99) << '\n'
+		       << name << ".max " << histogram.max() << '\n';
+	}
+
+	// Write all metrics as text, one "name value" pair per line.
+	inline void write_text(std::ostream& stream, const stats& stats) {
+		stream << "iterations " << stats.iterations << '\n'
+		       << "messages " << stats.messages << '\n';
+
+		for (std::size_t i = 0; i < stats::message_types; ++i)
+			stream << "messages." << stats::message_names[i] << ' ' << stats.messages_by_type[i] << '\n';
+
+		stream << "connections " << stats.connections << '\n'
+		       << "accepted " << stats.accepted << '\n'
+		       << "disconnected " << stats.disconnected << '\n'
+		       << "bytes_in " << stats.bytes_in << '\n'
+		       << "bytes_out " << stats.bytes_out << '\n'
+		       << "drops " << stats.drops << '\n'
+		       << "deferred " << stats.deferred << '\n'
+		       << "throttled " << stats.throttled << '\n'
+		       << "pings " << stats.pings << '\n'
+		       << "timed_out " << stats.timed_out << '\n'
+		       << "load.level " << stats.load_level << '\n'
+		       << "load.normal " << stats.load_normal << '\n'
+		       << "load.loaded " << stats.loaded << '\n'
+		       << "load.overloaded " << stats.overloaded << '\n'
+		       << "shed " << stats.shed << '\n'
+		       << "syscalls.poll " << stats.syscalls.poll << '\n'
+		       << "syscalls.accept " << stats.syscalls.accept << '\n'
+		       << "syscalls.recv " << stats.syscalls.recv << '\n'
+		       << "syscalls.send " << stats.syscalls.send << '\n';
+
+		write_text(stream, "message_size", stats.message_size);
+		write_text(stream, "fan_out", stats.fan_out);
+		write_text(stream, "iteration_time", stats.iteration_time);
+
+		for (std::size_t i = 0; i < stats::latency_stages; ++i)
+			write_text(stream, std::string("latency.") + stats::latency_names[i], stats.latency[i]);
+
+		stream << "latency.abandoned " << stats.abandoned << '\n';
+	}
+
+
+	// Write all metrics in the compact binary format: the magic "TP3M", a version byte, and
+	// then the values as little endian uint64, in the same order as the text format. Each
+	// histogram is written as count, mean (rounded), p50, p90, p99 and max.
+	inline void write_binary(std::string& buffer, const stats& stats) {
+		auto write = [&](uint64_t value) {
+			for (int i = 0; i < 8; ++i)
+				buffer.push_back(char(value >> (8 * i)));
+		};
+
+		auto write_histogram = [&](const auto& histogram) {
+			write(histogram.count());
+			write(histogram.mean() + 0.5);
+			write(histogram.percentile(0.5));
+			write(histogram.percentile(0.9));
+			write(histogram.percentile(0.99));
+			write(histogram.max());
+		};
+
+		buffer.append("TP3M");
+		buffer.push_back(6); // version
+
+		write(stats.iterations);
+		write(stats.messages);
+
+		for (auto count : stats.messages_by_type)
+			write(count);
+
+		write(stats.connections);
+		write(stats.accepted);
+		write(stats.disconnected);
+		write(stats.bytes_in);
+		write(stats.bytes_out);
+		write(stats.drops);
+		write(stats.deferred);
+		write(stats.throttled);
+		write(stats.pings);
+		write(stats.timed_out);
+		write(stats.load_level);
+		write(stats.load_normal);
+		write(stats.loaded);
+		write(stats.overloaded);
+		write(stats.shed);
+		write(stats.syscalls.poll);
+		write(stats.syscalls.accept);
+		write(stats.syscalls.recv);
+		write(stats.syscalls.send);
+
+		write_histogram(stats.message_size);
+		write_histogram(stats.fan_out);
+		write_histogram(stats.iteration_time);
+
+		for (const auto& histogram : stats.latency)
+			write_histogram(histogram);
+
+		write(stats.abandoned);
+	}
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+
+namespace tp3::server {
+	// A hierarchical timer wheel, for a timer per connection, identified by a dense id.
+	// Arming and cancelling are O(1): a timer is linked into a slot of one of the levels,
+	// chosen by how far it is. Each level has 64 slots, the first one tick wide, and each
+	// level's slots eight times as wide as the previous level's. A timer is not cascaded
+	// down the levels as time passes, but expires with its slot, rounded up to the slot's
+	// width: about an eighth of its delay late at most. Past the last level, a timer expires early,
+	// at the end of the wheel, which suits timers that are checked when they expire, like
+	// idle timeouts, where arming again costs less than keeping a precise deadline.
+	class timer_wheel {
+	public:
+		using time = std::chrono::nanoseconds; // Since the epoch of the transport's clock.
+		using id = uint32_t;
+
+	protected:
+		static constexpr unsigned slot_bits = 6;
+		static constexpr unsigned level_shift = 3; // Each level's slots are 8 times wider.
+		static constexpr std::size_t levels = 8;
+		static constexpr std::size_t slots = 1 << slot_bits;
+
+		static constexpr id npos = -1;
+
+		struct timer {
+			id prev = npos;
+			id next = npos;
+			uint16_t bucket = 0; // level * slots + slot, if armed.
+			bool armed = false;
+		};
+
+		time tick; // The width of the first level's slots.
+
+		std::vector<timer> timers;
+		id buckets[levels * slots];
+		uint64_t occupied[levels] = { }; // A bit per non empty slot.
+
+		uint64_t now = 0; // The current tick. The slots until it have expired.
+		std::size_t _armed = 0;
+
+
+		static unsigned shift(std::size_t level) noexcept {
+			return level * level_shift;
+		}
+
+		void link(id timer, std::size_t level, std::size_t slot) noexcept {
+			const std::size_t bucket = level * slots + slot;
+			auto& entry = this->timers[timer];
+
+			entry.prev = npos;
+			entry.next = this->buckets[bucket];
+			entry.bucket = bucket;
+			entry.armed = true;
+
+			if (entry.next != npos)
+				this->timers[entry.next].prev = timer;
+
+			this->buckets[bucket] = timer;
+			this->occupied[level] |= uint64_t(1) << slot;
+			++this->_armed;
+		}
+
+		void unlink(id timer) noexcept {
+			auto& entry = this->timers[timer];
+
+			if (entry.prev != npos)
+				this->timers[entry.prev].next = entry.next;
+			else {
+				this->buckets[entry.bucket] = entry.next;
+
+				if (entry.next == npos)
+					this->occupied[entry.bucket / slots] &= ~(uint64_t(1) << (entry.bucket % slots));
+			}
+
+			if (entry.next != npos)
+				this->timers[entry.next].prev = entry.prev;
+
+			entry.armed = false;
+			--this->_armed;
+		}
+
+		// Move the timers of a slot to the front of the expired list, disarming them.
+		void expire(std::size_t level, std::size_t slot, id& expired) noexcept {
+			const std::size_t bucket = level * slots + slot;
+
+			id timer = this->buckets[bucket];
+			this->buckets[bucket] = npos;
+			this->occupied[level] &= ~(uint64_t(1) << slot);
+
+			while (timer != npos) {
+				auto& entry = this->timers[timer];
+				const id next = entry.next;
+
+				entry.next = expired;
+				entry.armed = false;
+				--this->_armed;
+
+				expired = timer;
+				timer = next;
+			}
+		}
+
+
+	public:
+		// A wheel of the given resolution, starting at a time.
+		timer_wheel(time tick, time start)
+			: tick(tick),
+			  now(start / tick)
+		{
+			std::fill(std::begin(this->buckets), std::end(this->buckets), npos);
+		}
+
+
+		bool empty() const noexcept {
+			return this->_armed == 0;
+		}
+
+		bool armed(id timer) const noexcept {
+			return timer < this->timers.size() && this->timers[timer].armed;
+		}
+
+
+		// Arm a timer to expire at a time, rearming it if armed.
+		void arm(id timer, time when) {
+			if (timer >= this->timers.size())
+				this->timers.resize(timer + 1);
+			else if (this->timers[timer].armed)
+				this->unlink(timer);
+
+			// expire no earlier than the next tick, rounding up.
+			const uint64_t expiry = std::max<uint64_t>((when + this->tick - time(1)) / this->tick, this->now + 1);
+
+			for (std::size_t level = 0; level < levels; ++level) {
+				// the timer's slot, rounded up, must be less than a turn away.
+				const uint64_t slot = (expiry + (uint64_t(1) << shift(level)) - 1) >> shift(level);
+				const uint64_t last = (this->now >> shift(level)) + slots - 1;
+
+				if (slot <= last || level == levels - 1) {
+					this->link(timer, level, std::min(slot, last) % slots);
+					return;
+				}
+			}
+		}
+
+		void cancel(id timer) noexcept {
+			if (this->armed(timer))
+				this->unlink(timer);
+		}
+
+
+		// Advance to a time, calling expired with the id of each expired timer. The timers
+		// are collected before the calls, so that a timer armed again by a call doesn't expire
+		// before its time in a slot still to pass. A call may arm or cancel its timer only.
+		template<typename Expired>
+		void advance(time to, Expired expired) {
+			const uint64_t target = to / this->tick;
+
+			if (target <= this->now)
+				return;
+
+			const uint64_t from = this->now;
+			this->now = target;
+
+			id list = npos;
+
+			for (std::size_t level = 0; level < levels && this->_armed > 0; ++level) {
+				// the slots passed at this level, at most a turn.
+				const uint64_t first = (from >> shift(level)) + 1;
+				const uint64_t last = target >> shift(level);
+
+				if (first > last)
+					break; // the higher levels' slots are wider still.
+
+				for (uint64_t slot = first; slot <= last && slot < first + slots; ++slot)
+					if (this->occupied[level] & (uint64_t(1) << (slot % slots)))
+						this->expire(level, slot % slots, list);
+			}
+
+			while (list != npos) {
+				const id timer = list;
+				list = this->timers[timer].next;
+				expired(timer);
+			}
+		}
+
+
+		// When the next slot with timers expires, if any timer is armed.
+		std::optional<time> next() const noexcept {
+			std::optional<uint64_t> next;
+
+			for (std::size_t level = 0; level < levels; ++level) {
+				if (this->occupied[level] == 0)
+					continue;
+
+				// the occupied slots from the one after now's on, rotating now's slot to bit 0.
+				const uint64_t current = this->now >> shift(level);
+				const unsigned offset = current % slots;
+				const uint64_t rotated = offset == 0
+					? this->occupied[level]
+					: this->occupied[level] >> offset | this->occupied[level] << (slots - offset);
+
+				// now's slot itself expired, its timers are a turn away.
+				const uint64_t ahead = rotated & ~uint64_t(1);
+				const unsigned distance = ahead ? __builtin_ctzll(ahead) : slots;
+
+				const uint64_t expiry = (current + distance) << shift(level);
+
+				if (!next || expiry < *next)
+					next = expiry;
+			}
+
+			if (!next)
+				return {};
+
+			return *next * this->tick;
+		}
+	};
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+
+namespace tp3::server {
+	// A token bucket rate limit, holding up to burst tokens, refilled at rate tokens per
+	// second. Instead of the tokens, the bucket keeps the time at which it would be full
+	// again (the generic cell rate algorithm), so refilling is implicit and exact. Times are
+	// the durations since the epoch of the transport's clock.
+	class token_bucket {
+	public:
+		using time = std::chrono::nanoseconds;
+
+		static constexpr uint64_t unlimited = std::numeric_limits<uint64_t>::max();
+
+	protected:
+		time interval { 0 }; // The time to refill a token, zero for unlimited.
+		time tolerance { 0 }; // The time to refill the whole bucket.
+		time full { 0 }; // When the bucket is full again.
+
+
+	public:
+		token_bucket() = default;
+
+		// A bucket of rate tokens per second, unlimited if zero, with the given burst, or a
+		// second's worth of tokens if zero.
+		token_bucket(uint64_t rate, uint64_t burst = 0)
+			: interval(rate == 0 ? 0 : std::max<time::rep>(time(std::chrono::seconds(1)).count() / rate, 1)),
+			  tolerance(this->interval * (burst == 0 ? rate : burst)) { }
+
+
+		// The tokens available at a time.
+		uint64_t available(time now) const noexcept {
+			if (this->interval.count() == 0)
+				return unlimited;
+
+			if (this->full <= now)
+				return this->tolerance / this->interval;
+
+			const auto refilled = this->tolerance - (this->full - now);
+
+			return refilled.count() <= 0 ? 0 : refilled / this->interval;
+		}
+
+		// Take tokens at a time. Taking more than available is allowed, leaving the bucket
+		// in debt until refilled.
+		void take(time now, uint64_t tokens) noexcept {
+			if (this->interval.count() == 0)
+				return;
+
+			this->full = std::max(this->full, now) + this->interval * time::rep(tokens);
+		}
+
+		// When half the bucket is available again, if not at the given time, so that a held
+		// client resumes with a batch of tokens instead of each token as it comes.
+		time ready(time now) const noexcept {
+			if (this->interval.count() == 0)
+				return now;
+
+			const time::rep batch = std::max<time::rep>(this->tolerance / this->interval / 2, 1);
+
+			return std::max(now, this->full - this->tolerance + this->interval * batch);
+		}
+	};
+}
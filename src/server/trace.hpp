@@ -0,0 +1,303 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <server/stats.hpp>
+#include <util/histogram.hpp>
+#include <util/tsc.hpp>
+
+
+namespace tp3::server {
+	// Sampled per-message latency tracing. One in sample_rate messages is traced, with
+	// timestamps taken when its bytes were read, when it was decoded, when its recipients
+	// were found, when the last send was issued, and when the last recipient's queued copy
+	// was flushed. The stage latencies are aggregated in histograms, and each trace is
+	// written to the trace file, if any. A message that a recipient disconnected with still
+	// queued was not delivered, so its trace is only counted as abandoned, as is one with
+	// more queued recipients than can be followed.
+	// A flush or a disconnection only looks at the recipient's own waiters, so tracing costs
+	// O(1) per released waiter.
+	// All methods must be called from the event loop thread.
+	class tracer {
+	public:
+		enum stage : std::size_t {
+			decode, // read to decode.
+			route, // decode to route.
+			enqueue, // route to the last send.
+			flush, // last send to the last recipient's flush.
+			total // read to the last recipient's flush.
+		};
+
+		static constexpr std::size_t stages = stats::latency_stages;
+
+		static_assert(total + 1 == stages);
+
+
+	protected:
+		struct trace {
+			std::size_t type; // The message type index.
+			uint64_t read, decode, route, enqueue;
+			std::size_t recipients = 0;
+			std::size_t waiting = 0; // Recipients with the message still queued.
+			bool abandoned = false; // Whether a queued copy won't be followed to its flush.
+		};
+
+		// A recipient with a traced message still in its write queue.
+		struct waiter {
+			std::size_t trace; // The trace's slot.
+			uint64_t position; // The write queue position after the message.
+		};
+
+		// Traces waiting for flushes are bounded, sampling pauses when full. So are the waiters,
+		// a trace with more queued recipients than fit being abandoned.
+		static constexpr std::size_t max_pending = 256;
+		static constexpr std::size_t max_waiters = 16384;
+
+
+		const std::size_t sample_rate; // 0 when disabled.
+		std::size_t countdown;
+
+		double ns_per_tick = 1;
+
+		bool active = false; // Whether the current message is traced.
+		std::size_t current; // The current message's trace slot, if active.
+
+		std::vector<trace> traces; // The slots of the traced messages.
+		std::vector<std::size_t> free_traces;
+
+		// The waiters of each recipient, by descriptor, in the order of their positions, as
+		// write queue positions only grow.
+		std::unordered_map<int, std::deque<waiter>> waiters;
+		std::size_t waiting = 0; // Waiters across all recipients.
+
+		std::array<tp3::util::histogram<>, stages> _latency;
+		uint64_t _abandoned = 0;
+
+		std::ofstream file;
+
+
+		uint64_t ns(uint64_t ticks) const noexcept {
+			return ticks * this->ns_per_tick;
+		}
+
+		void complete(const trace& trace, uint64_t flushed) {
+			const uint64_t latency[stages] = {
+				this->ns(trace.decode - trace.read),
+				this->ns(trace.route - trace.decode),
+				this->ns(trace.enqueue - trace.route),
+				this->ns(flushed - trace.enqueue),
+				this->ns(flushed - trace.read)
+			};
+
+			for (std::size_t i = 0; i < stages; ++i)
+				this->_latency[i].record(latency[i]);
+
+			if (!this->file.is_open())
+				return;
+
+			this->file << stats::message_names[trace.type] << '\t' << trace.recipients;
+
+			for (auto value : latency)
+				this->file << '\t' << value;
+
+			this->file << '\n';
+		}
+
+		// Free a trace's slot, completing it now unless abandoned.
+		void finish(std::size_t slot, uint64_t now) {
+			const auto& trace = this->traces[slot];
+
+			if (trace.abandoned)
+				++this->_abandoned;
+			else
+				this->complete(trace, now);
+
+			this->free_traces.push_back(slot);
+		}
+
+		// A recipient of a trace is done with it, which finishes once no recipient is left.
+		void release(const waiter& waiter, bool abandon, uint64_t now) {
+			auto& trace = this->traces[waiter.trace];
+
+			trace.abandoned |= abandon;
+			--this->waiting;
+
+			if (--trace.waiting == 0)
+				this->finish(waiter.trace, now);
+		}
+
+
+	public:
+		tracer(std::size_t sample_rate = 0, const std::string& path = "")
+			: sample_rate(sample_rate),
+			  countdown(sample_rate)
+		{
+			if (!this->enabled())
+				return;
+
+			this->ns_per_tick = tp3::util::tsc::ns_per_tick();
+
+			this->traces.resize(max_pending);
+
+			for (std::size_t slot = max_pending; slot > 0; --slot)
+				this->free_traces.push_back(slot - 1);
+
+			if (path.empty())
+				return;
+
+			this->file.open(path);
+
+			if (!this->file)
+				throw std::runtime_error("failed to open trace file: " + path);
+
+			this->file << "type\trecipients";
+
+			for (auto name : stats::latency_names)
+				this->file << '\t' << name << "_ns";
+
+			this->file << '\n';
+		}
+
+
+		bool enabled() const noexcept {
+			return this->sample_rate > 0;
+		}
+
+		// Whether the message being processed is traced.
+		bool tracing() const noexcept {
+			return this->active;
+		}
+
+		const std::array<tp3::util::histogram<>, stages>& latency() const noexcept {
+			return this->_latency;
+		}
+
+		// Traces of messages a recipient disconnected with still queued.
+		uint64_t abandoned() const noexcept {
+			return this->_abandoned;
+		}
+
+
+		// A message was decoded, from data read at the given tsc time. Decides whether to
+		// trace it.
+		void decoded(std::size_t type, uint64_t read) noexcept {
+			if (!this->enabled() || --this->countdown > 0)
+				return;
+
+			this->countdown = this->sample_rate;
+
+			if (this->free_traces.empty())
+				return;
+
+			this->active = true;
+			this->current = this->free_traces.back();
+			this->free_traces.pop_back();
+
+			this->traces[this->current] = trace {
+				.type = type,
+				.read = read,
+				.decode = tp3::util::tsc::now(),
+				.route = 0,
+				.enqueue = 0
+			};
+		}
+
+		// The recipients of the traced message were found.
+		void routed() noexcept {
+			if (this->active)
+				this->traces[this->current].route = tp3::util::tsc::now();
+		}
+
+		// The traced message was sent to a recipient. If queued, position is the recipient's
+		// write queue position after it.
+		void sent(int descriptor, bool queued, uint64_t position) {
+			if (!this->active)
+				return;
+
+			auto& trace = this->traces[this->current];
+
+			++trace.recipients;
+
+			if (!queued)
+				return;
+
+			if (this->waiting >= max_waiters) {
+				trace.abandoned = true;
+				return;
+			}
+
+			++trace.waiting;
+			++this->waiting;
+			this->waiters[descriptor].push_back(waiter { this->current, position });
+		}
+
+		// The traced message was handled. It completes now if no recipient has it queued.
+		void handled() {
+			if (!this->active)
+				return;
+
+			this->active = false;
+
+			auto& trace = this->traces[this->current];
+			const auto now = tp3::util::tsc::now();
+
+			// Messages handled without routing, e.g. name changes, are routed when handled.
+			if (trace.route == 0)
+				trace.route = now;
+
+			trace.enqueue = now;
+
+			if (trace.waiting == 0)
+				this->finish(this->current, now);
+		}
+
+
+		// A client flushed its write queue up to position.
+		void flushed(int descriptor, uint64_t position) {
+			if (this->waiting == 0)
+				return;
+
+			const auto recipient = this->waiters.find(descriptor);
+
+			if (recipient == this->waiters.end())
+				return;
+
+			auto& queue = recipient->second;
+			const auto now = tp3::util::tsc::now();
+
+			while (!queue.empty() && queue.front().position <= position) {
+				this->release(queue.front(), false, now);
+				queue.pop_front();
+			}
+
+			if (queue.empty())
+				this->waiters.erase(recipient);
+		}
+
+		// A client disconnected, its queued messages will never be delivered.
+		void disconnected(int descriptor) {
+			if (this->waiting == 0)
+				return;
+
+			const auto recipient = this->waiters.find(descriptor);
+
+			if (recipient == this->waiters.end())
+				return;
+
+			const auto now = tp3::util::tsc::now();
+
+			for (const auto& waiter : recipient->second)
+				this->release(waiter, true, now);
+
+			this->waiters.erase(recipient);
+		}
+	};
+}
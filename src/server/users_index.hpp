@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <util/array_view.hpp>
+
+
+namespace tp3::server {
+	// The names in byte order, with their session handles, for paging through the users and
+	// searching them by prefix. A sorted array: a query is a binary search and a copy of the
+	// page, at the cost of moving the later names on every change. The names refer to the
+	// clients' name storage, like the catalogue's keys.
+	class users_index {
+	public:
+		using name_type = tp3::util::array_view<uint8_t>;
+
+		struct entry {
+			name_type name;
+			uint32_t handle;
+		};
+
+		using iterator = std::vector<entry>::const_iterator;
+
+		// The names starting with a prefix.
+		struct range {
+			iterator begin;
+			iterator end;
+
+			std::size_t size() const noexcept {
+				return this->end - this->begin;
+			}
+		};
+
+	protected:
+		std::vector<entry> names;
+
+
+		static bool less(const entry& entry, const name_type& name) noexcept {
+			return std::lexicographical_compare(
+				entry.name.begin(),
+				entry.name.end(),
+				name.begin(),
+				name.end()
+			);
+		}
+
+		static bool starts_with(const name_type& name, const name_type& prefix) noexcept {
+			return name.size() >= prefix.size()
+			    && std::equal(prefix.begin(), prefix.end(), name.begin());
+		}
+
+
+	public:
+		std::size_t size() const noexcept {
+			return this->names.size();
+		}
+
+
+		void insert(name_type name, uint32_t handle) {
+			this->names.insert(
+				std::lower_bound(this->names.begin(), this->names.end(), name, less),
+				entry { name, handle }
+			);
+		}
+
+		void erase(name_type name) {
+			const auto it = std::lower_bound(this->names.begin(), this->names.end(), name, less);
+
+			if (it != this->names.end() && it->name == name)
+				this->names.erase(it);
+		}
+
+
+		// The names starting with prefix, in O(log N).
+		range find(name_type prefix) const {
+			const auto begin = std::lower_bound(
+				this->names.begin(),
+				this->names.end(),
+				prefix,
+				less
+			);
+
+			// the names from begin on are not less than prefix, so the ones starting with it
+			// come first.
+			const auto end = std::partition_point(
+				begin,
+				this->names.cend(),
+				[&](const entry& entry) { return starts_with(entry.name, prefix); }
+			);
+
+			return range { begin, end };
+		}
+	};
+}
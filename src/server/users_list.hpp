@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <client/message.hpp>
+#include <util/array_view.hpp>
+#include <util/token.hpp>
+
+
+namespace tp3::server {
+	// The encoded users list frame, maintained as clients are named, renamed and forgotten,
+	// so that answering a list_users request is a single send of a shared buffer.
+	// The frame holds the header, an entry of name and separator per named client, and a
+	// tail with the count of anonymous clients, as "anonymous(count)", if any.
+	// Sent frames may be queued by the clients that couldn't take them at once, so they are
+	// never modified while shared: a shared frame is copied before changing.
+	// Removing an entry leaves a hole in the frame, its name overwritten by separators, so
+	// that a leave costs the name's size however many users there are. Clients skip the
+	// empty names, so the frame is sent with its holes, which are compacted, in a single
+	// pass, once they take half of the names.
+	class users_list {
+	public:
+		using frame_type = std::vector<uint8_t>;
+
+	protected:
+		using token = tp3::client::message::token;
+
+		static constexpr std::size_t header_size = 2; // heading + users_list
+		static constexpr std::size_t npos = -1;
+
+		struct entry {
+			std::size_t offset = 0; // Where the name starts in the frame.
+			std::size_t size = npos; // The name's size, npos when the entry is free.
+		};
+
+		std::shared_ptr<frame_type> _frame;
+		std::size_t names_end = header_size; // The end of the last entry.
+
+		std::vector<entry> entries;
+		std::vector<std::size_t> free_entries;
+
+		// The removed entries' names and separators, not yet compacted.
+		struct hole {
+			std::size_t offset;
+			std::size_t size;
+		};
+
+		std::vector<hole> holes;
+		std::size_t hole_bytes = 0;
+
+		// The anonymous count the tail was written for, if the tail is current.
+		std::optional<std::size_t> tail;
+
+
+		// Get the frame for modifying the entries, copying it if shared, and removing the tail.
+		frame_type& edit() {
+			if (this->_frame.use_count() > 1)
+				this->_frame = std::make_shared<frame_type>(*this->_frame);
+
+			auto& frame = *this->_frame;
+
+			if (this->tail) {
+				// without anonymous clients, the last separator was made the end.
+				if (*this->tail == 0 && this->names_end > header_size)
+					frame[this->names_end - 1] = tp3::util::token_value(token::user_sep);
+
+				frame.resize(this->names_end);
+				this->tail.reset();
+			}
+
+			return frame;
+		}
+
+
+		// Move the names back over the holes, and the entries' offsets with them.
+		void compact() {
+			auto& frame = this->edit();
+
+			std::sort(
+				this->holes.begin(),
+				this->holes.end(),
+				[](const hole& a, const hole& b) { return a.offset < b.offset; }
+			);
+
+			std::size_t end = this->holes.front().offset;
+			std::size_t removed = 0; // The bytes removed before each hole's end.
+
+			for (std::size_t i = 0; i < this->holes.size(); ++i) {
+				const std::size_t from = this->holes[i].offset + this->holes[i].size;
+				const std::size_t to = i + 1 < this->holes.size() ? this->holes[i + 1].offset : this->names_end;
+
+				end = std::copy(frame.begin() + from, frame.begin() + to, frame.begin() + end) - frame.begin();
+
+				removed += this->holes[i].size;
+				this->holes[i].size = removed;
+			}
+
+			frame.resize(end);
+			this->names_end = end;
+
+			// an entry moves back by the bytes removed before it.
+			for (auto& entry : this->entries) {
+				if (entry.size == npos)
+					continue;
+
+				const auto next = std::upper_bound(
+					this->holes.begin(),
+					this->holes.end(),
+					entry.offset,
+					[](std::size_t offset, const hole& hole) { return offset < hole.offset; }
+				);
+
+				if (next != this->holes.begin())
+					entry.offset -= std::prev(next)->size;
+			}
+
+			this->holes.clear();
+			this->hole_bytes = 0;
+		}
+
+
+	public:
+		users_list()
+			: _frame(
+			  	std::make_shared<frame_type>(
+			  		frame_type {
+			  			tp3::util::token_value(token::heading),
+			  			tp3::util::token_value(token::users_list)
+			  		}
+			  	)
+			  ) { }
+
+
+		// Add a name, returning its entry.
+		std::size_t add(tp3::util::array_view<uint8_t> name) {
+			auto& frame = this->edit();
+
+			std::size_t index;
+
+			if (this->free_entries.empty()) {
+				index = this->entries.size();
+				this->entries.emplace_back();
+			}
+			else {
+				index = this->free_entries.back();
+				this->free_entries.pop_back();
+			}
+
+			this->entries[index] = entry {
+				.offset = this->names_end,
+				.size = name.size()
+			};
+
+			frame.insert(frame.end(), name.begin(), name.end());
+			frame.push_back(tp3::util::token_value(token::user_sep));
+			this->names_end = frame.size();
+
+			return index;
+		}
+
+		// Remove an entry, leaving a hole in the frame.
+		void remove(std::size_t index) {
+			const auto removed = this->entries[index];
+
+			auto& frame = this->edit();
+
+			std::fill_n(
+				frame.begin() + removed.offset,
+				removed.size,
+				tp3::util::token_value(token::user_sep)
+			);
+
+			this->holes.push_back(hole { removed.offset, removed.size + 1 }); // name + separator
+			this->hole_bytes += removed.size + 1;
+
+			this->entries[index] = entry();
+			this->free_entries.push_back(index);
+
+			if (this->hole_bytes > (this->names_end - header_size) / 2)
+				this->compact();
+		}
+
+		// Change the name of an entry, returning the entry's new index.
+		std::size_t rename(std::size_t index, tp3::util::array_view<uint8_t> name) {
+			if (this->entries[index].size != name.size()) {
+				this->remove(index);
+				return this->add(name);
+			}
+
+			auto& frame = this->edit();
+
+			std::copy(
+				name.begin(),
+				name.end(),
+				frame.begin() + this->entries[index].offset
+			);
+
+			return index;
+		}
+
+
+		// The complete frame, given the current count of anonymous clients.
+		std::shared_ptr<const frame_type> frame(std::size_t anonymous) {
+			if (this->tail == anonymous)
+				return this->_frame;
+
+			auto& frame = this->edit();
+
+			if (anonymous > 0) {
+				char count[32] = "anonymous(";
+				char* end = std::to_chars(count + 10, count + sizeof(count) - 1, anonymous).ptr;
+				*end++ = ')';
+
+				frame.insert(frame.end(), count, end);
+				frame.push_back(tp3::util::token_value(token::end));
+			}
+			else if (this->names_end > header_size)
+				frame[this->names_end - 1] = tp3::util::token_value(token::end);
+			else
+				frame.push_back(tp3::util::token_value(token::end));
+
+			this->tail = anonymous;
+
+			return this->_frame;
+		}
+	};
+}
@@ -1,6 +1,9 @@
 #include "addr.hpp"
 
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
+#include <stdexcept>
 
 
 tp3::socket::name::name(std::string&& node, std::string&& service)
@@ -8,7 +11,7 @@ tp3::socket::name::name(std::string&& node, std::string&& service)
 	  service(std::move(service))
 { }
 
-tp3::socket::name::name(struct sockaddr* addr, socklen_t size) {
+tp3::socket::name::name(const struct sockaddr* addr, socklen_t size, int flags) {
 	const size_t max_size = 256;
 
 	char node[max_size];
@@ -22,7 +25,7 @@ tp3::socket::name::name(struct sockaddr* addr, socklen_t size) {
 		sizeof(node),
 		service,
 		sizeof(service),
-		0
+		flags
 	);
 
 	if (result != 0)
@@ -52,56 +55,47 @@ std::system_error tp3::socket::addr::eai_exception(int eai_error) {
 }
 
 
+void tp3::socket::addr::attach() noexcept {
+	this->info.ai_addr = reinterpret_cast<struct sockaddr*>(&this->storage);
+	this->info.ai_canonname = nullptr;
+	this->info.ai_next = nullptr;
+}
+
+
 tp3::socket::addr::addr(
 	const int fd,
 	const std::function<int(int, sockaddr*, socklen_t*)>& filladdr
-) {
-	struct sockaddr_in6 address; // sockaddr_in6 is the biggest of sockaddrs.
+) : info { } {
+	this->attach();
 
 	// filladdr:
-	socklen_t size = sizeof(address);
+	socklen_t size = sizeof(this->storage);
 	socklen_t original_size = size;
 
-	const auto sockaddr = reinterpret_cast<struct sockaddr *>(&address);
-
-	if (filladdr(fd, sockaddr, &size) < 0)
+	if (filladdr(fd, this->info.ai_addr, &size) < 0)
 		throw std::system_error(errno, std::generic_category());
 
 	if (size > original_size)
 		throw std::length_error(
 			std::string(
-				typeid(address).name()
+				typeid(this->storage).name()
 			)
 			.append(" too small")
 		);
 
-	// name:
-	const name name(sockaddr, size);
+	this->info.ai_family = this->info.ai_addr->sa_family;
+	this->info.ai_addrlen = size;
 
-	// addrinfo hint:
-	addrinfo addrinfo_hint {
-		.ai_family = sockaddr->sa_family
-	};
-	size = sizeof(addrinfo_hint.ai_socktype);
+	// socktype:
+	size = sizeof(this->info.ai_socktype);
 	original_size = size;
 
-	if (::getsockopt(fd, SOL_SOCKET, SO_TYPE, &addrinfo_hint.ai_socktype, &size) < 0)
+	// http://man7.org/linux/man-pages/man2/getsockopt.2.html
+	if (::getsockopt(fd, SOL_SOCKET, SO_TYPE, &this->info.ai_socktype, &size) < 0)
 		throw std::system_error(errno, std::generic_category());
 
 	if (size > original_size)
 		throw std::length_error("socktype too small");
-
-	// addrinfo:
-	// http://man7.org/linux/man-pages/man3/getaddrinfo.3.html
-	auto result = ::getaddrinfo(
-		name.node.c_str(),
-		name.service.c_str(),
-		&addrinfo_hint,
-		&this->data
-	);
-
-	if (result != 0)
-		throw addr::eai_exception(result);
 }
 
 tp3::socket::addr::addr(const int fd)
@@ -117,61 +111,115 @@ tp3::socket::addr::addr(const int fd)
 	  )
 { }
 
+tp3::socket::addr::addr(
+	const sockaddr* address,
+	socklen_t size,
+	int socktype,
+	int protocol
+) : info {
+	  	.ai_family = address->sa_family,
+	  	.ai_socktype = socktype,
+	  	.ai_protocol = protocol,
+	  	.ai_addrlen = size
+	  }
+{
+	if (size > sizeof(this->storage))
+		throw std::length_error(
+			std::string(
+				typeid(this->storage).name()
+			)
+			.append(" too small")
+		);
+
+	this->attach();
+
+	std::memcpy(&this->storage, address, size);
+}
+
 tp3::socket::addr::addr(const name& name, const addrinfo& hints) {
+	addrinfo* result;
+
 	// http://man7.org/linux/man-pages/man3/getaddrinfo.3.html
-	const auto result = ::getaddrinfo(
+	const auto error = ::getaddrinfo(
 		name.node.c_str(),
 		name.service.c_str(),
 		&hints,
-		&this->data
+		&result
 	);
 
-	if (result != 0)
-		throw addr::eai_exception(result);
-}
+	if (error != 0)
+		throw addr::eai_exception(error);
+
+	// Only the first address is used, so keep a copy of it and release the list.
+	try {
+		*this = addr(result->ai_addr, result->ai_addrlen, result->ai_socktype, result->ai_protocol);
+		this->info.ai_flags = result->ai_flags;
+	}
+	catch (...) {
+		::freeaddrinfo(result);
+		throw;
+	}
 
-tp3::socket::addr::addr(addr&& other) : data(other.data) {
-	other.data = nullptr;
+	// http://man7.org/linux/man-pages/man3/freeaddrinfo.3p.html
+	::freeaddrinfo(result);
 }
 
-tp3::socket::addr::~addr() {
-	if (this->data != nullptr)
-		// http://man7.org/linux/man-pages/man3/freeaddrinfo.3p.html
-		::freeaddrinfo(this->data);
+tp3::socket::addr::addr(const addr& other)
+	: storage(other.storage),
+	  info(other.info)
+{
+	this->attach();
 }
 
+tp3::socket::addr::addr(addr&& other) noexcept
+	: addr(
+	  	static_cast<const addr&>(other)
+	  )
+{ }
 
-tp3::socket::addr& tp3::socket::addr::operator=(addr&& other) {
-	this->~addr();
 
-	this->data = other.data;
-	other.data = nullptr;
+tp3::socket::addr& tp3::socket::addr::operator=(const addr& other) {
+	this->storage = other.storage;
+	this->info = other.info;
+	this->attach();
 
 	return *this;
 }
 
+tp3::socket::addr& tp3::socket::addr::operator=(addr&& other) noexcept {
+	return *this = static_cast<const addr&>(other);
+}
+
 
 addrinfo& tp3::socket::addr::operator*() {
-	return *this->data;
+	return this->info;
 }
 
 addrinfo* tp3::socket::addr::operator->() {
-	return this->data;
+	return &this->info;
 }
 
 const addrinfo& tp3::socket::addr::operator*() const {
-	return *this->data;
+	return this->info;
 }
 
 const addrinfo* tp3::socket::addr::operator->() const {
-	return this->data;
+	return &this->info;
 }
 
 
-std::ostream& operator<<(std::ostream& stream, const tp3::socket::addr& address) {
-	const tp3::socket::name name(address->ai_addr, address->ai_addrlen);
+std::ostream& tp3::socket::operator<<(std::ostream& stream, const tp3::socket::name& name) {
+	return stream << name.node << ':' << name.service;
+}
+
+std::ostream& tp3::socket::operator<<(std::ostream& stream, const tp3::socket::addr& address) {
+	const tp3::socket::name name(
+		address->ai_addr,
+		address->ai_addrlen,
+		NI_NUMERICHOST | NI_NUMERICSERV
+	);
 
-  stream << name.node << ':' << name.service;
+	stream << name;
 
 	switch (address->ai_family) {
 		case AF_INET: stream << " (IPv4"; break;
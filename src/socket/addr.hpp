@@ -18,15 +18,23 @@ namespace tp3::socket {
 
 		name() = default;
 		name(std::string&& node, std::string&& service);
-		name(struct sockaddr* addr, socklen_t size);
+		// Resolve from a socket address. Unless flags include NI_NUMERICHOST, this may
+		// perform a blocking reverse DNS lookup.
+		name(const struct sockaddr* addr, socklen_t size, int flags = 0);
 		~name() = default;
 	};
 
 
 	// A socket address structure.
+	// The raw address is stored inline, so constructing from a socket is cheap: no name
+	// resolution is ever performed, except when constructing from a name.
 	class addr {
 	protected:
-		addrinfo* data; // nullptr when deleted.
+		sockaddr_storage storage;
+		addrinfo info; // Describes storage. info.ai_addr always points to storage.
+
+		// Point info to storage.
+		void attach() noexcept;
 
 	public:
 		static std::system_error eai_exception(int eai_error);
@@ -35,14 +43,16 @@ namespace tp3::socket {
 		addr(int fd);
 		// Construct from a file descriptor and a function to fill a sockaddr.
 		addr(int fd, const std::function<int(int, sockaddr*, socklen_t*)>& fill_addr);
+		// Construct from a raw socket address.
+		addr(const sockaddr* address, socklen_t size, int socktype, int protocol = 0);
 		// Construct from a name.
 		addr(const name& nameinfo, const addrinfo& hints);
-		addr(const addr&) = delete;
-		addr(addr&&);
-		~addr();
+		addr(const addr&);
+		addr(addr&&) noexcept;
+		~addr() = default;
 
-		addr& operator=(const addr&) = delete;
-		addr& operator=(addr&&);
+		addr& operator=(const addr&);
+		addr& operator=(addr&&) noexcept;
 
 		addrinfo& operator*();
 		addrinfo* operator->();
@@ -52,5 +62,7 @@ namespace tp3::socket {
 	};
 
 
+	std::ostream& operator<<(std::ostream& stream, const name& name);
+	// Print the numeric address. No name resolution is performed.
 	std::ostream& operator<<(std::ostream& stream, const addr& address);
 }
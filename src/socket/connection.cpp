@@ -1,4 +1,5 @@
 #include "connection.hpp"
+#include "counters.hpp"
 
 #include <cerrno>
 #include <cstring>
@@ -6,6 +7,7 @@
 #include <system_error>
 
 #include <sys/socket.h>
+#include <unistd.h>
 
 
 tp3::socket::connection::connection(class addr&& address)
@@ -15,59 +17,159 @@ tp3::socket::connection::connection(class addr&& address)
 	  )
 { }
 
-tp3::socket::connection::connection(const server& server)
+namespace {
+	// Accept a connection, keeping the peer's raw address. No name resolution is performed.
+	// On failure, the returned descriptor is -1 and result tells why.
+	std::tuple<int, tp3::socket::addr> accept_from(
+		const tp3::socket::server& server,
+		int flags,
+		tp3::socket::result& result
+	) noexcept {
+		sockaddr_storage storage;
+		socklen_t size = sizeof(storage);
+
+		const auto address = reinterpret_cast<sockaddr*>(&storage);
+
+		++tp3::socket::syscalls.accept;
+
+		// http://man7.org/linux/man-pages/man2/accept.2.html
+		const int fd = ::accept4(server.descriptor(), address, &size, flags);
+
+		if (fd < 0) {
+			result = tp3::socket::result::from_errno(errno);
+
+			size = sizeof(sa_family_t);
+			address->sa_family = AF_UNSPEC;
+		}
+
+		return std::make_tuple(
+			fd,
+			tp3::socket::addr(address, size, SOCK_STREAM, server.address()->ai_protocol)
+		);
+	}
+
+	std::tuple<int, tp3::socket::addr> accept_from(const tp3::socket::server& server, int flags) {
+		tp3::socket::result result;
+
+		auto accepted = accept_from(server, flags, result);
+
+		if (!result)
+			throw std::system_error(result.code());
+
+		return accepted;
+	}
+}
+
+
+tp3::socket::connection::connection(std::tuple<int, class addr>&& accepted)
 	: sock(
-	  	// http://man7.org/linux/man-pages/man2/accept.2.html
-	  	::accept(server.descriptor(), nullptr, nullptr)
+	  	std::get<int>(accepted),
+	  	std::move(std::get<class addr>(accepted))
+	  )
+{ }
+
+tp3::socket::connection::connection(const server& server)
+	: connection(
+	  	accept_from(server, SOCK_CLOEXEC)
 	  )
 { }
 
 
+std::tuple<tp3::socket::result, std::optional<tp3::socket::connection>>
+tp3::socket::connection::accept(const server& server) noexcept {
+	tp3::socket::result result;
+
+	auto accepted = accept_from(server, SOCK_NONBLOCK | SOCK_CLOEXEC, result);
+
+	if (!result)
+		return { result, std::nullopt };
+
+	return { result, connection(std::move(accepted)) };
+}
+
+
+std::tuple<tp3::socket::result, std::optional<tp3::socket::connection>>
+tp3::socket::connection::connect(class addr&& address) noexcept {
+	// http://man7.org/linux/man-pages/man2/socket.2.html
+	const int fd = ::socket(
+		address->ai_family,
+		address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		address->ai_protocol
+	);
+
+	if (fd < 0)
+		return { result::from_errno(errno), std::nullopt };
+
+	// http://man7.org/linux/man-pages/man2/connect.2.html
+	if (::connect(fd, address->ai_addr, address->ai_addrlen) < 0 && errno != EINPROGRESS) {
+		const auto failed = result::from_errno(errno);
+		::close(fd);
+
+		return { failed, std::nullopt };
+	}
+
+	return { result(), connection(std::make_tuple(fd, std::move(address))) };
+}
+
+
 tp3::socket::connection::~connection() {
 	if (this->deleted())
 		return;
 
-	if (::shutdown(this->fd, SHUT_RDWR) < 0)
+	// ENOTCONN: the connection never connected, or was reset, so there is nothing to shut down.
+	if (::shutdown(this->fd, SHUT_RDWR) < 0 && errno != ENOTCONN)
 		std::cerr << "Failed to close connection (fd = " << this->fd << "):"
 		          << std::endl
 		          << std::strerror(errno);
 }
 
 
-bool tp3::socket::connection::is_closed() const {
-	// http://man7.org/linux/man-pages/man2/recv.2.html
-	uint8_t dump;
-
-	auto size = ::recv(
-		this->fd,
-		&dump,
-		1,
-		MSG_PEEK
-	);
-
-	return size == 0;
-}
+tp3::socket::result tp3::socket::connection::recv(
+	uint8_t buffer[],
+	std::size_t size
+) const noexcept {
+	++syscalls.recv;
 
-std::size_t tp3::socket::connection::recv(uint8_t buffer[], std::size_t size) const {
 	// http://man7.org/linux/man-pages/man2/recv.2.html
-	size = ::recv(this->fd, buffer, size, 0);
+	const auto received = ::recv(this->fd, buffer, size, 0);
 
-	if (size < 0)
-		throw std::system_error(errno, std::generic_category());
+	if (received < 0)
+		return result::from_errno(errno);
 
-	return size;
+	if (received == 0 && size > 0)
+		return { .status = status::closed };
+
+	return { .size = std::size_t(received) };
 }
 
 
-std::size_t tp3::socket::connection::send(
+tp3::socket::result tp3::socket::connection::send(
 	const uint8_t buffer[],
 	std::size_t size
-) const {
+) const noexcept {
+	++syscalls.send;
+
+	// MSG_NOSIGNAL: report a closed peer as EPIPE instead of raising SIGPIPE.
 	// http://man7.org/linux/man-pages/man2/sendto.2.html
-	size = ::send(this->fd, buffer, size, 0);
+	const auto sent = ::send(this->fd, buffer, size, MSG_NOSIGNAL);
+
+	if (sent < 0)
+		return result::from_errno(errno);
+
+	return { .size = std::size_t(sent) };
+}
+
+
+tp3::socket::result tp3::socket::connection::error() const noexcept {
+	int error = 0;
+	socklen_t size = sizeof(error);
+
+	// http://man7.org/linux/man-pages/man7/socket.7.html
+	if (::getsockopt(this->fd, SOL_SOCKET, SO_ERROR, &error, &size) < 0)
+		return result::from_errno(errno);
 
-	if (size < 0)
-		throw std::system_error(errno, std::generic_category());
+	if (error != 0)
+		return result::from_errno(error);
 
-	return size;
+	return {};
 }
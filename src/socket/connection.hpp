@@ -2,8 +2,11 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <tuple>
 
 #include "addr.hpp"
+#include "result.hpp"
 #include "server.hpp"
 #include "sock.hpp"
 
@@ -11,12 +14,26 @@
 namespace tp3::socket {
 	// A TCP connection socket.
 	class connection : public sock {
+	protected:
+		// Construct from an accepted descriptor and its peer address.
+		connection(std::tuple<int, class addr>&&);
+
 	public:
 		// Connect to an address.
 		connection(class addr&&);
-		// Accept connection from TCP server.
+		// Accept a pending connection from TCP server.
+		// Throws if there is no pending connection, as the server is non-blocking.
 		connection(const server&);
 
+		// Accept a pending connection from a non-blocking TCP server, if any.
+		// The accepted connection is non-blocking.
+		static std::tuple<result, std::optional<connection>> accept(const server&) noexcept;
+
+		// Start connecting to an address without blocking. The connection is non-blocking, and
+		// becomes writable once connected, or once connecting failed, see error. Sending before
+		// then would block.
+		static std::tuple<result, std::optional<connection>> connect(class addr&&) noexcept;
+
 		connection(const connection&) = delete;
 		connection(connection&&) = default;
 		connection& operator=(const connection&) = delete;
@@ -24,9 +41,11 @@ namespace tp3::socket {
 
 		~connection();
 
-		bool is_closed() const;
+		// A zero length read is reported as status::closed.
+		result recv(uint8_t[], std::size_t) const noexcept;
+		result send(const uint8_t[], std::size_t) const noexcept;
 
-		std::size_t recv(uint8_t[], std::size_t) const;
-		std::size_t send(const uint8_t[], std::size_t) const;
+		// The socket's pending error, such as why a non-blocking connect failed.
+		result error() const noexcept;
 	};
 }
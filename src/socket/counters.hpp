@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+
+namespace tp3::socket {
+	// Syscall counters.
+	struct counters {
+		uint64_t poll = 0;
+		uint64_t accept = 0;
+		uint64_t recv = 0;
+		uint64_t send = 0;
+	};
+
+	// The syscalls issued by the calling thread.
+	inline thread_local counters syscalls;
+}
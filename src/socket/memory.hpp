@@ -0,0 +1,442 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "addr.hpp"
+#include "result.hpp"
+
+
+// An in-process transport for tp3::server::server, for deterministic simulations.
+// A network connects virtual peers, driven by the simulation, to a single server through
+// in-memory pipes, and keeps a virtual clock that only moves when the simulation says
+// so. No syscalls are issued.
+namespace tp3::socket::memory {
+	// The network's virtual clock. Its time is read from the network, see network::now.
+	struct clock {
+		using duration = std::chrono::nanoseconds;
+		using rep = duration::rep;
+		using period = duration::period;
+		using time_point = std::chrono::time_point<clock>;
+
+		static constexpr bool is_steady = true;
+	};
+
+
+	class network;
+
+
+	// A virtual client's end of a connection. A handle, not an owner: the connection stays
+	// open until closed, and the handle is invalid afterwards.
+	class peer {
+	protected:
+		network* net;
+		std::size_t link;
+
+	public:
+		peer(network& net, std::size_t link)
+			: net(&net),
+			  link(link) { }
+
+		// Send data to the server, returning how many bytes fit in the pipe.
+		std::size_t send(const uint8_t data[], std::size_t size);
+
+		// The data sent by the server and not consumed yet.
+		const uint8_t* received() const noexcept;
+		std::size_t available() const noexcept;
+		void consume(std::size_t size) noexcept;
+
+		// Whether the server closed the connection.
+		bool closed() const noexcept;
+
+		void close() noexcept;
+	};
+
+
+	// The server's listening socket.
+	class server {
+	protected:
+		network* net;
+
+	public:
+		server(network& net)
+			: net(&net) { }
+
+		int descriptor() const noexcept;
+	};
+
+
+	// The server's end of a connection.
+	class connection {
+		friend class network;
+
+	protected:
+		network* net; // Null when moved from.
+		std::size_t link;
+		tp3::socket::addr _address; // A made up address, unique among the open connections.
+
+		connection(network&, std::size_t link);
+
+	public:
+		connection(const connection&) = delete;
+		connection(connection&& other) noexcept
+			: net(std::exchange(other.net, nullptr)),
+			  link(other.link),
+			  _address(std::move(other._address)) { }
+
+		~connection();
+
+		connection& operator=(const connection&) = delete;
+		connection& operator=(connection&& other) noexcept {
+			std::swap(this->net, other.net);
+			std::swap(this->link, other.link);
+			std::swap(this->_address, other._address);
+
+			return *this;
+		}
+
+		int descriptor() const noexcept;
+
+		const tp3::socket::addr& address() const noexcept {
+			return this->_address;
+		}
+
+		// A read of a pipe that is empty and closed is reported as status::closed.
+		result recv(uint8_t[], std::size_t) const noexcept;
+		result send(const uint8_t[], std::size_t) const noexcept;
+	};
+
+
+	class network {
+		friend class peer;
+		friend class server;
+		friend class connection;
+
+	protected:
+		// Descriptors are made up, above any real one, so that they can share a poll set
+		// with real sockets, which are never reported ready.
+		static constexpr int listener = (1 << 24) - 1;
+		static constexpr int first_descriptor = 1 << 24;
+
+		// One direction of a connection.
+		struct pipe {
+			std::vector<uint8_t> data;
+			std::size_t offset = 0; // Bytes of data already consumed.
+			bool closed = false; // No more data will be pushed.
+
+			std::size_t size() const noexcept {
+				return this->data.size() - this->offset;
+			}
+
+			std::size_t push(const uint8_t source[], std::size_t size, std::size_t capacity) {
+				size = std::min(size, capacity - this->size());
+				this->data.insert(this->data.end(), source, source + size);
+
+				return size;
+			}
+
+			void consume(std::size_t size) noexcept {
+				this->offset += size;
+
+				if (this->offset == this->data.size()) {
+					this->data.clear();
+					this->offset = 0;
+				}
+				else if (this->offset > this->data.size() / 2) {
+					this->data.erase(this->data.begin(), this->data.begin() + this->offset);
+					this->offset = 0;
+				}
+			}
+		};
+
+		struct link {
+			pipe up; // peer to server.
+			pipe down; // server to peer.
+			bool accepted = false;
+			bool server_open = false;
+			bool peer_open = true;
+		};
+
+
+		const std::size_t capacity; // Bytes each pipe holds, like a socket buffer.
+
+		std::vector<link> links; // By descriptor - first_descriptor.
+		std::vector<std::size_t> free_links; // Closed by both ends, to be reused.
+		std::deque<std::size_t> backlog; // Connections waiting to be accepted.
+
+		clock::time_point _now;
+
+
+		link* find(int descriptor) noexcept {
+			const std::size_t index = std::size_t(descriptor) - first_descriptor;
+
+			if (descriptor < first_descriptor || index >= this->links.size())
+				return nullptr;
+
+			return &this->links[index];
+		}
+
+		// Free a link once both ends are closed.
+		void release(std::size_t index) {
+			auto& link = this->links[index];
+
+			if (link.accepted && !link.server_open && !link.peer_open) {
+				link = network::link();
+				this->free_links.push_back(index);
+			}
+		}
+
+		// The poll events of a descriptor.
+		short events(int descriptor) noexcept {
+			if (descriptor == listener)
+				return this->backlog.empty() ? 0 : POLLIN;
+
+			auto link = this->find(descriptor);
+
+			if (!link || !link->server_open)
+				return 0;
+
+			short events = 0;
+
+			if (link->up.size() > 0)
+				events |= POLLIN;
+
+			if (link->up.closed)
+				events |= POLLIN | POLLRDHUP;
+
+			if (!link->peer_open || link->down.size() < this->capacity)
+				events |= POLLOUT;
+
+			return events;
+		}
+
+
+	public:
+		network(std::size_t capacity = 16 << 20)
+			: capacity(capacity) { }
+
+		network(const network&) = delete;
+		network& operator=(const network&) = delete;
+
+
+		// Open a connection to the server, to be accepted.
+		peer connect() {
+			std::size_t index;
+
+			if (this->free_links.empty()) {
+				index = this->links.size();
+				this->links.emplace_back();
+			}
+			else {
+				index = this->free_links.back();
+				this->free_links.pop_back();
+			}
+
+			this->backlog.push_back(index);
+
+			return peer(*this, index);
+		}
+
+
+		// Connections waiting to be accepted.
+		std::size_t pending() const noexcept {
+			return this->backlog.size();
+		}
+
+
+		clock::time_point now() const noexcept {
+			return this->_now;
+		}
+
+		void advance(clock::duration duration) noexcept {
+			this->_now += duration;
+		}
+
+
+		// Accept a pending connection, if any.
+		std::tuple<result, std::optional<connection>> accept() {
+			if (this->backlog.empty())
+				return { result::from_errno(EAGAIN), std::nullopt };
+
+			const auto index = this->backlog.front();
+			this->backlog.pop_front();
+
+			this->links[index].accepted = true;
+			this->links[index].server_open = true;
+
+			return { result(), connection(*this, index) };
+		}
+
+
+		// Report the ready descriptors like poll. When none is ready, the clock is advanced
+		// by the timeout instead of waiting.
+		int poll(pollfd sockets[], nfds_t count, int timeout) noexcept {
+			int ready = 0;
+
+			for (nfds_t i = 0; i < count; ++i) {
+				auto& socket = sockets[i];
+
+				socket.revents = this->events(socket.fd) & (socket.events | POLLHUP | POLLERR);
+
+				if (socket.revents)
+					++ready;
+			}
+
+			if (ready == 0 && timeout > 0)
+				this->advance(std::chrono::milliseconds(timeout));
+
+			return ready;
+		}
+	};
+
+
+	// The network as a transport for tp3::server::server.
+	struct transport {
+		using server = memory::server;
+		using connection = memory::connection;
+		using clock = memory::clock;
+
+		network* net;
+
+
+		transport(network& net)
+			: net(&net) { }
+
+
+		std::tuple<result, std::optional<connection>> accept(const server&) const {
+			return this->net->accept();
+		}
+
+		int poll(pollfd sockets[], nfds_t count, int timeout) const noexcept {
+			return this->net->poll(sockets, count, timeout);
+		}
+
+		clock::time_point now() const noexcept {
+			return this->net->now();
+		}
+	};
+
+
+
+	inline std::size_t peer::send(const uint8_t data[], std::size_t size) {
+		auto& link = this->net->links[this->link];
+
+		if (!link.peer_open || (link.accepted && !link.server_open))
+			return 0;
+
+		return link.up.push(data, size, this->net->capacity);
+	}
+
+	inline const uint8_t* peer::received() const noexcept {
+		const auto& down = this->net->links[this->link].down;
+		return down.data.data() + down.offset;
+	}
+
+	inline std::size_t peer::available() const noexcept {
+		return this->net->links[this->link].down.size();
+	}
+
+	inline void peer::consume(std::size_t size) noexcept {
+		this->net->links[this->link].down.consume(size);
+	}
+
+	inline bool peer::closed() const noexcept {
+		const auto& link = this->net->links[this->link];
+		return link.accepted && !link.server_open;
+	}
+
+	inline void peer::close() noexcept {
+		auto& link = this->net->links[this->link];
+
+		link.peer_open = false;
+		link.up.closed = true;
+		link.down = network::pipe();
+
+		this->net->release(this->link);
+	}
+
+
+	inline int server::descriptor() const noexcept {
+		return network::listener;
+	}
+
+
+	// The address is 10.0.0.0/8 plus the link index, with a port in the ephemeral range.
+	inline connection::connection(network& net, std::size_t link)
+		: net(&net),
+		  link(link),
+		  _address(
+		  	[link] {
+		  		sockaddr_in address { };
+		  		address.sin_family = AF_INET;
+		  		address.sin_port = htons(49152 + link % 16384);
+		  		address.sin_addr.s_addr = htonl(0x0a000000 | (link & 0xffffff));
+
+		  		return tp3::socket::addr(
+		  			reinterpret_cast<const sockaddr*>(&address),
+		  			sizeof(address),
+		  			SOCK_STREAM
+		  		);
+		  	}()
+		  )
+	{ }
+
+	inline connection::~connection() {
+		if (!this->net)
+			return;
+
+		auto& link = this->net->links[this->link];
+
+		link.server_open = false;
+		link.down.closed = true;
+		link.up = network::pipe();
+
+		this->net->release(this->link);
+	}
+
+	inline int connection::descriptor() const noexcept {
+		return network::first_descriptor + int(this->link);
+	}
+
+	inline result connection::recv(uint8_t buffer[], std::size_t size) const noexcept {
+		auto& up = this->net->links[this->link].up;
+
+		if (up.size() == 0)
+			return size == 0 ? result()
+			     : up.closed ? result { .status = status::closed }
+			     : result::from_errno(EAGAIN);
+
+		size = std::min(size, up.size());
+		std::copy(up.data.begin() + up.offset, up.data.begin() + up.offset + size, buffer);
+		up.consume(size);
+
+		return { .size = size };
+	}
+
+	inline result connection::send(const uint8_t buffer[], std::size_t size) const noexcept {
+		auto& link = this->net->links[this->link];
+
+		if (!link.peer_open)
+			return result::from_errno(EPIPE);
+
+		const auto sent = link.down.push(buffer, size, this->net->capacity);
+
+		if (sent == 0 && size > 0)
+			return result::from_errno(EAGAIN);
+
+		return { .size = sent };
+	}
+}
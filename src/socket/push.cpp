@@ -1,7 +1,7 @@
 #include "push.hpp"
+#include "counters.hpp"
 
 #include <cerrno>
-#include <system_error>
 
 #include <sys/socket.h>
 
@@ -14,35 +14,41 @@ tp3::socket::push::push(class addr&& address, int (&attach)(const sock&))
 { }
 
 
-std::tuple<std::unique_ptr<uint8_t[]>, tp3::socket::addr> tp3::socket::push::recv(
-	std::size_t& size
-) const {
-	auto buffer = std::make_unique<uint8_t[]>(size);
+std::tuple<tp3::socket::result, std::optional<tp3::socket::addr>> tp3::socket::push::recv(
+	uint8_t buffer[],
+	std::size_t size
+) const noexcept {
+	sockaddr_storage storage;
+	socklen_t address_size = sizeof(storage);
 
-	auto recv = [&](int fd, sockaddr* addr, socklen_t* addr_size) {
-		// http://man7.org/linux/man-pages/man3/recvfrom.3p.html
-		size = ::recvfrom(fd, buffer.get(), size, 0, addr, addr_size);
-		return size;
-	};
+	const auto address = reinterpret_cast<sockaddr*>(&storage);
+
+	++syscalls.recv;
+
+	// http://man7.org/linux/man-pages/man3/recvfrom.3p.html
+	const auto received = ::recvfrom(this->fd, buffer, size, 0, address, &address_size);
 
-	class addr addr(this->fd, recv); // this constructor must be called before moving buffer.
+	if (received < 0)
+		return { result::from_errno(errno), std::nullopt };
 
-	return std::make_tuple(
-		std::move(buffer),
-		std::move(addr)
-	);
+	return {
+		result { .size = std::size_t(received) },
+		addr(address, address_size, SOCK_DGRAM, this->_address->ai_protocol)
+	};
 }
 
-std::size_t tp3::socket::push::send(
+tp3::socket::result tp3::socket::push::send(
 	const uint8_t buffer[],
 	std::size_t size,
 	const class addr& addr
-) const {
+) const noexcept {
+	++syscalls.send;
+
 	// http://man7.org/linux/man-pages/man3/sendto.3p.html
-	auto result = ::sendto(this->fd, buffer, size, 0, addr->ai_addr, addr->ai_addrlen);
+	const auto sent = ::sendto(this->fd, buffer, size, 0, addr->ai_addr, addr->ai_addrlen);
 
-	if (result < 0)
-		throw std::system_error(errno, std::generic_category());
+	if (sent < 0)
+		return result::from_errno(errno);
 
-	return result;
+	return { .size = std::size_t(sent) };
 }
@@ -1,10 +1,11 @@
 #pragma once
 
 #include <cstdint>
-#include <memory>
+#include <optional>
 #include <tuple>
 
 #include "addr.hpp"
+#include "result.hpp"
 #include "sock.hpp"
 
 
@@ -15,7 +16,8 @@ namespace tp3::socket {
 		// attach must be bind for a server, or push for a client.
 		push(class addr&&, int (&attach)(const sock&));
 
-		std::tuple<std::unique_ptr<uint8_t[]>, class addr> recv(std::size_t&) const;
-		std::size_t send(const uint8_t[], std::size_t, const class addr&) const;
+		// Receive a datagram into buffer, along with the sender's address.
+		std::tuple<result, std::optional<class addr>> recv(uint8_t[], std::size_t) const noexcept;
+		result send(const uint8_t[], std::size_t, const class addr&) const noexcept;
 	};
 }
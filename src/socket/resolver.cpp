@@ -0,0 +1,125 @@
+#include "resolver.hpp"
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+
+
+tp3::socket::resolver::resolver(std::size_t capacity)
+	: capacity(capacity),
+	  worker(&resolver::run, this)
+{ }
+
+tp3::socket::resolver::~resolver() {
+	{
+		std::lock_guard lock(this->mutex);
+		this->stopping = true;
+	}
+
+	this->queued.notify_one();
+	this->worker.join();
+}
+
+
+std::string tp3::socket::resolver::key(const addr& address) {
+	const auto sockaddr = address->ai_addr;
+
+	// The port is not part of the key, as only the host is resolved.
+	switch (sockaddr->sa_family) {
+		case AF_INET: {
+			const auto& in = reinterpret_cast<const sockaddr_in*>(sockaddr)->sin_addr;
+			return std::string(reinterpret_cast<const char*>(&in), sizeof(in));
+		}
+
+		case AF_INET6: {
+			const auto& in6 = reinterpret_cast<const sockaddr_in6*>(sockaddr)->sin6_addr;
+			return std::string(reinterpret_cast<const char*>(&in6), sizeof(in6));
+		}
+
+		default:
+			return std::string(reinterpret_cast<const char*>(sockaddr), address->ai_addrlen);
+	}
+}
+
+
+void tp3::socket::resolver::run() {
+	// Signals must be handled by the event loop thread, so that they interrupt its poll.
+	sigset_t signals;
+	::sigfillset(&signals);
+	// http://man7.org/linux/man-pages/man3/pthread_sigmask.3.html
+	::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	std::unique_lock lock(this->mutex);
+
+	while (true) {
+		this->queued.wait(
+			lock,
+			[this] { return this->stopping || !this->queue.empty(); }
+		);
+
+		if (this->stopping)
+			return;
+
+		const addr address = std::move(this->queue.front());
+		this->queue.pop_front();
+
+		// the host may have been evicted while queued.
+		if (this->cache.find(key(address)) == this->cache.end())
+			continue;
+
+		lock.unlock();
+
+		std::string node;
+
+		try {
+			node = name(address->ai_addr, address->ai_addrlen, NI_NUMERICSERV).node;
+		}
+		catch (const std::system_error&) {
+			// Resolution failed, settle with the numeric host.
+			node = name(address->ai_addr, address->ai_addrlen, NI_NUMERICHOST | NI_NUMERICSERV).node;
+		}
+
+		lock.lock();
+
+		// only fill the entry if it wasn't evicted meanwhile, keeping the cache bounded.
+		if (const auto entry = this->cache.find(key(address)); entry != this->cache.end())
+			entry->second = std::move(node);
+	}
+}
+
+
+tp3::socket::name tp3::socket::resolver::lookup(const addr& address) {
+	name numeric(address->ai_addr, address->ai_addrlen, NI_NUMERICHOST | NI_NUMERICSERV);
+
+	std::lock_guard lock(this->mutex);
+
+	auto [entry, inserted] = this->cache.try_emplace(key(address));
+
+	if (!inserted) {
+		if (const auto& node = entry->second)
+			numeric.node = *node;
+
+		return numeric;
+	}
+
+	if (this->queue.size() >= max_queued) {
+		// Too many hosts are waiting, settle with the numeric name, and retry the next time.
+		this->cache.erase(entry);
+		return numeric;
+	}
+
+	if (this->cache.size() > this->capacity) {
+		// Evict some other host to make room.
+		auto victim = this->cache.begin();
+
+		if (victim == entry)
+			++victim;
+
+		this->cache.erase(victim);
+	}
+
+	this->queue.push_back(address);
+	this->queued.notify_one();
+
+	return numeric;
+}
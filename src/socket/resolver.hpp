@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "addr.hpp"
+
+
+namespace tp3::socket {
+	// An asynchronous reverse name resolver with a cache.
+	// Lookups never block: unresolved hosts are queued for a background thread, and the
+	// numeric name is returned meanwhile. Both the cache and the queue are bounded: while the
+	// queue is full, new hosts are not resolved, and keep their numeric name.
+	class resolver {
+	protected:
+		// Maximum number of hosts waiting for resolution, which may take seconds each.
+		static constexpr std::size_t max_queued = 256;
+
+		const std::size_t capacity; // Maximum number of cached hosts, including the queued.
+
+		std::mutex mutex;
+		std::condition_variable queued;
+
+		std::deque<addr> queue;
+		// Resolved host names, keyed by the raw host address.
+		// An empty optional marks a host that is queued for resolution.
+		std::unordered_map<std::string, std::optional<std::string>> cache;
+
+		bool stopping = false;
+
+		std::thread worker; // Must be the last member, as it uses all the others.
+
+
+		static std::string key(const addr&);
+
+		// The background thread's loop.
+		void run();
+
+
+	public:
+		resolver(std::size_t capacity = 4096);
+		resolver(const resolver&) = delete;
+		resolver(resolver&&) = delete;
+		~resolver();
+
+		resolver& operator=(const resolver&) = delete;
+		resolver& operator=(resolver&&) = delete;
+
+		// Get the name of an address, which is numeric if the host is not yet resolved.
+		name lookup(const addr&);
+	};
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+
+
+namespace tp3::socket {
+	// The outcome of a socket operation.
+	enum class status : uint8_t {
+		ok,
+		would_block, // EAGAIN or EWOULDBLOCK: retry when the socket is ready.
+		interrupted, // EINTR: retry.
+		closed, // The peer closed or reset the connection.
+		error // Any other error.
+	};
+
+
+	// The result of a socket I/O operation, reported as a value instead of an exception, as
+	// failures are common with non-blocking sockets.
+	class result {
+	public:
+		socket::status status = status::ok;
+		std::size_t size = 0; // Bytes transferred, which may be less than requested.
+		int error = 0; // The errno value, if the operation failed.
+
+
+		// Classify a failed syscall.
+		static result from_errno(int error) noexcept {
+			switch (error) {
+				case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+				case EWOULDBLOCK:
+#endif
+					return { .status = status::would_block, .error = error };
+
+				case EINTR:
+					return { .status = status::interrupted, .error = error };
+
+				case EPIPE:
+				case ECONNRESET:
+				case ECONNABORTED:
+					return { .status = status::closed, .error = error };
+
+				default:
+					return { .status = status::error, .error = error };
+			}
+		}
+
+
+		// Whether the operation succeeded, even if partially.
+		explicit operator bool() const noexcept {
+			return this->status == status::ok;
+		}
+
+		// Whether the socket is no longer usable.
+		bool failed() const noexcept {
+			return this->status == status::closed || this->status == status::error;
+		}
+
+		std::error_code code() const {
+			return std::error_code(this->error, std::generic_category());
+		}
+	};
+}
@@ -3,6 +3,7 @@
 #include <cerrno>
 #include <system_error>
 
+#include <fcntl.h>
 #include <sys/socket.h>
 
 
@@ -12,6 +13,13 @@ tp3::socket::server::server(class addr&& address, uint32_t queue_size)
 	  	tp3::socket::sock::bind
 	  )
 {
+	// Non-blocking, so that pending connections can be drained until EAGAIN.
+	// http://man7.org/linux/man-pages/man2/fcntl.2.html
+	const int flags = ::fcntl(this->fd, F_GETFL);
+
+	if (flags < 0 || ::fcntl(this->fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		throw std::system_error(errno, std::generic_category());
+
 	// http://man7.org/linux/man-pages/man2/listen.2.html
 	if (::listen(this->fd, queue_size) < 0)
 		throw std::system_error(errno, std::generic_category());
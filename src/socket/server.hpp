@@ -6,9 +6,10 @@
 
 
 namespace tp3::socket {
-	// A TCP server socket.
+	// A non-blocking TCP server socket.
 	class server : public sock {
 	public:
+		// queue_size is the listen backlog, which the kernel caps to net.core.somaxconn.
 		server(class addr&&, uint32_t queue_size);
 	};
 }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <tuple>
+
+#include <poll.h>
+
+#include "connection.hpp"
+#include "counters.hpp"
+#include "result.hpp"
+#include "server.hpp"
+
+
+namespace tp3::socket {
+	// The kernel's TCP sockets, as a transport for tp3::server::server.
+	// A transport provides the server and connection socket types, accepts connections,
+	// polls descriptors and tells the time. See tp3::socket::memory for an in-process one.
+	struct kernel {
+		using server = tp3::socket::server;
+		using connection = tp3::socket::connection;
+		using clock = std::chrono::steady_clock;
+
+
+		std::tuple<result, std::optional<connection>> accept(const server& server) const noexcept {
+			return connection::accept(server);
+		}
+
+		int poll(pollfd sockets[], nfds_t count, int timeout) const noexcept {
+			++syscalls.poll;
+
+			// http://man7.org/linux/man-pages/man2/poll.2.html
+			return ::poll(sockets, count, timeout);
+		}
+
+		clock::time_point now() const noexcept {
+			return clock::now();
+		}
+	};
+}
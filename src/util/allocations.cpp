@@ -0,0 +1,102 @@
+#include "allocations.hpp"
+
+#include <cstdlib>
+#include <new>
+
+
+// Replacements of the global allocation functions, counting the allocations.
+// https://en.cppreference.com/w/cpp/memory/new/operator_new#Global_replacements
+
+namespace {
+	void* allocate(std::size_t size, std::size_t alignment = 0) noexcept {
+		if (size == 0)
+			size = 1;
+
+		void* pointer = alignment > alignof(std::max_align_t)
+			// http://man7.org/linux/man-pages/man3/aligned_alloc.3.html
+			? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+			: std::malloc(size);
+
+		if (pointer) {
+			++tp3::util::allocations::count.allocations;
+			tp3::util::allocations::count.bytes += size;
+		}
+
+		return pointer;
+	}
+
+	void* allocate_or_throw(std::size_t size, std::size_t alignment = 0) {
+		void* pointer = allocate(size, alignment);
+
+		if (!pointer)
+			throw std::bad_alloc();
+
+		return pointer;
+	}
+
+	void deallocate(void* pointer) noexcept {
+		if (!pointer)
+			return;
+
+		++tp3::util::allocations::count.deallocations;
+		std::free(pointer);
+	}
+}
+
+
+void* operator new(std::size_t size) {
+	return allocate_or_throw(size);
+}
+
+void* operator new[](std::size_t size) {
+	return allocate_or_throw(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	return allocate_or_throw(size, std::size_t(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	return allocate_or_throw(size, std::size_t(alignment));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+
+void operator delete(void* pointer) noexcept {
+	deallocate(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+	deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+	deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+	deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+	deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+	deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+	deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept {
+	deallocate(pointer);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Heap allocation counters, for checking that code paths don't allocate.
+// The counters are only updated in programs linked with allocations.o, which replaces the
+// global operator new and delete with counting ones.
+namespace tp3::util::allocations {
+	struct counters {
+		uint64_t allocations = 0;
+		uint64_t deallocations = 0;
+		uint64_t bytes = 0; // Bytes allocated.
+	};
+
+	// The allocations made by the calling thread.
+	inline thread_local counters count;
+
+
+	// Counts the allocations made by the calling thread during its lifetime.
+	class scope {
+	protected:
+		const counters start;
+
+	public:
+		scope() noexcept
+			: start(count) { }
+
+		counters counted() const noexcept {
+			return {
+				.allocations = count.allocations - this->start.allocations,
+				.deallocations = count.deallocations - this->start.deallocations,
+				.bytes = count.bytes - this->start.bytes
+			};
+		}
+	};
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+
+#include <util/boxed_array.hpp>
+
+
+namespace tp3::util {
+	// A non-owning view of a contiguous array, valid as long as the viewed data.
+	template<typename T>
+	class array_view {
+	protected:
+		const T* _begin;
+		const T* _end;
+
+	public:
+		array_view() noexcept
+			: _begin(nullptr),
+			  _end(nullptr) { }
+
+		array_view(const T* begin, const T* end) noexcept
+			: _begin(begin),
+			  _end(end) { }
+
+		array_view(const boxed_array<T>& array) noexcept
+			: array_view(array.begin(), array.end()) { }
+
+
+		const T* get() const noexcept {
+			return this->_begin;
+		}
+
+		const T& operator[](std::size_t ix) const {
+			return this->_begin[ix];
+		}
+
+		std::size_t size() const noexcept {
+			return this->_end - this->_begin;
+		}
+
+		const T* begin() const noexcept {
+			return this->_begin;
+		}
+
+		const T* end() const noexcept {
+			return this->_end;
+		}
+
+
+		bool operator==(const array_view& other) const {
+			return this->size() == other.size()
+			    && std::equal(
+			       	this->begin(),
+			       	this->end(),
+			       	other.begin()
+			       );
+		}
+	};
+}
+
+// The same hash as boxed_array's, so that an array and a view of it hash alike.
+template<typename T>
+struct std::hash<tp3::util::array_view<T>> {
+	std::size_t operator()(const tp3::util::array_view<T>& view) const noexcept {
+		std::size_t seed = view.size();
+
+		for(const auto& e : view)
+			seed ^= std::hash<T>{}(e)
+			      + 0x9e3779b9
+			      + (seed << 6)
+			      + (seed >> 2);
+
+		return seed;
+	}
+};
+
+namespace tp3::util {
+	template<typename T>
+	std::ostream& operator<<(std::ostream &o, const array_view<T>& view) {
+		for (auto b : view)
+			o << b;
+
+		return o;
+	}
+}
@@ -172,10 +172,13 @@ struct std::hash<tp3::util::boxed_array<T>> {
 	}
 };
 
-template<typename T>
-std::ostream& operator<<(std::ostream &o, const tp3::util::boxed_array<T>& array) {
-	for (auto b : array)
-		o << b;
+namespace tp3::util {
+	// Defined in the class' namespace, so that it is found by argument dependent lookup.
+	template<typename T>
+	std::ostream& operator<<(std::ostream &o, const boxed_array<T>& array) {
+		for (auto b : array)
+			o << b;
 
-	return o;
+		return o;
+	}
 }
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+
+namespace tp3::util {
+	// A dispatch table from runtime sizes to compile time sizes.
+	// Each size in the set gets its own instantiation of the dispatched function, which
+	// receives the size as a std::integral_constant.
+	template<std::size_t... sizes>
+	class size_dispatch {
+		static_assert(sizeof...(sizes) > 0);
+
+	public:
+		static constexpr std::array<std::size_t, sizeof...(sizes)> values { sizes... };
+
+
+		static constexpr bool contains(std::size_t size) noexcept {
+			for (auto value : values)
+				if (value == size)
+					return true;
+
+			return false;
+		}
+
+
+		// Call function with the compile time constant equal to size.
+		// Throws std::invalid_argument if size is not in the set.
+		template<typename Function>
+		static auto call(std::size_t size, Function&& function) {
+			using result = std::invoke_result_t<
+				Function,
+				std::integral_constant<std::size_t, values[0]>
+			>;
+
+			using entry = result (*)(Function&);
+
+			static constexpr std::array<entry, sizeof...(sizes)> table {
+				[](Function& function) -> result {
+					return function(
+						std::integral_constant<std::size_t, sizes>()
+					);
+				}...
+			};
+
+			const auto it = std::find(values.begin(), values.end(), size);
+
+			if (it == values.end())
+				throw std::invalid_argument("unsupported size");
+
+			return table[it - values.begin()](function);
+		}
+	};
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace tp3::util {
+	// A histogram of unsigned values with bounded relative error, in the style of HDR
+	// histograms: each power of 2 range is split in 2^precision linear sub-buckets.
+	// Recording is a few arithmetic instructions and an increment.
+	template<unsigned precision = 3>
+	class histogram {
+		static_assert(precision > 0 && precision < 16);
+
+	protected:
+		static constexpr uint64_t sub_buckets = uint64_t(1) << precision;
+		static constexpr std::size_t buckets = (65 - precision) * sub_buckets;
+
+		std::array<uint64_t, buckets> counts { };
+
+		uint64_t _count = 0;
+		uint64_t _sum = 0;
+		uint64_t _max = 0;
+
+
+		static std::size_t index(uint64_t value) noexcept {
+			if (value < sub_buckets)
+				return value;
+
+			const unsigned exponent = 63 - __builtin_clzll(value);
+			const unsigned shift = exponent - precision;
+
+			return (shift + 1) * sub_buckets + ((value >> shift) - sub_buckets);
+		}
+
+		// The highest value in the bucket.
+		static uint64_t upper(std::size_t index) noexcept {
+			if (index < sub_buckets)
+				return index;
+
+			const unsigned shift = index / sub_buckets - 1;
+			const uint64_t top = index % sub_buckets + sub_buckets;
+
+			return ((top + 1) << shift) - 1;
+		}
+
+
+	public:
+		void record(uint64_t value) noexcept {
+			++this->counts[index(value)];
+			++this->_count;
+			this->_sum += value;
+			this->_max = std::max(this->_max, value);
+		}
+
+
+		uint64_t count() const noexcept {
+			return this->_count;
+		}
+
+		uint64_t max() const noexcept {
+			return this->_max;
+		}
+
+		double mean() const noexcept {
+			return this->_count == 0 ? 0 : double(this->_sum) / this->_count;
+		}
+
+		// The value below which the fraction p of the recorded values fall, up to the
+		// histogram's precision.
+		uint64_t percentile(double p) const noexcept {
+			if (this->_count == 0)
+				return 0;
+
+			const uint64_t rank = std::max<uint64_t>(1, p * this->_count + 0.5);
+
+			uint64_t seen = 0;
+
+			for (std::size_t i = 0; i < buckets; ++i) {
+				seen += this->counts[i];
+
+				if (seen >= rank)
+					return std::min(upper(i), this->_max);
+			}
+
+			return this->_max;
+		}
+
+
+		void merge(const histogram& other) noexcept {
+			for (std::size_t i = 0; i < buckets; ++i)
+				this->counts[i] += other.counts[i];
+
+			this->_count += other._count;
+			this->_sum += other._sum;
+			this->_max = std::max(this->_max, other._max);
+		}
+
+		void reset() noexcept {
+			*this = histogram();
+		}
+	};
+}
@@ -0,0 +1,227 @@
+#include "log.hpp"
+
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+
+
+void tp3::util::log::encode(record& record, const tp3::socket::addr& address) noexcept {
+	const auto sockaddr = address->ai_addr;
+
+	const void* host;
+	std::size_t host_size;
+	uint16_t port;
+
+	switch (sockaddr->sa_family) {
+		case AF_INET: {
+			const auto in = reinterpret_cast<const sockaddr_in*>(sockaddr);
+			host = &in->sin_addr;
+			host_size = sizeof(in->sin_addr);
+			port = in->sin_port;
+			break;
+		}
+
+		case AF_INET6: {
+			const auto in6 = reinterpret_cast<const sockaddr_in6*>(sockaddr);
+			host = &in6->sin6_addr;
+			host_size = sizeof(in6->sin6_addr);
+			port = in6->sin6_port;
+			break;
+		}
+
+		default:
+			return;
+	}
+
+	if (!reserve(record, 2 + sizeof(port) + host_size))
+		return;
+
+	record.payload[record.size++] = uint8_t(tag::address);
+	record.payload[record.size++] = sockaddr->sa_family;
+	std::memcpy(record.payload + record.size, &port, sizeof(port));
+	record.size += sizeof(port);
+	std::memcpy(record.payload + record.size, host, host_size);
+	record.size += host_size;
+}
+
+
+tp3::util::log::writer::writer(std::ostream& output, level output_level, std::size_t history)
+	: output(output),
+	  output_level(output_level),
+	  history(history),
+	  thread(&writer::run, this)
+{ }
+
+tp3::util::log::writer::~writer() {
+	this->stopping.store(true, std::memory_order_relaxed);
+	this->thread.join();
+}
+
+
+void tp3::util::log::writer::run() {
+	// Signals must be handled by the event loop thread, so that they interrupt its poll.
+	sigset_t signals;
+	::sigfillset(&signals);
+	// http://man7.org/linux/man-pages/man3/pthread_sigmask.3.html
+	::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	while (true) {
+		const bool stopping = this->stopping.load(std::memory_order_relaxed);
+
+		const bool wrote = this->drain();
+
+		if (dump_requested.exchange(false, std::memory_order_relaxed))
+			this->dump();
+
+		if (stopping)
+			break;
+
+		if (!wrote) {
+			this->output.flush();
+			// Producers never wait for the writer, so poll the queue.
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+	}
+
+	if (const auto count = dropped.exchange(0))
+		this->output << "log: dropped " << count << " records" << std::endl;
+
+	this->output.flush();
+}
+
+
+bool tp3::util::log::writer::drain() {
+	record record;
+	bool any = false;
+
+	while (records.pop(record)) {
+		any = true;
+
+		if (record.event->level >= this->output_level)
+			this->print(this->output, record);
+
+		if (this->history.empty())
+			continue;
+
+		this->history[this->history_next] = record;
+		this->history_next = (this->history_next + 1) % this->history.size();
+		this->history_size = std::min(this->history_size + 1, this->history.size());
+	}
+
+	return any;
+}
+
+
+void tp3::util::log::writer::dump() {
+	std::cerr << "flight recorder: last " << this->history_size << " events" << std::endl;
+
+	const std::size_t first = (this->history_next + this->history.size() - this->history_size)
+	                        % std::max<std::size_t>(this->history.size(), 1);
+
+	for (std::size_t i = 0; i < this->history_size; ++i)
+		this->print(std::cerr, this->history[(first + i) % this->history.size()]);
+
+	std::cerr << "flight recorder: end" << std::endl;
+}
+
+
+void tp3::util::log::writer::print(std::ostream& stream, const record& record) {
+	static const char* const levels[] = { "debug", "info", "warning", "error" };
+
+	// timestamp:
+	const std::time_t seconds = record.time / 1000000000;
+	const auto millis = (record.time / 1000000) % 1000;
+
+	std::tm time;
+	::localtime_r(&seconds, &time);
+
+	stream << std::put_time(&time, "%F %T") << '.'
+	       << std::setfill('0') << std::setw(3) << millis << std::setfill(' ')
+	       << ' ' << levels[std::size_t(record.event->level)] << ": ";
+
+	// message:
+	const uint8_t* field = record.payload;
+	const uint8_t* const end = record.payload + record.size;
+
+	for (const char* format = record.event->format; *format != '\0'; ++format) {
+		if (format[0] != '{' || format[1] != '}') {
+			stream << *format;
+			continue;
+		}
+
+		++format;
+
+		if (field == end) {
+			stream << "?";
+			continue;
+		}
+
+		switch (tag(*field++)) {
+			case tag::number: {
+				uint64_t number;
+				std::memcpy(&number, field, sizeof(number));
+				field += sizeof(number);
+
+				stream << number;
+				break;
+			}
+
+			case tag::error: {
+				int error;
+				std::memcpy(&error, field, sizeof(error));
+				field += sizeof(error);
+
+				stream << std::strerror(error);
+				break;
+			}
+
+			case tag::bytes: {
+				const std::size_t size = *field++;
+
+				stream.write(reinterpret_cast<const char*>(field), size);
+				field += size;
+				break;
+			}
+
+			case tag::address: {
+				sockaddr_storage storage { };
+				socklen_t size;
+
+				const auto family = *field++;
+
+				if (family == AF_INET) {
+					auto& in = reinterpret_cast<sockaddr_in&>(storage);
+					in.sin_family = AF_INET;
+					std::memcpy(&in.sin_port, field, sizeof(in.sin_port));
+					std::memcpy(&in.sin_addr, field + sizeof(in.sin_port), sizeof(in.sin_addr));
+					field += sizeof(in.sin_port) + sizeof(in.sin_addr);
+					size = sizeof(in);
+				}
+				else {
+					auto& in6 = reinterpret_cast<sockaddr_in6&>(storage);
+					in6.sin6_family = AF_INET6;
+					std::memcpy(&in6.sin6_port, field, sizeof(in6.sin6_port));
+					std::memcpy(&in6.sin6_addr, field + sizeof(in6.sin6_port), sizeof(in6.sin6_addr));
+					field += sizeof(in6.sin6_port) + sizeof(in6.sin6_addr);
+					size = sizeof(in6);
+				}
+
+				stream << this->resolver.lookup(
+					tp3::socket::addr(
+						reinterpret_cast<const sockaddr*>(&storage),
+						size,
+						SOCK_STREAM
+					)
+				);
+				break;
+			}
+		}
+	}
+
+	stream << '\n';
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include <socket/addr.hpp>
+#include <socket/resolver.hpp>
+#include <util/array_view.hpp>
+#include <util/ring.hpp>
+
+
+// The lowest log level compiled in, see tp3::util::log::level. Writes of lower levels are
+// compiled out entirely.
+#ifndef TP3_LOG_LEVEL
+#define TP3_LOG_LEVEL 1
+#endif
+
+
+// An asynchronous logger.
+// Log writes encode their arguments into a fixed size binary record and push it to a
+// lock-free queue, never blocking: if the queue is full, the record is dropped. A
+// background writer formats the records and keeps the last ones in a flight recorder.
+namespace tp3::util::log {
+	enum class level : uint8_t {
+		debug = 0,
+		info = 1,
+		warning = 2,
+		error = 3
+	};
+
+	constexpr level compiled_level = level(TP3_LOG_LEVEL);
+
+
+	// A log event. Each {} in the format is replaced by an argument of the write.
+	struct event {
+		log::level level;
+		const char* format;
+	};
+
+	// An errno value, formatted as its description.
+	struct error_code {
+		int value;
+	};
+
+
+	// Argument type tags in the record payload.
+	enum class tag : uint8_t {
+		number,
+		bytes,
+		address,
+		error
+	};
+
+	// A binary log record.
+	struct record {
+		uint64_t time; // Nanoseconds since the epoch.
+		const log::event* event;
+		uint8_t size; // Used payload bytes.
+		uint8_t payload[47]; // Arguments, each preceded by its tag.
+	};
+
+	static_assert(sizeof(record) == 64);
+
+
+	inline ring<record, 8192> records;
+	inline std::atomic<uint64_t> dropped = 0; // Records dropped because the queue was full.
+	inline std::atomic<bool> dump_requested = false;
+
+
+	// Request the writer to dump the flight recorder. Async-signal-safe.
+	inline void request_dump() noexcept {
+		dump_requested.store(true, std::memory_order_relaxed);
+	}
+
+
+	// Arguments that don't fit in the payload are left out.
+	inline bool reserve(record& record, std::size_t size) noexcept {
+		return record.size + size <= sizeof(record.payload);
+	}
+
+	inline void encode(record& record, uint64_t number) noexcept {
+		if (!reserve(record, 1 + sizeof(number)))
+			return;
+
+		record.payload[record.size++] = uint8_t(tag::number);
+		std::memcpy(record.payload + record.size, &number, sizeof(number));
+		record.size += sizeof(number);
+	}
+
+	inline void encode(record& record, error_code error) noexcept {
+		if (!reserve(record, 1 + sizeof(error.value)))
+			return;
+
+		record.payload[record.size++] = uint8_t(tag::error);
+		std::memcpy(record.payload + record.size, &error.value, sizeof(error.value));
+		record.size += sizeof(error.value);
+	}
+
+	// Byte strings are truncated to fit.
+	inline void encode(record& record, array_view<uint8_t> bytes) noexcept {
+		if (!reserve(record, 2))
+			return;
+
+		const std::size_t size = std::min(
+			bytes.size(),
+			sizeof(record.payload) - record.size - 2
+		);
+
+		record.payload[record.size++] = uint8_t(tag::bytes);
+		record.payload[record.size++] = size;
+		std::memcpy(record.payload + record.size, bytes.get(), size);
+		record.size += size;
+	}
+
+	// Only the numeric host and port are stored. The writer resolves the name.
+	void encode(record& record, const tp3::socket::addr& address) noexcept;
+
+
+	template<const event& event, typename... Args>
+	void write(const Args&... args) noexcept {
+		if constexpr (event.level >= compiled_level) {
+			record record {
+				.time = uint64_t(
+					std::chrono::duration_cast<std::chrono::nanoseconds>(
+						std::chrono::system_clock::now().time_since_epoch()
+					)
+					.count()
+				),
+				.event = &event,
+				.size = 0
+			};
+
+			(encode(record, args), ...);
+
+			if (!records.push(record))
+				dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+
+	// The background writer, consuming the records.
+	// There must be at most one writer at a time.
+	class writer {
+	protected:
+		std::ostream& output;
+		const level output_level; // Records of lower levels are only kept in the flight recorder.
+
+		// The flight recorder, holding the last records of all levels.
+		std::vector<record> history;
+		std::size_t history_next = 0;
+		std::size_t history_size = 0;
+
+		tp3::socket::resolver resolver;
+
+		std::atomic<bool> stopping = false;
+		std::thread thread; // Must be the last member, as it uses all the others.
+
+
+		void run();
+		// Write all queued records. Returns whether there were any.
+		bool drain();
+		void dump();
+		void print(std::ostream&, const record&);
+
+
+	public:
+		writer(std::ostream& output, level output_level = level::info, std::size_t history = 1024);
+		writer(const writer&) = delete;
+		~writer(); // Writes the remaining records.
+
+		writer& operator=(const writer&) = delete;
+	};
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+
+namespace tp3::util {
+	// Parse a decimal number, up to end. Returns nothing if not a number, or if greater than
+	// max, which also keeps the number from overflowing.
+	template<typename ForwardIterator>
+	std::optional<std::size_t> decode_number(ForwardIterator begin, ForwardIterator end, std::size_t max = SIZE_MAX) {
+		if (begin == end)
+			return {};
+
+		std::size_t number = 0;
+
+		for (; begin != end; ++begin) {
+			if (*begin < '0' || *begin > '9')
+				return {};
+
+			const std::size_t digit = *begin - '0';
+
+			if (number > (max - digit) / 10)
+				return {};
+
+			number = number * 10 + digit;
+		}
+
+		return number;
+	}
+}
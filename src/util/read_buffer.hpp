@@ -1,48 +1,66 @@
 #pragma once
 
-#include <iostream>
-
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
-#include <vector>
 #include <optional>
 
-#include <socket/connection.hpp>
+#include <util/boxed_array.hpp>
 
 
 namespace tp3::util {
 	// A message read buffer for a connection socket.
+	// The buffer keeps the scan state between reads, so that each received byte is only
+	// searched once for the frame delimiters, regardless of how fragmented the data is.
 	template<std::size_t size>
 	class read_buffer {
 	protected:
-		// The inner buffer to read.
-		// This buffer *must not* change capacity. The capacity supposed to be fixed, and only
-		// the size should variate between 0 and capacity.
-		std::vector<uint8_t> buffer;
+		static constexpr std::size_t npos = -1;
+
+		// The inner buffer to read. Its capacity is fixed, and only the range [begin, end)
+		// contains unconsumed data.
+		boxed_array<uint8_t> buffer;
+
+		std::size_t begin = 0; // The first unconsumed byte.
+		std::size_t end = 0; // The end of the received data.
 
+		std::size_t heading = npos; // The heading token of the pending frame, if found.
+		std::size_t scanned = 0; // Bytes before this have been searched for the current token.
 
-		// Read bytes into buffer.
-		void read(const tp3::socket::connection& connection) {
-			const auto current_size = this->buffer.size();
+		std::size_t frame = 0; // The size of the last extracted message.
+		std::size_t last = 0; // Where the last read placed its data.
 
-			if (current_size == size) // Buffer is full.
-				return;
 
-			this->buffer.resize(size); // Extend the buffer to the end for reading.
+		// Discard all data in the buffer.
+		void reset() noexcept {
+			this->begin = 0;
+			this->end = 0;
+			this->heading = npos;
+			this->scanned = 0;
+		}
 
-			uint8_t* end = &this->buffer[current_size];
+		// Move the unconsumed data to the start of the buffer.
+		void compact() noexcept {
+			uint8_t* data = this->buffer.get();
 
-			const auto added_size = connection.recv(
-				end,
-				size - current_size
+			std::copy(
+				data + this->begin,
+				data + this->end,
+				data
 			);
 
-			this->buffer.resize(current_size + added_size); // Remove excess elements.
+			this->end -= this->begin;
+			this->scanned -= this->begin;
+
+			if (this->heading != npos)
+				this->heading -= this->begin;
+
+			this->begin = 0;
 		}
 
 
 	public:
-		using parser_iter = typename decltype(buffer)::iterator;
+		using parser_iter = uint8_t*;
 
 
 		read_buffer(const read_buffer&) = delete;
@@ -50,58 +68,132 @@ namespace tp3::util {
 		read_buffer& operator=(const read_buffer&) = delete;
 		read_buffer& operator=(read_buffer&&) = default;
 
-		read_buffer() noexcept {
-			this->buffer.reserve(size);
+		read_buffer()
+			: buffer(size) { }
+
+
+		// Whether the buffer is full of unconsumed data.
+		bool full() const noexcept {
+			return this->end == size && this->begin == 0;
+		}
+
+		// How many bytes the next read will request from the source.
+		std::size_t tail() const noexcept {
+			return this->end == size ? this->begin
+			                         : size - this->end;
+		}
+
+		// The size of the last message extracted by next.
+		std::size_t frame_size() const noexcept {
+			return this->frame;
+		}
+
+		// The data received by the last read. Only valid until next is called.
+		const uint8_t* last_read() const noexcept {
+			return this->buffer.get() + this->last;
+		}
+
+		// Whether the buffer has no unconsumed data.
+		bool empty() const noexcept {
+			return this->begin == this->end;
+		}
+
+		// The unconsumed data size.
+		std::size_t buffered() const noexcept {
+			return this->end - this->begin;
+		}
+
+
+		// Read up to limit bytes from source into the buffer, returning the result of
+		// source.recv, which must report the received bytes in its size member.
+		// Must not be called when the buffer is full.
+		template<typename Source>
+		auto read(const Source& source, std::size_t limit = size) {
+			if (this->end == size)
+				this->compact();
+
+			uint8_t* data = this->buffer.get();
+
+			this->last = this->end;
+
+			const auto result = source.recv(
+				data + this->end,
+				std::min(size - this->end, limit)
+			);
+
+			this->end += result.size;
+
+			return result;
 		}
 
 
-		// Read a message from the buffer.
+		// Extract the next message from the buffered data, without reading from the source.
 		template<typename Message, typename Token, typename Parser>
-		std::optional<Message> read(
-			const tp3::socket::connection& connection,
+		std::optional<Message> next(
 			Parser parser,
 			Token heading_tok,
 			Token end_tok
 		) {
-			this->read(connection);
-
-			auto begin = this->buffer.begin();
-			const auto end = this->buffer.end();
-
-			std::optional<Message> message;
-
-			while (!message) {
-				begin = std::find(begin, end, heading_tok);
-
-				if (begin == end) { // heading token not found, data must be trash.
-					this->buffer.clear();
-					return {};
+			uint8_t* const data = this->buffer.get();
+
+			while (true) {
+				if (this->heading == npos) {
+					const auto heading = std::find(
+						data + this->scanned,
+						data + this->end,
+						heading_tok
+					);
+
+					if (heading == data + this->end) { // heading token not found, data must be trash.
+						this->reset();
+						return {};
+					}
+
+					this->heading = heading - data;
+					this->begin = this->heading;
+					this->scanned = this->heading + 1;
 				}
 
-				auto msg_end = std::find(begin, end, end_tok);
+				const auto msg_end = std::find(
+					data + this->scanned,
+					data + this->end,
+					end_tok
+				);
+
+				if (msg_end == data + this->end) { // end token not found
+					this->scanned = this->end;
 
-				if (msg_end == end) { // end token not found
-					if (this->buffer.size() == size)
+					if (this->end - this->begin == size)
 						// the message is larger than the buffer, so we can't handle it.
-						this->buffer.clear();
+						this->reset();
 
 					return {};
 				}
 
 				// The parser should move begin to the point where it consumed.
-				message = parser(
+				parser_iter begin = data + this->heading;
+
+				auto message = parser(
 					begin,
 					msg_end + 1
 				);
-			}
 
-			// A message has been parsed, remove it from the buffer.
-			this->buffer.erase(
-				this->buffer.begin(),
-				begin
-			);
+				// Make sure we progress even if the parser didn't consume anything.
+				this->begin = std::max<std::size_t>(begin - data, this->heading + 1);
+				this->scanned = this->begin;
 
-			return message;
+				if (message)
+					this->frame = this->begin - this->heading;
+
+				this->heading = npos;
+
+				if (message) {
+					if (this->empty())
+						this->reset();
+
+					return message;
+				}
+			}
 		}
 	};
 }
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+
+namespace tp3::util {
+	// A bounded lock-free multiple producer, single consumer queue.
+	// Pushing never blocks: it fails when the queue is full.
+	// http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+	template<typename T, std::size_t capacity>
+	class ring {
+		static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "capacity must be a power of 2");
+		static_assert(std::is_trivially_copyable<T>::value);
+
+	protected:
+		static constexpr std::size_t mask = capacity - 1;
+
+		struct slot {
+			// The position this slot is ready for: equal to the position when the slot is free
+			// for pushing, or to the position + 1 when it holds an element to pop.
+			std::atomic<std::size_t> sequence;
+			T data;
+		};
+
+		std::unique_ptr<slot[]> slots;
+
+		alignas(64) std::atomic<std::size_t> tail = 0; // The next position to push.
+		alignas(64) std::size_t head = 0; // The next position to pop, only used by the consumer.
+
+
+	public:
+		ring()
+			: slots(
+			  	std::make_unique<slot[]>(capacity)
+			  )
+		{
+			for (std::size_t i = 0; i < capacity; ++i)
+				this->slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		ring(const ring&) = delete;
+		ring& operator=(const ring&) = delete;
+
+
+		bool push(const T& data) noexcept {
+			std::size_t position = this->tail.load(std::memory_order_relaxed);
+
+			while (true) {
+				auto& slot = this->slots[position & mask];
+
+				const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+				const auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+
+				if (diff == 0) {
+					if (
+						this->tail.compare_exchange_weak(
+							position,
+							position + 1,
+							std::memory_order_relaxed
+						)
+					) {
+						slot.data = data;
+						slot.sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0) // full.
+					return false;
+				else // another producer took this position.
+					position = this->tail.load(std::memory_order_relaxed);
+			}
+		}
+
+
+		// Must only be called by the consumer.
+		bool pop(T& data) noexcept {
+			auto& slot = this->slots[this->head & mask];
+
+			if (slot.sequence.load(std::memory_order_acquire) != this->head + 1) // empty.
+				return false;
+
+			data = slot.data;
+			slot.sequence.store(this->head + capacity, std::memory_order_release);
+
+			++this->head;
+
+			return true;
+		}
+	};
+}
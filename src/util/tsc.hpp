@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+// A cheap timestamp counter. On x86 this reads the time stamp counter, which is constant
+// rate on any modern processor. Elsewhere, it falls back to the steady clock.
+namespace tp3::util::tsc {
+	inline uint64_t now() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()
+		)
+		.count();
+#endif
+	}
+
+
+	// Nanoseconds per tick, measured against the steady clock on the first call, which
+	// takes about 10 milliseconds.
+	inline double ns_per_tick() {
+		static const double value = [] {
+			using clock = std::chrono::steady_clock;
+
+			const auto start = clock::now();
+			const auto start_ticks = now();
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+			const auto ticks = now() - start_ticks;
+			const auto elapsed = std::chrono::duration<double, std::nano>(clock::now() - start);
+
+			return ticks == 0 ? 1 : elapsed.count() / ticks;
+		}();
+
+		return value;
+	}
+}
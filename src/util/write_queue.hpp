@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <util/boxed_array.hpp>
+
+
+namespace tp3::util {
+	// An outgoing data queue for a non-blocking connection socket, holding the data that
+	// the socket could not take yet.
+	class write_queue {
+	protected:
+		struct packet {
+			boxed_array<uint8_t> owned; // The data, when copied into the queue.
+			std::shared_ptr<const std::vector<uint8_t>> shared; // The data, when shared.
+			const uint8_t* data;
+			std::size_t size;
+		};
+
+		std::deque<packet> packets;
+
+		std::size_t offset = 0; // Bytes of the front packet that were already sent.
+		std::size_t _size = 0; // Queued bytes, excluding the offset.
+		uint64_t _sent = 0; // Bytes sent from the queue since construction.
+
+
+	public:
+		bool empty() const noexcept {
+			return this->packets.empty();
+		}
+
+		std::size_t size() const noexcept {
+			return this->_size;
+		}
+
+		// Positions in the stream of all bytes ever queued: the next byte to be sent, and the
+		// end of the queued data.
+		uint64_t sent() const noexcept {
+			return this->_sent;
+		}
+
+		uint64_t queued() const noexcept {
+			return this->_sent + this->_size;
+		}
+
+
+		void push(const uint8_t data[], std::size_t size) {
+			boxed_array<uint8_t> owned(data, data + size);
+			const uint8_t* copy = owned.get();
+
+			this->packets.push_back(packet { std::move(owned), nullptr, copy, size });
+			this->_size += size;
+		}
+
+		// Queue a shared buffer from offset on, without copying it. The buffer must not change
+		// while queued.
+		void push(std::shared_ptr<const std::vector<uint8_t>> shared, std::size_t offset = 0) {
+			const uint8_t* data = shared->data() + offset;
+			const std::size_t size = shared->size() - offset;
+
+			this->packets.push_back(packet { boxed_array<uint8_t>(), std::move(shared), data, size });
+			this->_size += size;
+		}
+
+
+		// Send queued data to sink until it would block or fail, returning the result of the
+		// last sink.send, which must report the sent bytes in its size member.
+		template<typename Sink>
+		auto flush(const Sink& sink) -> decltype(sink.send(nullptr, 0)) {
+			while (!this->packets.empty()) {
+				const auto& packet = this->packets.front();
+
+				const auto result = sink.send(
+					packet.data + this->offset,
+					packet.size - this->offset
+				);
+
+				this->offset += result.size;
+				this->_size -= result.size;
+				this->_sent += result.size;
+
+				if (this->offset < packet.size) // would block or failed.
+					return result;
+
+				this->packets.pop_front();
+				this->offset = 0;
+			}
+
+			return {};
+		}
+	};
+}